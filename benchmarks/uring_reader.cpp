@@ -0,0 +1,167 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/LogReader.hpp"
+#include "src/UringReader.hpp"
+
+/**
+ * Times reading a set of rotated files until all lines were handed over,
+ * by LogReaders on the reactor and by the UringReader at several depths,
+ * with the files in the page cache (warm) and evicted from it (cold).
+ *
+ * The files are generated in the given directory unless they exist. The
+ * pages are evicted with POSIX_FADV_DONTNEED, which needs no privileges
+ * but only drops clean pages of files on a local file system, not on
+ * e.g. tmpfs.
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const std::vector<unsigned> kDepths{0u, 1u, 8u, 32u, 128u};
+
+std::vector<std::string> generate(const std::string& directory, size_t fileCnt, size_t lineCnt) {
+
+    std::vector<std::string> files;
+    for (size_t i = 0; i < fileCnt; i++) {
+        files.push_back(directory + "/app.log." + std::to_string(i));
+        if (::access(files.back().c_str(), R_OK) == 0) {
+            continue;
+        }
+        std::ofstream file(files.back());
+        for (size_t line = 0; line < lineCnt; line++) {
+            file << "2024-05-01 12:00:" << std::setw(2) << std::setfill('0') << line % 60
+                 << " INFO worker=" << line % 16 << " request=" << i * lineCnt + line
+                 << " took " << line % 997 << " ms\n";
+        }
+    }
+    return files;
+}
+
+//! @return False if a file couldn't be evicted.
+bool evict(const std::vector<std::string>& files) {
+    bool success = true;
+    for (const auto& filename : files) {
+        int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        // Dirty pages are not dropped
+        success = success && fd >= 0 && ::fdatasync(fd) == 0
+            && ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+    return success;
+}
+
+void waitFor(const std::atomic<size_t>& done, size_t cnt) {
+    while (done < cnt) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+
+/**
+ * @param depth Reads in flight through io_uring, 0 for the reactor.
+ * @return Milliseconds until all lines were handed over, or -1 if
+ *         io_uring isn't available.
+ */
+double run(const std::vector<std::string>& files, unsigned depth, size_t* lineCnt) {
+
+    std::atomic<size_t> lines{0u};
+    std::atomic<size_t> done{0u};
+    auto start = Clock::now();
+
+    if (depth == 0u) {
+        Reactor reactor;
+        std::vector<std::unique_ptr<LogReader>> readers;
+        for (const auto& filename : files) {
+            readers.emplace_back(std::make_unique<LogReader>(reactor, filename, [&done] () { done++; },
+                [&lines] (const std::vector<std::string_view>& batch) { lines += batch.size(); }, false));
+        }
+        waitFor(done, files.size());
+    }
+    else {
+        UringReader reader(files,
+            [&lines] (size_t, const std::vector<std::string_view>& batch) { lines += batch.size(); },
+            nullptr,
+            [&done] (size_t, size_t) { done++; },
+            depth);
+        if (!reader.isOpen()) {
+            return -1.0;
+        }
+        waitFor(done, files.size());
+    }
+
+    *lineCnt = lines;
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2u];
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <directory> [files] [lines per file] [runs]\n\n"
+                  << "Defaults to 300 files of 23333 lines, about 400 MB, and 7 runs." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    size_t fileCnt = argc > 2 ? std::stoul(argv[2]) : 300u;
+    size_t lineCnt = argc > 3 ? std::stoul(argv[3]) : 23333u;
+    size_t runs = std::max<size_t>(argc > 4 ? std::stoul(argv[4]) : 7u, 1u);
+
+    auto files = generate(argv[1], fileCnt, lineCnt);
+    if (!evict(files)) {
+        std::cerr << "Failed to evict the files, cold runs read from the cache" << std::endl;
+    }
+
+    std::cout << "Median of " << runs << " runs, " << fileCnt * lineCnt << " lines\n\n"
+              << "                 warm       cold" << std::endl;
+
+    for (unsigned depth : kDepths) {
+
+        std::vector<double> warm;
+        std::vector<double> cold;
+        size_t lines = 0u;
+        bool available = true;
+
+        for (size_t i = 0; i < runs && available; i++) {
+            // Also warms the cache for the first warm run
+            evict(files);
+            cold.push_back(run(files, depth, &lines));
+            warm.push_back(run(files, depth, &lines));
+            available = cold.back() >= 0.0;
+        }
+
+        std::string name = depth == 0u ? "reactor" : "depth " + std::to_string(depth);
+        std::cout << "  " << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(0);
+        if (!available) {
+            std::cout << "  io_uring not available" << std::endl;
+            continue;
+        }
+        std::cout << std::setw(8) << median(warm) << " ms" << std::setw(8) << median(cold) << " ms";
+        if (lines != fileCnt * lineCnt) {
+            std::cout << "  (" << lines << " lines)";
+        }
+        std::cout << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "IDataModel.hpp"
+#include "QuantileSketch.hpp"
+
+/**
+ * Values of a field captured by a filter, stored by column.
+ *
+ * The type is decided by the first value: a column of numbers keeps them
+ * as doubles, other columns keep ids into a dictionary of distinct values.
+ * Aggregates are updated as values are added, so reading them doesn't
+ * depend on the number of rows.
+ */
+class Column {
+
+public:
+
+    enum class Type { Undecided, Number, Text };
+
+    Column(std::string name, uint8_t tab)
+        : _name(std::move(name))
+        , _tab(tab) {}
+
+    void add(size_t lineId, std::string_view value) {
+
+        if (value.empty()) {
+            return;
+        }
+
+        double number = NAN;
+        bool numeric = parse(value, &number);
+
+        if (_type == Type::Undecided) {
+            _type = numeric ? Type::Number : Type::Text;
+        }
+
+        _lineIds.push_back(lineId);
+
+        if (_type == Type::Number) {
+            _numbers.push_back(number);
+            if (!numeric) {
+                _invalid++;
+                return;
+            }
+            _sum += number;
+            _min = std::min(_min, number);
+            _max = std::max(_max, number);
+            _sketch.add(number);
+            return;
+        }
+
+        auto it = _ids.find(std::string(value));
+        if (it == _ids.end()) {
+            it = _ids.emplace(std::string(value), _dictionary.size()).first;
+            _dictionary.emplace_back(value);
+            _textCounts.push_back(0u);
+        }
+        _texts.push_back(it->second);
+        _textCounts[it->second]++;
+    }
+
+    const std::string& getName() const {
+        return _name;
+    }
+
+    Type getType() const {
+        return _type;
+    }
+
+    //! @return Number of stored values.
+    size_t size() const {
+        return _lineIds.size();
+    }
+
+    //! @return Id of the line the value at the index was captured from.
+    size_t getLineId(size_t index) const {
+        return _lineIds[index];
+    }
+
+    //! @return Numeric value at the index, NaN if it isn't a number.
+    double getNumber(size_t index) const {
+        return _type == Type::Number ? _numbers[index] : NAN;
+    }
+
+    FieldInfo getInfo(size_t maxTop = kDefaultTop) const {
+
+        FieldInfo info{_name, _tab, _type == Type::Number, size(), _invalid};
+
+        if (_type == Type::Number) {
+            bool empty = _sketch.getCount() == 0u;
+            info.sum = _sum;
+            info.min = empty ? NAN : _min;
+            info.max = empty ? NAN : _max;
+            info.p50 = _sketch.getQuantile(0.5);
+            info.p99 = _sketch.getQuantile(0.99);
+        }
+        else if (_type == Type::Text) {
+            std::vector<uint32_t> ids(_dictionary.size());
+            for (uint32_t id = 0; id < ids.size(); id++) {
+                ids[id] = id;
+            }
+            size_t top = std::min(maxTop, ids.size());
+            std::partial_sort(ids.begin(), ids.begin() + top, ids.end(), [this](uint32_t a, uint32_t b) {
+                return _textCounts[a] > _textCounts[b];
+            });
+            for (size_t i = 0; i < top; i++) {
+                info.top.emplace_back(_dictionary[ids[i]], _textCounts[ids[i]]);
+            }
+        }
+
+        return info;
+    }
+
+private:
+
+    static constexpr size_t kDefaultTop = 3u;
+
+    static bool parse(std::string_view value, double* number) {
+        auto first = value.data();
+        auto last = value.data() + value.size();
+        if (*first == '+') {
+            first++;
+        }
+        auto result = std::from_chars(first, last, *number);
+        return result.ec == std::errc() && result.ptr == last;
+    }
+
+    std::string _name;
+    uint8_t _tab;
+    Type _type{Type::Undecided};
+
+    //! Ids of the lines the values were captured from, in order.
+    std::vector<size_t> _lineIds;
+    std::vector<double> _numbers;
+    std::vector<uint32_t> _texts;
+
+    std::vector<std::string> _dictionary;
+    std::unordered_map<std::string, uint32_t> _ids;
+    std::vector<uint64_t> _textCounts;
+
+    size_t _invalid{0u};
+    double _sum{0.0};
+    double _min{std::numeric_limits<double>::infinity()};
+    double _max{-std::numeric_limits<double>::infinity()};
+    QuantileSketch _sketch;
+};
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "Log.hpp"
+
+/**
+ * Command started once, which comments lines sent to its standard input.
+ *
+ * Each request is a header line with a request id and the length of the
+ * log line in bytes, followed by the log line itself:
+ *
+ *     <id> <length>\n<line>
+ *
+ * The command answers on its standard output in the same format, with the
+ * id of the request and the comment. Requests are sent without waiting
+ * for the answers, which may come in any order.
+ */
+class Coprocess {
+
+public:
+
+    using OnResult = std::function<void(std::string result)>;
+
+    explicit Coprocess(const std::string& command) {
+        start(command);
+    }
+
+    ~Coprocess() {
+        stop();
+    }
+
+    bool isRunning() {
+        std::lock_guard<std::mutex> g(_mtx);
+        return _running;
+    }
+
+    /**
+     * Sends the line to the command. The result is passed to the callback
+     * from the reader thread, or an empty one if the command has exited.
+     */
+    void send(const std::string& line, OnResult onResult) {
+
+        std::lock_guard<std::mutex> writing(_writeMtx);
+
+        uint64_t id = 0u;
+        bool running;
+        {
+            std::lock_guard<std::mutex> g(_mtx);
+            running = _running;
+            if (running) {
+                id = _nextId++;
+                _pending[id] = onResult;
+            }
+        }
+        if (!running) {
+            onResult({});
+            return;
+        }
+
+        std::string frame = std::to_string(id) + " " + std::to_string(line.size()) + "\n" + line;
+        if (!writeAll(frame)) {
+            LOG("Failed to write to co-process " << _pid);
+            fail(id);
+        }
+    }
+
+    /**
+     * Terminates the command, requests still waiting get empty results.
+     */
+    void stop() {
+        // Unblocks a write to a command which stopped reading
+        if (_pid > 0) {
+            ::kill(_pid, SIGTERM);
+        }
+        {
+            std::lock_guard<std::mutex> writing(_writeMtx);
+            if (_stdin >= 0) {
+                ::close(_stdin);
+                _stdin = -1;
+            }
+        }
+        if (_reader.joinable()) {
+            _reader.join();
+        }
+        if (_pid > 0) {
+            ::waitpid(_pid, nullptr, 0);
+            _pid = -1;
+        }
+        if (_stdout >= 0) {
+            ::close(_stdout);
+            _stdout = -1;
+        }
+    }
+
+private:
+
+    static constexpr size_t kReadSize = 64u * 1024u;
+
+    void start(const std::string& command) {
+
+        // Writing to a command which exited must not terminate the program
+        ::signal(SIGPIPE, SIG_IGN);
+
+        int input[2];
+        int output[2];
+        if (::pipe2(input, O_CLOEXEC) != 0) {
+            return;
+        }
+        if (::pipe2(output, O_CLOEXEC) != 0) {
+            ::close(input[0]);
+            ::close(input[1]);
+            return;
+        }
+
+        _pid = ::fork();
+        if (_pid == 0) {
+            ::dup2(input[0], STDIN_FILENO);
+            ::dup2(output[1], STDOUT_FILENO);
+            ::execl("/bin/sh", "sh", "-c", command.c_str(), nullptr);
+            ::_exit(127);
+        }
+
+        ::close(input[0]);
+        ::close(output[1]);
+
+        if (_pid < 0) {
+            ::close(input[1]);
+            ::close(output[0]);
+            return;
+        }
+
+        LOG("Started co-process " << _pid << ": " << command);
+        _stdin = input[1];
+        _stdout = output[0];
+        _running = true;
+        _reader = std::thread([this] () { read(); });
+    }
+
+    bool writeAll(std::string_view data) {
+        while (!data.empty()) {
+            ssize_t written = ::write(_stdin, data.data(), data.size());
+            if (written > 0) {
+                data.remove_prefix(written);
+            }
+            else if (written < 0 && errno != EINTR) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void fail(uint64_t id) {
+        OnResult onResult;
+        {
+            std::lock_guard<std::mutex> g(_mtx);
+            auto it = _pending.find(id);
+            if (it == _pending.end()) {
+                return;
+            }
+            onResult.swap(it->second);
+            _pending.erase(it);
+        }
+        onResult({});
+    }
+
+    void read() {
+
+        std::string received;
+        char buffer[kReadSize];
+
+        while (true) {
+            ssize_t size = ::read(_stdout, buffer, sizeof(buffer));
+            if (size < 0 && errno == EINTR) {
+                continue;
+            }
+            if (size <= 0) {
+                break;
+            }
+            received.append(buffer, size);
+
+            size_t offset = 0u;
+            uint64_t id;
+            std::string result;
+            while (extractResult(received, &offset, &id, &result)) {
+                OnResult onResult;
+                {
+                    std::lock_guard<std::mutex> g(_mtx);
+                    auto it = _pending.find(id);
+                    if (it != _pending.end()) {
+                        onResult.swap(it->second);
+                        _pending.erase(it);
+                    }
+                }
+                if (onResult) {
+                    onResult(std::move(result));
+                }
+            }
+            received.erase(0, offset);
+        }
+
+        // Requests still waiting will not be answered
+        std::map<uint64_t, OnResult> pending;
+        {
+            std::lock_guard<std::mutex> g(_mtx);
+            _running = false;
+            pending.swap(_pending);
+        }
+        for (auto& request : pending) {
+            request.second({});
+        }
+        LOG("Co-process " << _pid << " exited");
+    }
+
+    /**
+     * Takes the first complete "<id> <length>\n<result>" out of the data.
+     *
+     * @return False if the result is incomplete.
+     */
+    static bool extractResult(const std::string& data, size_t* offset, uint64_t* id, std::string* result) {
+
+        size_t end = data.find('\n', *offset);
+        if (end == std::string::npos) {
+            return false;
+        }
+
+        char* next = nullptr;
+        *id = std::strtoull(data.c_str() + *offset, &next, 10);
+        size_t length = std::strtoull(next, nullptr, 10);
+        if (data.size() - end - 1u < length) {
+            return false;
+        }
+
+        result->assign(data, end + 1u, length);
+        *offset = end + 1u + length;
+        return true;
+    }
+
+    std::mutex                      _mtx;
+    std::mutex                      _writeMtx;
+    pid_t                           _pid{-1};
+    int                             _stdin{-1};
+    int                             _stdout{-1};
+    bool                            _running{false};
+    uint64_t                        _nextId{0u};
+    std::map<uint64_t, OnResult>    _pending;
+    std::thread                     _reader;
+};
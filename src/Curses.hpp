@@ -1,26 +1,87 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <curses.h>
+#include <fstream>
+#include <iterator>
 #include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
 
 #include "IDataModel.hpp"
 #include "Log.hpp"
 
 class Curses {
 
+    enum class View { Lines, Templates, Fields, Filters, Related, Expanded };
+
+    //! Contents of a screen row, as last written to the window.
+    struct Row {
+        std::string text;
+        int color{0};
+
+        bool operator==(const Row& other) const {
+            return color == other.color && text == other.text;
+        }
+
+        bool operator!=(const Row& other) const {
+            return !(*this == other);
+        }
+    };
+
     std::atomic<bool> _active{false};
     std::vector<std::string> _tabs;
     IDataModel& _data;
-    std::atomic<bool> _drawing{false};
+    //! Held while drawing, or while the menu reads user input, and while
+    //! the UI thread changes what the drawing reads.
+    std::mutex _drawing;
     std::atomic<bool> _screenFilled{false};
     bool _showComments{true};
+    std::atomic<View> _view{View::Lines};
+    std::string _message;
+    std::chrono::steady_clock::time_point _started{std::chrono::steady_clock::now()};
+    //! Time from the start until the first lines were shown, -1 until then.
+    long long _firstScreenMs{-1};
+    //! Keeps the end of the lines in view as new ones arrive.
+    std::atomic<bool> _follow{false};
+
+    //! Full text of the line shown expanded, and the first row shown.
+    size_t _expandedId{SIZE_MAX};
+    std::string _expandedText;
+    size_t _expandedRow{0u};
+
+    //! Rows currently shown, only rows which differ are rewritten.
+    std::vector<Row> _shownRows;
+    int _shownWidth{0};
+    std::string _shownTabs;
+    std::string _shownStatus;
+    std::tuple<size_t, size_t, size_t> _shownThumb;
+
+    //! Bytes curses wrote to the terminal.
+    std::atomic<size_t> _writtenBytes{0u};
+
+    //! Bytes written, sampled to measure the terminal bandwidth used.
+    size_t _rateBytes{0u};
+    std::chrono::steady_clock::time_point _rateStart{_started};
+    size_t _bytesPerSecond{0u};
 
     WINDOW* _winMenu{nullptr};
     WINDOW* _winLines{nullptr};
+    WINDOW* _winScroll{nullptr};
 
     static const int kMenuHeight = 3;
     static const int kMenuWidth = 0; // Full width
+    static const int kScrollWidth = 1;
+    static const int kHorMargin = 2;
+    static const int kStatusRow = 1;
 
 public:
 
@@ -28,11 +89,13 @@ public:
         :_data(data) {
 
         _data.registerOnNewDataAvailableListener([this](){
-            if (!_screenFilled) {
+            if (!_screenFilled || _follow) {
                 redraw();
             }
-            else {
+            else if (renderingAvailable()) {
                 drawMenu();
+                update();
+                _drawing.unlock();
             }
         });
     }
@@ -40,6 +103,7 @@ public:
     ~Curses() {
         ::delwin(_winMenu);
         ::delwin(_winLines);
+        ::delwin(_winScroll);
         endwin();
     }
 
@@ -56,11 +120,15 @@ public:
         }
 
         _winMenu = ::newwin(kMenuHeight, kMenuWidth, 0, 0);
-        _winLines = ::newwin(0, 0, kMenuHeight, 0);
+        _winLines = ::newwin(0, COLS - kScrollWidth, kMenuHeight, 0);
+        _winScroll = ::newwin(0, kScrollWidth, kMenuHeight, COLS - kScrollWidth);
+
+        // Lets curses scroll the region with terminal commands.
+        ::idlok(_winLines, true);
 
         LOG("Curses: " << _active);
 
-        return _active && _winMenu && _winLines;
+        return _active && _winMenu && _winLines && _winScroll;
     }
 
     void initColors() {
@@ -82,9 +150,49 @@ public:
         init_pair(14, COLOR_BLACK, COLOR_RED);
     }
 
-    void setColor(WINDOW* window, uint8_t src, bool positive) {
-        int index = positive ? (src % 7 + 1) : (src % 7 + 8);
-        ::wattron(window, COLOR_PAIR(index));
+    static int getColor(uint8_t src, bool positive) {
+        return positive ? (src % 7 + 1) : (src % 7 + 8);
+    }
+
+    //! Writes the changes of the windows to the terminal, counting the bytes.
+    void update() {
+        size_t before = getThreadWrittenBytes();
+        ::doupdate();
+        _writtenBytes += getThreadWrittenBytes() - before;
+    }
+
+    /**
+     * @return Bytes written by the calling thread so far, of which only
+     *         curses writes while the screen is updated.
+     */
+    static size_t getThreadWrittenBytes() {
+        static const char kCounter[] = "wchar: ";
+        std::ifstream io("/proc/thread-self/io");
+        std::string line;
+        while (std::getline(io, line)) {
+            if (line.compare(0, sizeof(kCounter) - 1u, kCounter) == 0) {
+                return std::strtoull(line.c_str() + sizeof(kCounter) - 1u, nullptr, 10);
+            }
+        }
+        return 0u;
+    }
+
+    //! @return Bytes written to the terminal so far.
+    size_t getWrittenBytes() const {
+        return _writtenBytes;
+    }
+
+    //! @return Bytes written to the terminal per second, over the last second.
+    size_t getBytesPerSecond() {
+        auto now = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - _rateStart).count();
+        if (elapsed >= 1000) {
+            size_t bytes = getWrittenBytes();
+            _bytesPerSecond = (bytes - _rateBytes) * 1000u / elapsed;
+            _rateBytes = bytes;
+            _rateStart = now;
+        }
+        return _bytesPerSecond;
     }
 
     bool run() {
@@ -112,11 +220,57 @@ public:
                     _data.toggleTab(ch - '0');
                     break;
                 case KEY_UP:
-                    _data.scrollUp();
+                    if (_view == View::Expanded) {
+                        scrollExpanded(-1);
+                        break;
+                    }
+                    _follow = false;
+                    if (!_data.scrollUp()) {
+                        _data.loadHistory();
+                    }
                     break;
                 case KEY_DOWN:
+                    if (_view == View::Expanded) {
+                        scrollExpanded(1);
+                        break;
+                    }
+                    _follow = false;
                     _data.scrollDown();
                     break;
+                case KEY_PPAGE:
+                    if (_view == View::Expanded) {
+                        scrollExpanded(-getPageHeight());
+                        break;
+                    }
+                    _follow = false;
+                    scrollPages(-1);
+                    break;
+                case KEY_NPAGE:
+                    if (_view == View::Expanded) {
+                        scrollExpanded(getPageHeight());
+                        break;
+                    }
+                    _follow = false;
+                    scrollPages(1);
+                    break;
+                case KEY_HOME:
+                    _follow = false;
+                    _data.scrollTo(0u);
+                    _data.loadHistory();
+                    break;
+                case KEY_END:
+                    _follow = true;
+                    scrollToEnd();
+                    break;
+                case 'g':
+                case 'G':
+                    _follow = false;
+                    gotoLine();
+                    break;
+                case 'e':
+                case 'E':
+                    exportLines();
+                    break;
                 case 'q':
                 case 'Q':
                     _active = false;
@@ -126,6 +280,41 @@ public:
                 case 'C':
                     toggleComments();
                     break;
+                case 't':
+                case 'T':
+                    toggleView(View::Templates);
+                    break;
+                case 'a':
+                case 'A':
+                    toggleView(View::Fields);
+                    break;
+                case 'p':
+                case 'P':
+                    toggleView(View::Filters);
+                    break;
+                case 'k':
+                    _follow = false;
+                    cycleRelated(false);
+                    break;
+                case 'K':
+                    _follow = false;
+                    cycleRelated(true);
+                    break;
+                case 'r':
+                case 'R':
+                    toggleView(View::Related);
+                    break;
+                case '/':
+                    query();
+                    break;
+                case 'x':
+                case 'X':
+                    {
+                        std::lock_guard<std::mutex> g(_drawing);
+                        _expandedRow = 0u;
+                    }
+                    toggleView(View::Expanded);
+                    break;
             }
         }
 
@@ -133,9 +322,135 @@ public:
     }
 
     void toggleComments() {
+        std::lock_guard<std::mutex> g(_drawing);
         _showComments = !_showComments;
     }
 
+    void toggleView(View view) {
+        _view = _view == view ? View::Lines : view;
+    }
+
+    void scrollExpanded(int rows) {
+        std::lock_guard<std::mutex> g(_drawing);
+        if (rows < 0) {
+            _expandedRow -= std::min(_expandedRow, static_cast<size_t>(-rows));
+        }
+        else {
+            _expandedRow += rows;
+        }
+    }
+
+    int getPageHeight() {
+        int screenWidth, screenHeight;
+        getmaxyx(_winLines, screenHeight, screenWidth);
+        return screenHeight;
+    }
+
+    void scrollPages(int pages) {
+        size_t position = _data.getPosition();
+        size_t delta = getPageHeight() * static_cast<size_t>(std::abs(pages));
+
+        if (pages < 0) {
+            _data.scrollTo(position > delta ? position - delta : 0u);
+            if (position <= delta) {
+                _data.loadHistory();
+            }
+        }
+        else {
+            _data.scrollTo(position + delta);
+        }
+    }
+
+    void scrollToEnd() {
+        size_t cnt = _data.getVisibleCnt();
+        size_t page = getPageHeight();
+        _data.scrollTo(cnt > page ? cnt - page : 0u);
+    }
+
+    void gotoLine() {
+        auto input = prompt("Go to line: ");
+        char* end = nullptr;
+        unsigned long line = std::strtoul(input.c_str(), &end, 10);
+        if (!input.empty() && *end == '\0' && line > 0) {
+            _data.scrollTo(line - 1u);
+        }
+    }
+
+    /**
+     * Scrolls to the next or previous line sharing a key with the top line.
+     */
+    void cycleRelated(bool backwards) {
+        auto related = _data.scrollToRelated(backwards);
+        if (related.count == 0u) {
+            setMessage("No key in the top line");
+            return;
+        }
+        setMessage(related.name + " " + related.key + " " + std::to_string(related.position + 1u)
+                   + "/" + std::to_string(related.count));
+    }
+
+    /**
+     * Searches all lines for a regex, showing only the matching ones.
+     */
+    void query() {
+        auto regex = prompt("Query: ");
+        if (!_data.startQuery(regex)) {
+            setMessage("Invalid query " + regex);
+            return;
+        }
+        setMessage({});
+
+        uint8_t tab = _data.getTabCnt() - 1u;
+        if (!regex.empty() && !_data.getTab(tab).enabled) {
+            _data.toggleTab(tab);
+        }
+    }
+
+    void exportLines() {
+        auto filename = prompt("Export to: ");
+        if (filename.empty()) {
+            return;
+        }
+
+        size_t exported = 0;
+        if (_data.exportVisible(filename, &exported)) {
+            setMessage("Exported " + std::to_string(exported) + " lines to " + filename);
+        }
+        else {
+            setMessage("Failed to export to " + filename);
+        }
+    }
+
+    //! Sets the message shown in the status row, which redraws read.
+    void setMessage(std::string message) {
+        std::lock_guard<std::mutex> g(_drawing);
+        _message = std::move(message);
+    }
+
+    /**
+     * Reads a line of user input in the status row of the menu.
+     */
+    std::string prompt(const std::string& text) {
+
+        static const int kMaxInput = 256;
+        char buffer[kMaxInput] = {};
+
+        // Waits for a redraw from another thread to finish.
+        _drawing.lock();
+
+        ::wattrset(_winMenu, A_NORMAL);
+        ::wmove(_winMenu, kStatusRow, 0);
+        ::wclrtoeol(_winMenu);
+        ::mvwprintw(_winMenu, kStatusRow, kHorMargin, "%s", text.c_str());
+        ::echo();
+        ::wgetnstr(_winMenu, buffer, kMaxInput - 1);
+        ::noecho();
+
+        _shownStatus.clear();
+        _drawing.unlock();
+        return buffer;
+    }
+
     void addTab(std::string name, int index) {
         LOG(_tabs.size() << " " << index);
         if (_tabs.size() <= index) {
@@ -153,48 +468,134 @@ public:
             tabName = tabName.substr(tabName.length() - kMaxNameLength, std::string::npos);
         }
 
-        stream << "[" << static_cast<int>(src) << "] "  << tabName << " (" << tab.rowsCnt << ")";
+        stream << "[" << static_cast<int>(src) << "] "  << tabName << " (" << tab.rowsCnt;
+        if (tab.dropped > 0u) {
+            stream << " -" << tab.dropped;
+        }
+        if (tab.sampled > 0u) {
+            stream << " ~" << tab.sampled;
+        }
+        if (!tab.warning.empty()) {
+            stream << " !" << tab.warning;
+        }
+        if (tab.indexed < 100u) {
+            stream << " " << static_cast<int>(tab.indexed) << "%";
+        }
+        stream << ")";
         return stream.str();
     }
 
-    int drawMenu() {
-
-        static const int kHorMargin = 2;
-        static const int kVerMargin = 0;
-        static const int kVerPadding = 2;
-        static const int kRightPanelWidth = 20;
-
-        int row = kVerMargin;
-        int column = kHorMargin;
+    /**
+     * Updates the tabs and the status row, if they changed.
+     */
+    void drawMenu() {
 
-        ::wclear(_winMenu);
+        std::string tabs;
+        std::vector<std::pair<std::string, int>> titles;
 
         for (int i = 0; i < _data.getTabCnt(); i++) {
 
             auto tab = _data.getTab(i);
 
             if (!tab) {
-                return row + kVerPadding;
+                break;
+            }
+
+            titles.emplace_back(getTabTitle(tab, i), getColor(i, !tab.enabled));
+            tabs.append(titles.back().first);
+            tabs.push_back(static_cast<char>(titles.back().second));
+        }
+
+        if (tabs != _shownTabs) {
+            _shownTabs = tabs;
+            ::wmove(_winMenu, 0, 0);
+            ::wclrtoeol(_winMenu);
+
+            int column = kHorMargin;
+            for (const auto& title : titles) {
+                ::wattrset(_winMenu, COLOR_PAIR(title.second));
+                mvwaddnstr(_winMenu, 0, column, title.first.c_str(), std::max(0, COLS - column));
+                column += title.first.length() + kHorMargin;
+                if (column >= COLS) {
+                    break;
+                }
             }
+        }
+
+        drawStatus();
+
+        ::wnoutrefresh(_winMenu);
+    }
+
+    void drawStatus() {
+
+        size_t cnt = _data.getVisibleCnt();
+        size_t position = cnt > 0u ? _data.getPosition() + 1u : 0u;
+        size_t percent = cnt > 0u ? position * 100u / cnt : 0u;
+
+        std::stringstream stream;
+        stream << position << "/" << cnt << " (" << percent << "%)";
+
+        if (_follow) {
+            stream << "  following";
+        }
+
+        if (_firstScreenMs >= 0) {
+            stream << "  first screen in " << _firstScreenMs << " ms";
+        }
+
+        stream << "  out " << getBytesPerSecond() / 1024u << " KiB/s";
+
+        if (!_message.empty()) {
+            stream << "  " << _message;
+        }
+
+        auto status = stream.str();
+        if (status == _shownStatus) {
+            return;
+        }
+        _shownStatus = status;
 
-            setColor(_winMenu, i, !tab.enabled);
+        ::wattrset(_winMenu, A_NORMAL);
+        ::wmove(_winMenu, kStatusRow, 0);
+        ::wclrtoeol(_winMenu);
+        mvwaddnstr(_winMenu, kStatusRow, kHorMargin, status.c_str(), std::max(0, COLS - kHorMargin));
+    }
+
+    void drawScrollbar(int screenHeight) {
 
-            auto tabTitle = getTabTitle(tab, i);
+        size_t cnt = _data.getVisibleCnt();
+        size_t height = static_cast<size_t>(screenHeight);
+        size_t thumbStart = 0u;
+        size_t thumbLength = cnt > 0u ? height : 0u;
 
-            ::mvwprintw(_winMenu, row, column, "%s", tabTitle.c_str());
+        if (cnt > height) {
+            thumbLength = std::max<size_t>(1u, height * height / cnt);
+            thumbStart = std::min(height - thumbLength, _data.getPosition() * height / cnt);
+        }
 
-            column += tabTitle.length() + kHorMargin;
+        auto thumb = std::make_tuple(height, thumbStart, thumbLength);
+        if (thumb == _shownThumb) {
+            return;
         }
+        _shownThumb = thumb;
 
-        wrefresh(_winMenu);
-        return row + kVerPadding;
+        for (size_t row = 0u; row < height; row++) {
+            bool isThumb = row >= thumbStart && row < thumbStart + thumbLength;
+            mvwaddch(_winScroll, row, 0, isThumb ? (' ' | A_REVERSE) : ACS_VLINE);
+        }
+        ::wnoutrefresh(_winScroll);
     }
 
-    bool drawLines(int screenHeight) {
+    /**
+     * Lays out the lines from the top position into rows.
+     *
+     * @return False if the lines don't fill the screen.
+     */
+    bool layoutLines(std::vector<Row>* rows, int screenWidth, int screenHeight) {
 
         _data.prepareLines();
-        int row = 0;
-        while (row < screenHeight) {
+        while (rows->size() < static_cast<size_t>(screenHeight)) {
 
             auto line = _data.nextLine();
 
@@ -203,22 +604,263 @@ public:
                 return false;
             }
 
-            setColor(_winLines, line.src, true);
-            row += printLine(row, line);
+            int color = getColor(line.src, true);
+            addRows(rows, formatLine(line), color, screenWidth, screenHeight);
 
             if (!line.comment.empty() && _showComments) {
-                row += printComment(row, line);
+                addRows(rows, "        |> " + line.comment, color, screenWidth);
             }
         }
 
-        LOG("Drawn " << row << "/" << screenHeight);
-
         return true;
     }
 
+    bool layoutTemplates(std::vector<Row>* rows, int screenWidth, int screenHeight) {
+
+        auto templates = _data.getTemplates();
+        char count[32];
+
+        for (const auto& info : templates) {
+            if (rows->size() >= static_cast<size_t>(screenHeight)) {
+                return true;
+            }
+            std::snprintf(count, sizeof(count), "%10zu ", info.count);
+            addRows(rows, count + info.text, 0, screenWidth);
+        }
+
+        return false;
+    }
+
+    bool layoutFields(std::vector<Row>* rows, int screenWidth, int screenHeight) {
+
+        auto fields = _data.getFields();
+
+        for (const auto& field : fields) {
+            if (rows->size() >= static_cast<size_t>(screenHeight)) {
+                return true;
+            }
+
+            std::stringstream stream;
+            stream << "[" << static_cast<int>(field.tab) << "] " << field.name << "  count " << field.count;
+
+            if (field.numeric) {
+                stream << "  sum " << field.sum << "  min " << field.min << "  max " << field.max
+                       << "  p50 " << field.p50 << "  p99 " << field.p99;
+                if (field.invalid > 0u) {
+                    stream << "  invalid " << field.invalid;
+                }
+            }
+            else {
+                for (size_t i = 0; i < field.top.size(); i++) {
+                    stream << (i == 0u ? "  top " : ", ") << field.top[i].first << " (" << field.top[i].second << ")";
+                }
+            }
+
+            addRows(rows, stream.str(), getColor(field.tab, true), screenWidth);
+        }
+
+        return false;
+    }
+
+    bool layoutFilters(std::vector<Row>* rows, int screenWidth, int screenHeight) {
+
+        auto filters = _data.getFilters();
+        char stats[128];
+
+        for (const auto& filter : filters) {
+            if (rows->size() >= static_cast<size_t>(screenHeight)) {
+                return true;
+            }
+
+            double rate = filter.tried > 0u ? 100.0 * filter.matched / filter.tried : 0.0;
+            std::snprintf(stats, sizeof(stats), "%10zu tried %5.1f%% matched %9.1f us avg %9.1f us max",
+                          filter.tried, rate, filter.averageUs, filter.maxUs);
+
+            std::stringstream stream;
+            if (filter.drop) {
+                stream << stats << "  [drop] " << filter.name;
+            }
+            else {
+                stream << stats << "  [" << static_cast<int>(filter.tab) << "] " << filter.name;
+            }
+            if (filter.skipped > 0u) {
+                stream << "  skipped " << filter.skipped;
+            }
+            if (!filter.warning.empty()) {
+                stream << "  !" << filter.warning;
+            }
+
+            addRows(rows, stream.str(), getColor(filter.tab, true), screenWidth);
+        }
+
+        return false;
+    }
+
+    bool layoutRelated(std::vector<Row>* rows, int screenWidth, int screenHeight) {
+
+        auto related = _data.getRelated(screenHeight);
+        if (related.count == 0u) {
+            addRows(rows, "No key in the top line", 0, screenWidth);
+            return false;
+        }
+
+        std::stringstream stream;
+        stream << related.name << " " << related.key << "  " << related.count << " lines";
+        addRows(rows, stream.str(), 0, screenWidth);
+
+        for (const auto& line : related.lines) {
+            if (rows->size() >= static_cast<size_t>(screenHeight)) {
+                return true;
+            }
+            addRows(rows, formatLine(line), getColor(line.src, true), screenWidth);
+        }
+
+        return related.lines.size() < related.count;
+    }
+
+    /**
+     * Lays out the whole text of the top line, from the first row scrolled
+     * to on.
+     */
+    bool layoutExpanded(std::vector<Row>* rows, int screenWidth, int screenHeight) {
+
+        _data.prepareLines();
+        auto line = _data.nextLine();
+        if (!line.isValid()) {
+            return false;
+        }
+
+        if (line.id != _expandedId) {
+            _expandedId = line.id;
+            _expandedText = line.fullLength > 0u ? _data.getText(line.id) : line.text;
+        }
+
+        std::vector<Row> all;
+        addRows(&all, formatLine(line, _expandedText), getColor(line.src, true), screenWidth,
+                _expandedRow + screenHeight);
+        _expandedRow = std::min(_expandedRow, all.size() - 1u);
+        rows->insert(rows->end(), std::make_move_iterator(all.begin() + _expandedRow),
+                     std::make_move_iterator(all.end()));
+
+        return rows->size() >= static_cast<size_t>(screenHeight);
+    }
+
+    /**
+     * Splits the text into rows of the screen width. Tabs are expanded
+     * and other control characters replaced, so every byte takes one
+     * column.
+     *
+     * @param maxRows Stops once there are as many rows, so only the part
+     *                of a long text which fits is formatted.
+     */
+    static void addRows(std::vector<Row>* rows, std::string_view text, int color, int screenWidth,
+                        size_t maxRows = SIZE_MAX) {
+
+        static const size_t kTabWidth = 8u;
+        size_t width = std::max(1, screenWidth);
+        std::string row;
+
+        while (!text.empty() && text.back() == '\n') {
+            text.remove_suffix(1u);
+        }
+
+        for (char c : text) {
+            if (rows->size() >= maxRows) {
+                return;
+            }
+            if (c == '\n') {
+                rows->emplace_back(Row{std::move(row), color});
+                row.clear();
+                continue;
+            }
+            else if (c == '\t') {
+                row.append(kTabWidth - row.size() % kTabWidth, ' ');
+            }
+            else {
+                row.push_back(static_cast<unsigned char>(c) < ' ' || c == 0x7f ? '?' : c);
+            }
+
+            while (row.size() >= width) {
+                rows->emplace_back(Row{row.substr(0, width), color});
+                row.erase(0, width);
+            }
+        }
+
+        if (!row.empty() || text.empty()) {
+            rows->emplace_back(Row{std::move(row), color});
+        }
+    }
+
+    /**
+     * Shift of the new rows against the shown ones, if they are the shown
+     * rows moved up by a number of rows.
+     *
+     * @return Number of rows to scroll, or 0.
+     */
+    int findScroll(const std::vector<Row>& rows) const {
+
+        int height = _shownRows.size();
+        for (int shift = 1; shift < height; shift++) {
+            if (_shownRows[shift].text.empty()) {
+                continue;
+            }
+            bool shifted = true;
+            for (int row = 0; row + shift < height && shifted; row++) {
+                shifted = rows[row] == _shownRows[row + shift];
+            }
+            if (shifted) {
+                return shift;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * Writes the rows which differ from the shown ones, scrolling the
+     * window first when the rows moved up.
+     */
+    void updateLines(std::vector<Row> rows, int screenWidth, int screenHeight) {
+
+        rows.resize(screenHeight);
+
+        if (_shownRows.size() != rows.size() || _shownWidth != screenWidth) {
+            ::werase(_winLines);
+            _shownRows.assign(screenHeight, Row{});
+            _shownWidth = screenWidth;
+        }
+
+        int shift = findScroll(rows);
+        if (shift > 0) {
+            ::scrollok(_winLines, true);
+            ::wscrl(_winLines, shift);
+            ::scrollok(_winLines, false);
+            _shownRows.erase(_shownRows.begin(), _shownRows.begin() + shift);
+            _shownRows.resize(screenHeight);
+        }
+
+        int changed = 0;
+        for (int row = 0; row < screenHeight; row++) {
+
+            if (rows[row] == _shownRows[row]) {
+                continue;
+            }
+
+            ::wattrset(_winLines, COLOR_PAIR(rows[row].color));
+            mvwaddnstr(_winLines, row, 0, rows[row].text.c_str(), screenWidth);
+            // A full row already moved the cursor to the next one.
+            if (static_cast<int>(rows[row].text.size()) < screenWidth) {
+                ::wclrtoeol(_winLines);
+            }
+            _shownRows[row] = std::move(rows[row]);
+            changed++;
+        }
+
+        LOG("Scrolled " << shift << ", updated " << changed << "/" << screenHeight);
+        ::wnoutrefresh(_winLines);
+    }
+
     bool renderingAvailable() {
-        bool expected = false;
-        return _drawing.compare_exchange_weak(expected, true);
+        return _drawing.try_lock();
     }
     
     void redraw() {
@@ -234,24 +876,55 @@ public:
         int screenWidth, screenHeight;
         getmaxyx(_winLines, screenHeight, screenWidth);
 
-        LOG("Dimensions: " << screenWidth << "x" << screenHeight);
-       
-        ::wclear(_winLines);
+        if (_follow && _view == View::Lines) {
+            scrollToEnd();
+        }
+
+        std::vector<Row> rows;
+        if (_view == View::Templates) {
+            _screenFilled = layoutTemplates(&rows, screenWidth, screenHeight);
+        }
+        else if (_view == View::Fields) {
+            _screenFilled = layoutFields(&rows, screenWidth, screenHeight);
+        }
+        else if (_view == View::Filters) {
+            _screenFilled = layoutFilters(&rows, screenWidth, screenHeight);
+        }
+        else if (_view == View::Related) {
+            _screenFilled = layoutRelated(&rows, screenWidth, screenHeight);
+        }
+        else if (_view == View::Expanded) {
+            _screenFilled = layoutExpanded(&rows, screenWidth, screenHeight);
+        }
+        else {
+            _screenFilled = layoutLines(&rows, screenWidth, screenHeight);
+        }
+
+        if (_firstScreenMs < 0 && !rows.empty()) {
+            _firstScreenMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - _started).count();
+            LOG("First screen in " << _firstScreenMs << " ms");
+        }
+
         drawMenu();
-        _screenFilled = drawLines(screenHeight);
+        updateLines(std::move(rows), screenWidth, screenHeight);
+        drawScrollbar(screenHeight);
+        update();
 
-        ::wrefresh(_winLines);
-        _drawing = false;
+        _drawing.unlock();
     }
 
-    int printLine(int row, const LogLine& line) {
-        ::mvwprintw(_winLines, row, 0, "%6d [%d] %s", line.id, line.src, line.text.c_str());
-        return getcury(_winLines) - row + 1;
+    static std::string formatLine(const LogLine& line) {
+        auto text = formatLine(line, line.text);
+        if (line.fullLength > 0u) {
+            text += " [+" + std::to_string(line.fullLength - line.text.size()) + " bytes, x]";
+        }
+        return text;
     }
 
-    int printComment(int row, const LogLine& line) {
-        ::mvwprintw(_winLines, row, 0, "        |> %s", line.comment.c_str());
-        return getcury(_winLines) - row + 1;
+    static std::string formatLine(const LogLine& line, const std::string& text) {
+        char prefix[32];
+        std::snprintf(prefix, sizeof(prefix), "%6zu [%d] ", line.id, line.src);
+        return prefix + text;
     }
 };
-
@@ -1,61 +1,204 @@
 #pragma once
 
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
 #include <chrono>
+#include <climits>
+#include <deque>
 #include <functional>
+#include <future>
+#include <thread>
 #include <vector>
-#include <regex>
 #include <string>
+#include <string_view>
 #include <limits>
+#include <condition_variable>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <regex>
 
 #include "Log.hpp"
 #include "LogLine.hpp"
 #include "IExec.hpp"
 
+#include "Column.hpp"
+#include "FilterSet.hpp"
 #include "IDataModel.hpp"
+#include "KeyIndex.hpp"
+#include "LineStore.hpp"
+#include "RankIndex.hpp"
+#include "SpillStore.hpp"
+#include "TemplateMiner.hpp"
 
 namespace {
     const size_t kUndefined = std::numeric_limits<size_t>::max();
+    //! Lines formatted by one export worker.
+    const size_t kExportChunkSize = 64u * 1024u;
+    //! Lines searched by one query worker at a time.
+    const size_t kQueryChunkSize = 16u * 1024u;
 };
 
 class DataModel : public IDataModel {
 
+    //! Text is stored as a template id and the template parameters,
+    //! which are kept compressed in the line store under the line id.
     struct LogLineInternal {
         std::chrono::time_point<std::chrono::steady_clock> time;
-        std::string text;
+        uint32_t templateId;
+        uint16_t paramCnt;
         uint8_t src;
     };
 
+    //! Command to comment a line with, run once the lock is released.
+    struct Command {
+        std::string command;
+        bool coprocess;
+        std::string text;
+        size_t lineId;
+    };
+
+    //! Full text of a line of which only a prefix is kept in memory.
+    struct Spilled {
+        uint64_t offset;
+        size_t length;
+    };
+
+    //! Ids of lines shown one after another, [first, last).
+    struct Segment {
+        size_t first;
+        size_t last;
+    };
+
+    //! Visible lines before each segment for a view, see getSegmentCountsLocked().
+    struct SegmentCounts {
+        RankIndex::Mask enabled;
+        bool query{false};
+        //! Lines and query the counts were taken for.
+        size_t lineCnt{std::numeric_limits<size_t>::max()};
+        size_t queryGeneration{0u};
+        size_t queryMatched{0u};
+        //! Visible lines before each segment, and in all of them at the end.
+        std::vector<size_t> before;
+        //! First line and index of each segment, ordered by the first line.
+        std::vector<std::pair<size_t, size_t>> byFirst;
+    };
+
     struct TabInternal {
         std::string name;
-        bool enabled;
         size_t rowsCnt{0};
-        size_t minLineId{kUndefined};
-        size_t maxLineId{kUndefined};
+        size_t dropped{0};
+        size_t sampled{0};
+        //! Keeps one of this many lines.
+        size_t sampleEvery{1};
+        size_t sampleCounter{0};
+        uint8_t indexed{100};
+    };
+
+    //! Regex searched for in all lines, see startQuery().
+    struct Query {
+        std::string regex;
+        std::shared_ptr<const std::regex> compiled;
+        //! Contained in every match, checked before running the regex.
+        std::string literal;
+        //! Bitmap of the matching lines, and the lines by tab.
+        std::vector<uint64_t> matches;
+        RankIndex index;
+        size_t matched{0};
+        //! Lines present when the query started, which are scanned.
+        size_t end{0};
+        size_t scanned{0};
     };
 
 public:
 
+    //! Classifies lines by the index of the matching filter, or -1.
+    using Classify = std::function<void(const std::vector<std::string_view>&, std::vector<int>*)>;
+
     DataModel(std::shared_ptr<IExec> exec = nullptr) : _exec{exec} {}
 
+    ~DataModel() {
+        stopQuery();
+    }
+
+    //! Scroll position and hidden tabs of a viewer of the lines.
+    struct View {
+        size_t row{0};
+        RankIndex::Mask disabled;
+        //! Key last cycled through, kept while the top line has it.
+        size_t keyExtractor{kUndefined};
+        std::string key;
+        //! Whether only the lines matching the query are shown.
+        bool query{false};
+    };
+
     bool scrollUp() {
+        return scrollUp(&_view);
+    }
+
+    bool scrollUp(View* view) {
 
         std::lock_guard<std::mutex> g(_mtx);
-        return reverseFiltered(&_row);
+        size_t position = getPositionLocked(*view);
+        return position != kUndefined && position > 0u && scrollToLocked(view, position - 1u);
     }
 
     bool scrollDown() {
+        return scrollDown(&_view);
+    }
+
+    bool scrollDown(View* view) {
+
+        std::lock_guard<std::mutex> g(_mtx);
+        size_t position = getPositionLocked(*view);
+        return position != kUndefined && scrollToLocked(view, position + 1u);
+    }
+
+    bool scrollTo(size_t position) {
+        return scrollTo(&_view, position);
+    }
+
+    bool scrollTo(View* view, size_t position) {
+
+        std::lock_guard<std::mutex> g(_mtx);
+        size_t cnt = getVisibleCntLocked(*view);
+        if (cnt == 0u) {
+            return false;
+        }
+        return scrollToLocked(view, std::min(position, cnt - 1u));
+    }
+
+    size_t getPosition() {
+        return getPosition(_view);
+    }
+
+    size_t getPosition(const View& view) {
+
+        std::lock_guard<std::mutex> g(_mtx);
+        return getPositionLocked(view);
+    }
+
+    size_t getVisibleCnt() {
+        return getVisibleCnt(_view);
+    }
+
+    size_t getVisibleCnt(const View& view) {
 
         std::lock_guard<std::mutex> g(_mtx);
-        return fastForwardFiltered(&_row);
+        return getVisibleCntLocked(view);
     }
 
     void prepareLines() {
 
         std::lock_guard<std::mutex> g(_mtx);
-        _nextLine = clampRow(_row);
+        size_t position = getPositionLocked(_view);
+        _nextLine = position != kUndefined ? selectVisible(_view, position) : kUndefined;
         _hasNextLine = _nextLine != kUndefined;
     }
 
@@ -67,38 +210,301 @@ public:
             return {};
         }
 
-        assert(_nextLine < _lines.size());
+        auto line = getLineLocked(_nextLine);
+        _hasNextLine = fastForwardFiltered(_view, &_nextLine);
 
-        const auto& internal = _lines[_nextLine];
-        LogLine line{internal.time, internal.text, "", _nextLine, internal.src, true};
+        return line;
+    }
 
-        auto comment = _comments.find(_nextLine);
-        if (comment != std::end(_comments)) {
-            line.comment = comment->second;
+    /**
+     * @return Up to cnt visible lines, starting at the position.
+     */
+    std::vector<LogLine> getLines(const View& view, size_t position, size_t cnt) {
+
+        std::lock_guard<std::mutex> g(_mtx);
+        std::vector<LogLine> lines;
+        size_t lineId = selectVisible(view, position);
+        bool hasLine = lineId != kUndefined;
+
+        while (hasLine && lines.size() < cnt) {
+            lines.emplace_back(getLineLocked(lineId));
+            hasLine = fastForwardFiltered(view, &lineId);
         }
-    
-        _hasNextLine = fastForwardFiltered(&_nextLine);
-        
-        return line;
+
+        return lines;
+    }
+
+    RelatedInfo scrollToRelated(bool backwards = false) {
+        return scrollToRelated(&_view, backwards);
+    }
+
+    RelatedInfo scrollToRelated(View* view, bool backwards = false) {
+
+        std::lock_guard<std::mutex> g(_mtx);
+        RelatedInfo info;
+        size_t lineId;
+        std::vector<size_t> related;
+        if (!findRelatedLocked(view, &lineId, &related, &info)) {
+            return info;
+        }
+
+        // Lines are related in the order they were added
+        auto it = std::lower_bound(related.begin(), related.end(), lineId);
+        size_t index = it - related.begin();
+        if (backwards) {
+            index = (index + related.size() - 1u) % related.size();
+        }
+        else {
+            index = it != related.end() && *it == lineId ? (index + 1u) % related.size() : index % related.size();
+        }
+
+        view->row = related[index];
+        info.position = index;
+        return info;
+    }
+
+    RelatedInfo getRelated(size_t cnt) {
+        return getRelated(_view, cnt);
+    }
+
+    RelatedInfo getRelated(View view, size_t cnt) {
+
+        std::lock_guard<std::mutex> g(_mtx);
+        RelatedInfo info;
+        size_t lineId;
+        std::vector<size_t> related;
+        if (!findRelatedLocked(&view, &lineId, &related, &info)) {
+            return info;
+        }
+
+        info.position = std::lower_bound(related.begin(), related.end(), lineId) - related.begin();
+        for (size_t i = 0; i < related.size() && i < cnt; i++) {
+            info.lines.emplace_back(getLineLocked(related[i]));
+        }
+        return info;
+    }
+
+    bool exportVisible(const std::string& filename, size_t* exported) {
+        return exportVisible(_view, filename, exported);
+    }
+
+    /**
+     * Writes the lines of the enabled tabs, with their comments, to a file.
+     *
+     * The lines present when the export starts are written, as seen by the
+     * view at that time. Batches of chunks are formatted in parallel under
+     * the lock, which is released while each batch is written, so ingestion
+     * and viewers only pause for the formatting.
+     *
+     * @param exported Receives the number of exported lines.
+     */
+    bool exportVisible(const View& current, const std::string& filename, size_t* exported) {
+
+        int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            LOG("Failed to open " << filename);
+            return false;
+        }
+
+        // Line ids are stable, as lines are only ever added.
+        View view;
+        std::vector<Segment> chunks;
+        {
+            std::lock_guard<std::mutex> g(_mtx);
+            view = current;
+            for (const auto& segment : _segments) {
+                for (size_t first = segment.first; first < segment.last; first += kExportChunkSize) {
+                    chunks.push_back({first, std::min(segment.last, first + kExportChunkSize)});
+                }
+            }
+        }
+
+        size_t batchSize = std::max(1u, std::thread::hardware_concurrency());
+        bool success = true;
+
+        *exported = 0u;
+
+        for (size_t next = 0u; success && next < chunks.size(); next += batchSize) {
+
+            std::vector<std::string> buffers;
+            {
+                std::lock_guard<std::mutex> g(_mtx);
+                size_t last = std::min(chunks.size(), next + batchSize);
+                std::vector<std::future<std::pair<std::string, size_t>>> pending;
+                for (size_t i = next + 1u; i < last; i++) {
+                    pending.emplace_back(std::async(std::launch::async, [this, &chunks, i, &view] () {
+                        return formatChunk(chunks[i], view);
+                    }));
+                }
+
+                auto first = formatChunk(chunks[next], view);
+                buffers.emplace_back(std::move(first.first));
+                *exported += first.second;
+                for (auto& chunk : pending) {
+                    auto formatted = chunk.get();
+                    buffers.emplace_back(std::move(formatted.first));
+                    *exported += formatted.second;
+                }
+            }
+
+            success = writeAll(fd, buffers);
+        }
+
+        return ::close(fd) == 0 && success;
     }
 
     void toggleTab(uint8_t src) {
+        toggleTab(&_view, src);
+    }
+
+    void toggleTab(View* view, uint8_t src) {
         std::lock_guard<std::mutex> g(_mtx);
-        _tabs[src].enabled = !_tabs[src].enabled;
+        if (src < _tabs.size()) {
+            view->disabled.flip(src);
+        }
+        else if (src == _tabs.size() && _query) {
+            view->query = !view->query;
+        }
     }
 
     Tab getTab(uint8_t src) {
+        return getTab(_view, src);
+    }
+
+    Tab getTab(const View& view, uint8_t src) {
         std::lock_guard<std::mutex> g(_mtx);
         if (src < _tabs.size()) {
             TabInternal& tab = _tabs[src];
-            return Tab{tab.name, tab.enabled, tab.rowsCnt, true};
+            Tab info{tab.name, !view.disabled[src], tab.rowsCnt, true, tab.dropped, tab.sampled};
+            info.indexed = tab.indexed;
+            for (const auto& filter : _filters.getFilters()) {
+                if (filter.src == src) {
+                    info.warning = filter.warning;
+                }
+            }
+            return info;
+        }
+        if (src == _tabs.size() && _query) {
+            Tab info{"/" + _query->regex + "/", view.query, _query->matched, true};
+            info.indexed = _query->end > 0u ? _query->scanned * 100u / _query->end : 100u;
+            return info;
         }
         return {};
     }
 
     uint8_t getTabCnt() {
         std::lock_guard<std::mutex> g(_mtx);
-        return _tabs.size();
+        return _tabs.size() + (_query ? 1u : 0u);
+    }
+
+    /**
+     * Searches all lines for the regex on all cores, shown as a tab after
+     * the others, which shows only the matching lines of the enabled tabs
+     * when enabled. The lines are scanned in chunks, each reported once
+     * done, and lines added later are matched as they arrive.
+     *
+     * There is one query shared by all views, so a new query, from any
+     * viewer, replaces the previous one, and an empty one only stops it.
+     *
+     * @return False if the regex is invalid.
+     */
+    bool startQuery(const std::string& regex) {
+
+        std::lock_guard<std::mutex> q(_queryMtx);
+        stopScanning();
+        if (regex.empty()) {
+            return true;
+        }
+
+        auto query = std::make_unique<Query>();
+        query->regex = regex;
+        try {
+            query->compiled = std::make_shared<const std::regex>(regex);
+        }
+        catch (const std::regex_error& e) {
+            LOG("Invalid query " << regex << ": " << e.what());
+            return false;
+        }
+        query->literal = FilterSet::requiredLiteral(regex);
+
+        size_t end;
+        {
+            std::lock_guard<std::mutex> g(_mtx);
+            end = query->end = _lines.size();
+            query->matches.resize(end / 64u + 1u);
+            query->index.reserve(end);
+            _query = std::move(query);
+            _queryGeneration++;
+        }
+
+        LOG("Query " << regex << " over " << end << " lines");
+        _queryStopped = false;
+        _queryNextChunk = 0u;
+        size_t workers = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t i = 0; i < workers; i++) {
+            _queryWorkers.emplace_back([this] () { scanQuery(); });
+        }
+        if (_onNewDataAvailable) {
+            _onNewDataAvailable();
+        }
+        return true;
+    }
+
+    /**
+     * Stops scanning and removes the query's tab.
+     */
+    void stopQuery() {
+        std::lock_guard<std::mutex> q(_queryMtx);
+        stopScanning();
+    }
+
+    std::vector<TemplateInfo> getTemplates() {
+        std::lock_guard<std::mutex> g(_mtx);
+        std::vector<TemplateInfo> templates;
+        for (uint32_t id = 0; id < _templates.size(); id++) {
+            templates.emplace_back(TemplateInfo{_templates.getText(id), _templates.getCount(id)});
+        }
+        std::stable_sort(templates.begin(), templates.end(), [](const auto& a, const auto& b) {
+            return a.count > b.count;
+        });
+        return templates;
+    }
+
+    std::vector<FieldInfo> getFields() {
+        std::lock_guard<std::mutex> g(_mtx);
+        std::vector<FieldInfo> fields;
+        for (const auto& column : _columns) {
+            fields.emplace_back(column.getInfo());
+        }
+        return fields;
+    }
+
+    /**
+     * @return Drop filters, which are tried first, followed by the filters.
+     */
+    std::vector<FilterInfo> getFilters() {
+
+        std::lock_guard<std::mutex> g(_mtx);
+        std::vector<FilterInfo> filters;
+        for (const auto* set : {&_drops, &_filters}) {
+            for (const auto& filter : set->getFilters()) {
+                using Us = std::chrono::duration<double, std::micro>;
+                double totalUs = std::chrono::duration_cast<Us>(filter.time).count();
+                filters.push_back({filter.name, static_cast<uint8_t>(filter.src), filter.tried, filter.matched,
+                    filter.skipped, filter.tried > 0u ? totalUs / filter.tried : 0.0,
+                    std::chrono::duration_cast<Us>(filter.maxTime).count(), filter.warning, set == &_drops});
+            }
+        }
+        return filters;
+    }
+
+    /**
+     * Waits for the comments of co-processes to the lines added so far.
+     */
+    void waitForComments() {
+
+        std::unique_lock<std::mutex> lock(_mtx);
+        _commentAdded.wait(lock, [this] () { return _pendingComments == 0u; });
     }
 
     void registerOnNewDataAvailableListener(std::function<void()> listener) {
@@ -106,7 +512,8 @@ public:
     }
 
     /**
-     * Adds a new filter.
+     * Adds a new filter. Named groups, "(?<name>...)", capture fields of
+     * the matching lines, which are aggregated per tab.
      *
      * @return The ID of tab corresponding to the filter.
      */
@@ -115,188 +522,852 @@ public:
         LOG("Filter " << name << " (" << _src << ")");
         std::lock_guard<std::mutex> g(_mtx);
         uint8_t tabId = _tabs.size();
-        _filters.emplace_back(Filter{_src++, name, std::regex{regex}});
-        _tabs.emplace_back(TabInternal{name, true, 0, kUndefined});
+        const auto& filter = _filters.add(_src++, name, regex);
+        if (!filter.fields.empty()) {
+            _fieldColumns[filter.src] = _columns.size();
+            for (const auto& field : filter.fields) {
+                _columns.emplace_back(field.first, tabId);
+            }
+        }
+        addTab(name);
         return tabId;
     }
 
-    bool addExternal(const std::string& name, const std::string& command) {
+    /**
+     * Adds a filter whose matching lines are dropped before they are
+     * stored or matched against the other filters. The lines dropped are
+     * counted per filter.
+     */
+    void addDropFilter(const std::string& name, const std::string& regex) {
 
+        LOG("Drop filter " << name);
         std::lock_guard<std::mutex> g(_mtx);
-        for (auto& filter : _filters) {
-            if (filter.name == name) {
-                filter.command = command;
-                return true;
-            }
+        _drops.add(_drops.size(), name, regex);
+    }
+
+    /**
+     * Adds a correlation key, which indexes the lines by the value of the
+     * regex's first group, or its match, found anywhere in them.
+     *
+     * @return False if the regex is invalid.
+     */
+    bool addKey(const std::string& name, const std::string& regex) {
+
+        LOG("Key " << name);
+        std::lock_guard<std::mutex> g(_mtx);
+        return _keys.addKey(name, regex);
+    }
+
+    /**
+     * Keeps only a prefix of lines longer than the limit in memory, with
+     * the full text in a spill file, read when the line is expanded,
+     * exported or searched. Lines are classified by their full text.
+     *
+     * @param bytes Length of the prefix, 0 for no limit.
+     */
+    void setLineLimit(size_t bytes) {
+        std::lock_guard<std::mutex> g(_mtx);
+        _lineLimit = bytes;
+    }
+
+    /**
+     * @return Full text of the line, including the part not kept in memory.
+     */
+    std::string getText(size_t lineId) {
+        std::lock_guard<std::mutex> g(_mtx);
+        if (lineId >= _lines.size()) {
+            return {};
         }
-        return false;
+        LineStore::Cursor cursor(_store);
+        return getTextLocked(lineId, &cursor);
     }
 
-    std::function<void(std::string)> getAppender(std::string name) {
+    /**
+     * Comments the lines matching the filter with the output of the command.
+     *
+     * @param coprocess Whether to start the command once and pass it the
+     *                  lines over its standard input, see Coprocess.
+     */
+    bool addExternal(const std::string& name, const std::string& command, bool coprocess = false) {
+
+        std::lock_guard<std::mutex> g(_mtx);
+        return _filters.setCommand(name, command, coprocess);
+    }
+
+    /**
+     * Caches the compiled filters in the directory, reusing them on
+     * later runs with the same filters.
+     */
+    void setFilterCache(const std::string& directory) {
+        std::lock_guard<std::mutex> g(_mtx);
+        _filters.setCacheDirectory(directory);
+        _drops.setCacheDirectory(directory);
+    }
+
+    uint8_t addSource(const std::string& name) {
 
         std::lock_guard<std::mutex> g(_mtx);
         auto src = _src++;
         LOG("Appender " << name << " (" << src << ")");
-        _tabs.emplace_back(TabInternal{name, true});
+        addTab(name);
+        return src;
+    }
+
+    /**
+     * Sets the share of the tab's input indexed so far, in percent.
+     */
+    void setIndexed(uint8_t src, uint8_t percent) {
+        {
+            std::lock_guard<std::mutex> g(_mtx);
+            if (src < _tabs.size()) {
+                _tabs[src].indexed = percent;
+            }
+        }
+        if (_onNewDataAvailable) {
+            _onNewDataAvailable();
+        }
+    }
+
+    void addDropped(uint8_t src, size_t cnt) {
+        std::lock_guard<std::mutex> g(_mtx);
+        if (src < _tabs.size()) {
+            _tabs[src].dropped += cnt;
+        }
+    }
+
+    /**
+     * Sampling is deterministic, keeping the first of every n lines,
+     * and applies to tabs added later as well.
+     */
+    void setSampling(const std::string& name, size_t every) {
+        std::lock_guard<std::mutex> g(_mtx);
+        _sampling[name] = std::max<size_t>(every, 1u);
+        for (auto& tab : _tabs) {
+            if (tab.name == name) {
+                tab.sampleEvery = _sampling[name];
+            }
+        }
+    }
+
+    std::function<void(std::string)> getAppender(std::string name) {
+
+        auto src = addSource(name);
 
         return [this, src] (std::string line) {
             addLine(line, src);
         };
     }
 
+    std::function<void(const std::vector<std::string_view>&)> getBatchAppender(std::string name) {
+
+        auto src = addSource(name);
+
+        return [this, src] (const std::vector<std::string_view>& lines) {
+            addLines(lines, src);
+        };
+    }
+
     void addLine(const std::string& text, uint8_t src) {
+        addLines({text}, src);
+    }
 
-        if (src >= _tabs.size()) {
-            return;
+    /**
+     * Adds a batch of lines from the same source, taking the lock
+     * and notifying the listener only once.
+     */
+    void addLines(const std::vector<std::string_view>& lines, uint8_t src) {
+        addBatch(lines, nullptr, src);
+    }
+
+    /**
+     * Creates a classifier matching lines against a copy of the filters,
+     * so they can be classified on another thread and then added with
+     * addClassifiedLines(). Statistics are merged after each batch.
+     */
+    Classify getClassifier() {
+
+        std::shared_ptr<FilterSet> drops;
+        std::shared_ptr<FilterSet> filters;
+        {
+            std::lock_guard<std::mutex> g(_mtx);
+            drops = _drops.fork();
+            filters = _filters.fork();
         }
 
-        LogLineInternal line{std::chrono::steady_clock::now(), text, src};
-        const std::string *command = nullptr;
+        return [this, drops, filters] (const std::vector<std::string_view>& lines, std::vector<int>* classes) {
+            classes->clear();
+            for (const auto& text : lines) {
+                bool dropped = drops->size() > 0u && drops->classify(text) >= 0;
+                classes->push_back(dropped ? kDropped : filters->classify(text));
+            }
+            std::lock_guard<std::mutex> g(_mtx);
+            _drops.merge(drops.get());
+            _filters.merge(filters.get());
+        };
+    }
 
-        // Matching filter takes the ownership of the line.
+    /**
+     * Adds a batch of lines classified by a classifier, see getClassifier().
+     */
+    void addClassifiedLines(const std::vector<std::string_view>& lines,
+                            const std::vector<int>& classes, uint8_t src) {
+        addBatch(lines, &classes, src);
+    }
+
+    /**
+     * Adds lines which precede all lines added so far, like older lines
+     * of a file opened at its end. Each batch is shown before the earlier
+     * ones. Lines keep their ids, so the views stay on the same lines.
+     */
+    void prependLines(const std::vector<std::string_view>& lines, uint8_t src) {
+        addBatch(lines, nullptr, src, true);
+    }
+
+    /**
+     * Registers a function loading older lines of an input, see loadHistory().
+     */
+    void addHistoryLoader(std::function<void()> loader) {
+        std::lock_guard<std::mutex> g(_mtx);
+        _historyLoaders.push_back(loader);
+    }
+
+    void loadHistory() {
+        std::vector<std::function<void()>> loaders;
         {
             std::lock_guard<std::mutex> g(_mtx);
+            loaders = _historyLoaders;
+        }
+        for (const auto& loader : loaders) {
+            loader();
+        }
+    }
 
-            for (const auto& filter : _filters) {
-                if (std::regex_match(text, filter.regex)) {
-                    line.src = filter.src;
+private:
 
-                    if (!filter.command.empty()) {
-                        command = &filter.command;
-                    }
+    //! Marks a line not classified in advance.
+    static constexpr int kUnclassified = -2;
+    //! Marks a line classified to be dropped.
+    static constexpr int kDropped = -3;
 
-                    break;
-                }
-            }
+    /**
+     * @param history Whether the lines precede all lines added so far.
+     */
+    void addBatch(const std::vector<std::string_view>& lines, const std::vector<int>* classes,
+                  uint8_t src, bool history = false) {
 
-            auto lineId = _lines.size();
-            _lines.emplace_back(line);
+        if (src >= _tabs.size() || lines.empty()) {
+            return;
+        }
 
-            // Update tabs
-            _tabs[line.src].rowsCnt++;
-            _tabs[line.src].maxLineId = lineId;
-            if (_tabs[line.src].minLineId == kUndefined) {
-                _tabs[line.src].minLineId = lineId;
+        std::vector<Command> commands;
+        {
+            std::lock_guard<std::mutex> g(_mtx);
+            if (history) {
+                _segments.insert(_segments.begin(), {_lines.size(), _lines.size()});
             }
-
-            // Run command
-            if (command) {
-                addComment(*command, text, lineId);
+            for (size_t i = 0; i < lines.size(); i++) {
+                int filter = classes != nullptr && i < classes->size() ? (*classes)[i] : kUnclassified;
+                addLineLocked(lines[i], src, &commands, filter, history);
+            }
+            if (history && _segments.front().first == _segments.front().last) {
+                _segments.erase(_segments.begin());
             }
         }
-        
+
+        runCommands(commands);
+
         if (_onNewDataAvailable) {
             _onNewDataAvailable();
         }
     }
 
-private:
+    void addTab(const std::string& name) {
+        TabInternal tab{name};
+        auto sampling = _sampling.find(name);
+        if (sampling != _sampling.end()) {
+            tab.sampleEvery = sampling->second;
+        }
+        _tabs.emplace_back(std::move(tab));
+    }
 
-    void addComment(const std::string& command,
-                    const std::string& text,
-                    size_t lineId) {
+    /**
+     * @param history Whether the line goes at the end of the first segment.
+     */
+    void addLineLocked(std::string_view text, uint8_t src, std::vector<Command>* commands,
+                       int classified = kUnclassified, bool history = false) {
 
-        if (_exec == nullptr) {
+        if (classified == kDropped
+            || (classified == kUnclassified && _drops.size() > 0u && _drops.match(text) != nullptr)) {
             return;
         }
-        auto comment =_exec->exec(command, text);
-        if (!comment.empty()) {
-            _comments[lineId] = comment;
-            LOG("Added comment (" << lineId << ") "  << _comments[lineId]);
+
+        LogLineInternal line{std::chrono::steady_clock::now(), 0, 0, src};
+        std::string params;
+        auto lineId = _lines.size();
+
+        // Matching filter takes the ownership of the line.
+        FilterSet::Captures captures;
+        auto filter = classified == kUnclassified
+            ? _filters.match(text, &captures)
+            : _filters.matchClassified(classified, text, &captures);
+        if (filter != nullptr) {
+            line.src = filter->src;
         }
-        else {
-            LOG("Failed to add comment for line " << lineId);
+
+        auto& tab = _tabs[line.src];
+        if (tab.sampleEvery > 1u && tab.sampleCounter++ % tab.sampleEvery != 0u) {
+            tab.sampled++;
+            return;
+        }
+
+        if (filter != nullptr && !filter->fields.empty()) {
+            addFields(*filter, text, captures, lineId);
+        }
+
+        // Long lines are only matched in full
+        std::string_view stored = text;
+        uint64_t offset;
+        if (_lineLimit > 0u && text.size() > _lineLimit && _spill.append(text, &offset)) {
+            _spilled[lineId] = {offset, text.size()};
+            stored = text.substr(0, _lineLimit);
+        }
+
+        line.templateId = _templates.add(stored, &params, &line.paramCnt);
+
+        _lines.emplace_back(line);
+        _store.append(params);
+        if (!_keys.empty()) {
+            _keys.add(text, lineId);
+        }
+        if (_query) {
+            _query->index.reserve(lineId + 1u);
+            if (matchesQuery(*_query, text)) {
+                markQueryLocked(lineId);
+            }
         }
-    }
 
-    size_t clamp(size_t wanted, size_t min, size_t max) {
-        if (wanted < min) {
-            return min;
+        if (history) {
+            _segments.front().last++;
         }
-        else if (wanted > max) {
-            return max;
+        else if (!_segments.empty() && _segments.back().last == lineId) {
+            _segments.back().last++;
         }
         else {
-            return wanted;
+            _segments.push_back({lineId, lineId + 1u});
+        }
+
+        // Update tabs
+        tab.rowsCnt++;
+        _index.add(lineId, line.src);
+
+        // Commands may take long, so they are run without the lock
+        if (filter != nullptr && !filter->command.empty() && _exec != nullptr) {
+            commands->push_back({filter->command, filter->coprocess, std::string(text), lineId});
         }
     }
 
-    size_t clampRow(size_t wanted) {
-        return clamp(wanted, getMinLineWithFilters(), getMaxLineWithFilters());
+    void addFields(const Filter& filter, std::string_view text,
+                   const FilterSet::Captures& captures, size_t lineId) {
+
+        size_t column = _fieldColumns[filter.src];
+        for (const auto& field : filter.fields) {
+            if (field.second < captures.size() && captures[field.second].matched) {
+                const auto& capture = captures[field.second];
+                // The groups may refer to a flattened copy of the text
+                _columns[column].add(lineId, text.substr(capture.first - captures[0].first, capture.length()));
+            }
+            column++;
+        }
     }
 
-    bool reverseFiltered(size_t *from) {
-        size_t i = *from - 1u;
-        while ((i < _lines.size()) && !_tabs[_lines[i].src].enabled) {
-            i--;
+    void runCommands(const std::vector<Command>& commands) {
+
+        for (const auto& command : commands) {
+            size_t lineId = command.lineId;
+            if (!command.coprocess) {
+                addComment(lineId, _exec->exec(command.command, command.text));
+                continue;
+            }
+
+            // Comments of a co-process arrive on its reader thread
+            {
+                std::lock_guard<std::mutex> g(_mtx);
+                _pendingComments++;
+            }
+            _exec->execAsync(command.command, command.text, [this, lineId](std::string comment) {
+                if (addComment(lineId, std::move(comment)) && _onNewDataAvailable) {
+                    _onNewDataAvailable();
+                }
+                {
+                    std::lock_guard<std::mutex> g(_mtx);
+                    _pendingComments--;
+                }
+                _commentAdded.notify_all();
+            });
         }
+    }
 
-        if (i < _lines.size()) {
-            *from = i;
-            return true;
+    bool addComment(size_t lineId, std::string comment) {
+
+        if (comment.empty()) {
+            LOG("Failed to add comment for line " << lineId);
+            return false;
         }
 
-        return false;
+        std::lock_guard<std::mutex> g(_mtx);
+        _comments[lineId] = std::move(comment);
+        LOG("Added comment (" << lineId << ") "  << _comments[lineId]);
+        return true;
     }
 
-    size_t fastForwardFiltered(size_t *from) {
-        size_t i = *from + 1u;
-        while ((i < _lines.size()) && !_tabs[_lines[i].src].enabled) {
-            i++;
+    LogLine getLineLocked(size_t lineId) {
+
+        assert(lineId < _lines.size());
+
+        const auto& internal = _lines[lineId];
+        auto text = _templates.render(internal.templateId, _store.get(lineId), internal.paramCnt);
+        LogLine line{internal.time, std::move(text), "", lineId, internal.src, true};
+
+        auto comment = _comments.find(lineId);
+        if (comment != std::end(_comments)) {
+            line.comment = comment->second;
         }
 
-        if (i < _lines.size()) {
-            *from = i;
-            return true;
+        auto spilled = _spilled.find(lineId);
+        if (spilled != _spilled.end()) {
+            line.fullLength = spilled->second.length;
         }
 
-        return false;
+        return line;
     }
 
-    size_t getMinLineWithFilters() {
-        size_t minLineId = kUndefined;
-        bool found = false;
-        for (const auto& tab : _tabs) {
-            if (tab.enabled && (tab.minLineId < minLineId)) {
-                minLineId = tab.minLineId;
-                found = true;
+    //! @return Full text of the line, read from the spill file if needed.
+    std::string getTextLocked(size_t lineId, LineStore::Cursor* cursor) const {
+
+        auto spilled = _spilled.find(lineId);
+        if (spilled != _spilled.end()) {
+            std::string text;
+            if (_spill.read(spilled->second.offset, spilled->second.length, &text)) {
+                return text;
             }
         }
-        return found ? minLineId : kUndefined;    
+
+        const auto& internal = _lines[lineId];
+        return _templates.render(internal.templateId, cursor->get(lineId), internal.paramCnt);
     }
 
-    size_t getMaxLineWithFilters() {
-        size_t maxLineId = 0u;
-        bool found = false;
-        for (const auto& tab : _tabs) {
-            if (tab.enabled && (tab.maxLineId > maxLineId)) {
-                maxLineId = tab.maxLineId;
-                found = true;
+    //! @return Formatted visible lines of the chunk and their count.
+    std::pair<std::string, size_t> formatChunk(const Segment& chunk, const View& view) const {
+
+        LineStore::Cursor cursor(_store);
+        RankIndex::Mask enabled = ~view.disabled;
+        std::string text;
+        size_t cnt = 0u;
+
+        for (size_t lineId = chunk.first; lineId < chunk.last; lineId++) {
+
+            if (!isVisibleLocked(view, enabled, lineId)) {
+                continue;
+            }
+
+            text.append(getTextLocked(lineId, &cursor));
+            text.push_back('\n');
+            cnt++;
+
+            auto comment = _comments.find(lineId);
+            if (comment != std::end(_comments)) {
+                std::string_view body{comment->second};
+                while (!body.empty() && body.back() == '\n') {
+                    body.remove_suffix(1u);
+                }
+                text.append("        |> ");
+                text.append(body);
+                text.push_back('\n');
             }
         }
-        return found ? maxLineId : kUndefined;    
+
+        return {std::move(text), cnt};
     }
 
-    size_t getLinesCntWithFilters() {
-        size_t cnt = 0;
-        for (const auto& tab : _tabs) {
-            if (tab.enabled) {
-                cnt += tab.rowsCnt;
+    static bool writeAll(int fd, const std::vector<std::string>& buffers) {
+
+        std::vector<iovec> iovecs;
+        for (const auto& buffer : buffers) {
+            if (!buffer.empty()) {
+                iovecs.push_back({const_cast<char*>(buffer.data()), buffer.size()});
             }
         }
-        return cnt;
+
+        size_t first = 0u;
+        while (first < iovecs.size()) {
+            size_t cnt = std::min<size_t>(iovecs.size() - first, IOV_MAX);
+            ssize_t written = ::writev(fd, &iovecs[first], cnt);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+
+            // Skip what was written, possibly part of an iovec.
+            size_t remaining = written;
+            while (first < iovecs.size() && remaining >= iovecs[first].iov_len) {
+                remaining -= iovecs[first].iov_len;
+                first++;
+            }
+            if (remaining > 0u) {
+                iovecs[first].iov_base = static_cast<char*>(iovecs[first].iov_base) + remaining;
+                iovecs[first].iov_len -= remaining;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * Finds the lines of the enabled tabs sharing a key with the top line,
+     * preferring the key the view cycled through last.
+     *
+     * @return False if the top line has no key.
+     */
+    bool findRelatedLocked(View* view, size_t* lineId, std::vector<size_t>* related, RelatedInfo* info) {
+
+        size_t position = getPositionLocked(*view);
+        *lineId = position != kUndefined ? selectVisible(*view, position) : kUndefined;
+        if (*lineId == kUndefined || _keys.empty()) {
+            return false;
+        }
+
+        LineStore::Cursor cursor(_store);
+        auto found = _keys.find(getTextLocked(*lineId, &cursor));
+        if (found.empty()) {
+            return false;
+        }
+        auto key = std::find(found.begin(), found.end(), KeyIndex::Found{view->keyExtractor, view->key});
+        if (key == found.end()) {
+            key = found.begin();
+        }
+        view->keyExtractor = key->first;
+        view->key = key->second;
+
+        RankIndex::Mask enabled = ~view->disabled;
+        *related = _keys.getLines(key->first, key->second);
+        related->erase(std::remove_if(related->begin(), related->end(),
+            [&](size_t i) { return !isVisibleLocked(*view, enabled, i); }), related->end());
+
+        info->name = _keys.getName(key->first);
+        info->key = key->second;
+        info->count = related->size();
+        return !related->empty();
+    }
+
+    static bool matchesQuery(const Query& query, std::string_view text) {
+
+        if (!query.literal.empty() && text.find(query.literal) == std::string_view::npos) {
+            return false;
+        }
+        try {
+            return std::regex_search(text.begin(), text.end(), *query.compiled);
+        }
+        catch (const std::regex_error& e) {
+            LOG("Query failed: " << e.what());
+            return false;
+        }
+    }
+
+    void markQueryLocked(size_t lineId) {
+        auto& query = *_query;
+        if (lineId / 64u >= query.matches.size()) {
+            query.matches.resize(lineId / 64u + 1u);
+        }
+        query.matches[lineId / 64u] |= uint64_t{1} << (lineId % 64u);
+        query.index.add(lineId, _lines[lineId].src);
+        query.matched++;
+    }
+
+    //! Called with _queryMtx held.
+    void stopScanning() {
+        _queryStopped = true;
+        for (auto& worker : _queryWorkers) {
+            worker.join();
+        }
+        _queryWorkers.clear();
+
+        std::lock_guard<std::mutex> g(_mtx);
+        _query.reset();
+    }
+
+    /**
+     * Worker of a query, taking chunks of the lines until all were scanned.
+     * The lines of a chunk are rendered under the lock, and matched without.
+     */
+    void scanQuery() {
+
+        // Replaced only once the workers are joined. The regex and the
+        // range don't change, the rest is only accessed under the lock.
+        const Query* query;
+        {
+            std::lock_guard<std::mutex> g(_mtx);
+            query = _query.get();
+        }
+        if (query == nullptr) {
+            return;
+        }
+
+        std::string texts;
+        std::vector<size_t> ends;
+        std::vector<size_t> matched;
+
+        while (!_queryStopped) {
+
+            size_t first = _queryNextChunk++ * kQueryChunkSize;
+            if (first >= query->end) {
+                return;
+            }
+            size_t last = std::min(query->end, first + kQueryChunkSize);
+
+            texts.clear();
+            ends.clear();
+            matched.clear();
+            {
+                std::lock_guard<std::mutex> g(_mtx);
+                LineStore::Cursor cursor(_store);
+                for (size_t lineId = first; lineId < last && !_queryStopped; lineId++) {
+                    texts.append(getTextLocked(lineId, &cursor));
+                    ends.push_back(texts.size());
+                }
+            }
+
+            size_t start = 0u;
+            for (size_t i = 0; i < ends.size() && !_queryStopped; i++) {
+                if (matchesQuery(*query, std::string_view(texts.data() + start, ends[i] - start))) {
+                    matched.push_back(first + i);
+                }
+                start = ends[i];
+            }
+
+            bool done;
+            {
+                std::lock_guard<std::mutex> g(_mtx);
+                if (_queryStopped) {
+                    return;
+                }
+                for (size_t lineId : matched) {
+                    markQueryLocked(lineId);
+                }
+                _query->scanned += last - first;
+                done = _query->scanned == _query->end;
+            }
+
+            if (done) {
+                LOG("Query " << query->regex << " done");
+            }
+            if (_onNewDataAvailable) {
+                _onNewDataAvailable();
+            }
+        }
+    }
+
+    //! @return Whether the view shows only the lines matching the query.
+    bool showsQueryLocked(const View& view) const {
+        return view.query && _query;
+    }
+
+    //! @return Index of the lines the view shows.
+    const RankIndex& getIndexLocked(const View& view) const {
+        return showsQueryLocked(view) ? _query->index : _index;
+    }
+
+    bool isVisibleLocked(const View& view, const RankIndex::Mask& enabled, size_t lineId) const {
+        if (!enabled[_lines[lineId].src]) {
+            return false;
+        }
+        if (!showsQueryLocked(view)) {
+            return true;
+        }
+        const auto& matches = _query->matches;
+        return lineId / 64u < matches.size() && (matches[lineId / 64u] >> (lineId % 64u)) & 1u;
+    }
+
+    size_t getVisibleCntLocked(const View& view) const {
+        RankIndex::Mask enabled = ~view.disabled;
+        return getIndexLocked(view).count(enabled, [&](size_t i) { return isVisibleLocked(view, enabled, i); });
+    }
+
+    /**
+     * @return Position of the first visible line at or after the view's
+     *         row among the visible lines, or kUndefined if there are none.
+     */
+    size_t getPositionLocked(const View& view) const {
+        size_t cnt = getVisibleCntLocked(view);
+        if (cnt == 0u) {
+            return kUndefined;
+        }
+        size_t position = countBeforeLocked(view, view.row);
+        return std::min(position, cnt - 1u);
+    }
+
+    /**
+     * @return Number of enabled lines shown before the line.
+     */
+    size_t countBeforeLocked(const View& view, size_t lineId) const {
+
+        RankIndex::Mask enabled = ~view.disabled;
+        const auto& index = getIndexLocked(view);
+        auto isMember = [&](size_t i) { return isVisibleLocked(view, enabled, i); };
+        if (_segments.size() == 1u) {
+            return index.countBefore(lineId, enabled, isMember);
+        }
+
+        const auto& counts = getSegmentCountsLocked(view);
+        size_t segment = findSegmentLocked(counts, lineId);
+        if (segment == kUndefined) {
+            return counts.before.back();
+        }
+        return counts.before[segment] + index.countBefore(lineId, enabled, isMember)
+            - index.countBefore(_segments[segment].first, enabled, isMember);
+    }
+
+    //! @return Id of the visible line at the given position, or kUndefined.
+    size_t selectVisible(const View& view, size_t position) const {
+        RankIndex::Mask enabled = ~view.disabled;
+        const auto& index = getIndexLocked(view);
+        auto isMember = [&](size_t i) { return isVisibleLocked(view, enabled, i); };
+        if (_segments.size() == 1u) {
+            size_t lineId = index.select(position, enabled, isMember);
+            return lineId < _lines.size() ? lineId : kUndefined;
+        }
+
+        const auto& counts = getSegmentCountsLocked(view);
+        if (position >= counts.before.back()) {
+            return kUndefined;
+        }
+        // The last segment starting at or before the position
+        size_t segment = std::upper_bound(counts.before.begin(), counts.before.end(), position)
+            - counts.before.begin() - 1u;
+        size_t before = index.countBefore(_segments[segment].first, enabled, isMember);
+        return index.select(before + position - counts.before[segment], enabled, isMember);
+    }
+
+    /**
+     * @return Visible lines before each segment for the view, recounted
+     *         once lines were added or the view shows other lines.
+     */
+    const SegmentCounts& getSegmentCountsLocked(const View& view) const {
+
+        RankIndex::Mask enabled = ~view.disabled;
+        bool query = showsQueryLocked(view);
+        size_t matched = query ? _query->matched : 0u;
+        auto& counts = _segmentCounts;
+        if (counts.lineCnt == _lines.size() && counts.enabled == enabled && counts.query == query
+            && counts.queryGeneration == _queryGeneration && counts.queryMatched == matched) {
+            return counts;
+        }
+
+        counts.enabled = enabled;
+        counts.query = query;
+        counts.lineCnt = _lines.size();
+        counts.queryGeneration = _queryGeneration;
+        counts.queryMatched = matched;
+        counts.before.clear();
+        counts.byFirst.clear();
+
+        const auto& index = getIndexLocked(view);
+        auto isMember = [&](size_t i) { return isVisibleLocked(view, enabled, i); };
+        size_t cnt = 0u;
+        for (size_t i = 0; i < _segments.size(); i++) {
+            const auto& segment = _segments[i];
+            counts.before.push_back(cnt);
+            counts.byFirst.emplace_back(segment.first, i);
+            cnt += index.countBefore(segment.last, enabled, isMember) - index.countBefore(segment.first, enabled, isMember);
+        }
+        counts.before.push_back(cnt);
+        std::sort(counts.byFirst.begin(), counts.byFirst.end());
+        return counts;
+    }
+
+    //! @return Index of the segment holding the line, or kUndefined.
+    size_t findSegmentLocked(const SegmentCounts& counts, size_t lineId) const {
+        auto it = std::upper_bound(counts.byFirst.begin(), counts.byFirst.end(),
+                                   std::make_pair(lineId, kUndefined));
+        if (it == counts.byFirst.begin()) {
+            return kUndefined;
+        }
+        size_t segment = std::prev(it)->second;
+        return lineId < _segments[segment].last ? segment : kUndefined;
+    }
+
+    bool scrollToLocked(View* view, size_t position) {
+        size_t lineId = selectVisible(*view, position);
+        if (lineId == kUndefined || lineId == view->row) {
+            return false;
+        }
+        view->row = lineId;
+        return true;
+    }
+
+    bool fastForwardFiltered(const View& view, size_t *from) {
+        RankIndex::Mask enabled = ~view.disabled;
+
+        // Mostly the following line of the same segment is visible.
+        size_t next = *from + 1u;
+        size_t segment = _segments.size() == 1u ? 0u : findSegmentLocked(getSegmentCountsLocked(view), *from);
+        if (segment != kUndefined && next < _segments[segment].last && isVisibleLocked(view, enabled, next)) {
+            *from = next;
+            return true;
+        }
+
+        size_t position = countBeforeLocked(view, *from) + (isVisibleLocked(view, enabled, *from) ? 1u : 0u);
+        size_t lineId = selectVisible(view, position);
+        if (lineId == kUndefined) {
+            return false;
+        }
+        *from = lineId;
+        return true;
     }
 
     std::mutex  _mtx;
     int         _src = 0;
-    size_t      _row = 0;
+    View        _view;
     size_t      _nextLine = 0;
     bool        _hasNextLine = false;
     std::vector<LogLineInternal> _lines;
+    //! Lines in the order they are shown, usually a single segment.
+    std::deque<Segment> _segments;
+    //! Taken for the view last counted, as views are mostly counted repeatedly.
+    mutable SegmentCounts _segmentCounts;
+    std::vector<std::function<void()>> _historyLoaders;
     std::vector<TabInternal> _tabs;
-    std::vector<Filter> _filters;
+    FilterSet _filters;
+    //! Filters of the lines not to store, tried before the others.
+    FilterSet _drops;
+    std::vector<Column> _columns;
+    //! First column of the fields of each filter, by source.
+    std::map<int, size_t> _fieldColumns;
+    //! Sampling of tabs by name.
+    std::map<std::string, size_t> _sampling;
+    RankIndex _index;
+    //! Lines by their correlation keys.
+    KeyIndex _keys;
+    TemplateMiner _templates;
+    LineStore _store;
     std::function<void()> _onNewDataAvailable;
     std::map<size_t, std::string> _comments;
+    size_t _pendingComments{0u};
+    std::condition_variable _commentAdded;
     std::shared_ptr<IExec> _exec;
+    //! Lines longer than this keep only a prefix in memory, 0 for no limit.
+    size_t _lineLimit{0u};
+    SpillStore _spill;
+    std::map<size_t, Spilled> _spilled;
+    std::unique_ptr<Query> _query;
+    //! Tells queries apart, counted up whenever one starts.
+    size_t _queryGeneration{0u};
+    //! Serializes starting and stopping the query, which may be done from
+    //! the UI, the session's viewers and the shutdown at once.
+    std::mutex _queryMtx;
+    std::vector<std::thread> _queryWorkers;
+    std::atomic<bool> _queryStopped{false};
+    std::atomic<size_t> _queryNextChunk{0u};
 };
 
@@ -3,32 +3,72 @@
 #include <array>
 #include <cstdio>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 
+#include "Coprocess.hpp"
 #include "Log.hpp"
 #include "IExec.hpp"
 
 
 struct Exec : public IExec {
 
-std::string exec(const std::string& cmd, const std::string& line) override {
+    /**
+     * Runs the command through the shell, with the line as its argument.
+     */
+    std::string exec(const std::string& cmd, const std::string& line) override {
 
-    std::string fullCmd = cmd + " '" + line + "'"; 
-    std::array<char, 128> buffer;
-    std::string result;
+        std::string fullCmd = cmd + " " + quote(line);
+        std::array<char, 128> buffer;
+        std::string result;
 
-    LOG("Executing: " << fullCmd);
+        LOG("Executing: " << fullCmd);
 
-    std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(fullCmd.c_str(), "r"), pclose);
+        std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(fullCmd.c_str(), "r"), pclose);
 
-    if (pipe) {
-        while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) {
-            result += buffer.data();
+        if (pipe) {
+            while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) {
+                result += buffer.data();
+            }
         }
+        return result;
     }
-    return result;
-}
 
+    void execAsync(const std::string& cmd, const std::string& line, OnResult onResult) override {
+
+        Coprocess* coprocess;
+        {
+            std::lock_guard<std::mutex> g(_mtx);
+            auto& started = _coprocesses[cmd];
+            if (!started) {
+                started = std::make_unique<Coprocess>(cmd);
+            }
+            coprocess = started.get();
+        }
+        coprocess->send(line, onResult);
+    }
+
+    /**
+     * Quotes the text as a single shell word, even if it contains quotes.
+     */
+    static std::string quote(const std::string& text) {
+        std::string quoted = "'";
+        for (char c : text) {
+            if (c == '\'') {
+                quoted += "'\\''";
+            }
+            else {
+                quoted += c;
+            }
+        }
+        return quoted + "'";
+    }
+
+private:
+
+    std::mutex _mtx;
+    std::map<std::string, std::unique_ptr<Coprocess>> _coprocesses;
 };
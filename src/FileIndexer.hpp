@@ -0,0 +1,333 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "LineSplitter.hpp"
+#include "Log.hpp"
+
+/**
+ * Indexes the lines of regular files on a pool of threads.
+ *
+ * A file is mapped and split into blocks of bytes, each starting after
+ * the first newline at or past its nominal offset, so workers find the
+ * boundaries without coordinating. Workers take the next block, locate
+ * its lines and classify them, and the blocks are handed over strictly
+ * in file order, so lines get their ids as if the file was read serially.
+ * The files are indexed in turn, the workers move on to the next file
+ * once all blocks of the previous one were taken.
+ *
+ * The first block is small, so the first screen shows up right away.
+ * Workers may run a bounded number of blocks ahead of the handover.
+ *
+ * Only complete lines are indexed. The offset after the last newline is
+ * reported once everything was handed over, for a reader to continue.
+ */
+class FileIndexer {
+
+public:
+
+    //! Classifies lines on a worker thread, by filter index or -1.
+    using Classify = std::function<void(const std::vector<std::string_view>& lines, std::vector<int>* classes)>;
+    //! Called on each worker thread to create its own classifier.
+    using ClassifierFactory = std::function<Classify()>;
+    using OnLines = std::function<void(const std::vector<std::string_view>& lines, const std::vector<int>& classes)>;
+    //! Receives the indexed and the total bytes.
+    using OnProgress = std::function<void(size_t indexed, size_t total)>;
+    //! Receives the offset after the last indexed line.
+    using OnDone = std::function<void(size_t end)>;
+
+    //! Files smaller than this are read serially.
+    static constexpr size_t kMinSize = 16u * 1024u * 1024u;
+
+    /**
+     * @return True if the file is regular and large enough to be worth
+     *         indexing in parallel.
+     */
+    static bool isIndexable(const std::string& filename, size_t minSize = kMinSize) {
+        struct stat status;
+        return ::stat(filename.c_str(), &status) == 0 && S_ISREG(status.st_mode)
+            && static_cast<size_t>(status.st_size) >= minSize;
+    }
+
+    explicit FileIndexer(ClassifierFactory classifierFactory,
+                         size_t workers = std::thread::hardware_concurrency())
+        : _classifierFactory(classifierFactory)
+        , _workerCnt(std::max<size_t>(workers, 1u)) {}
+
+    ~FileIndexer() {
+        stop();
+        for (const auto& file : _files) {
+            ::munmap(const_cast<char*>(file->data), file->size);
+        }
+    }
+
+    /**
+     * Queues the file to be indexed after the files added before it.
+     *
+     * @return False if the file can't be mapped.
+     */
+    bool add(const std::string& filename, OnLines onLines, OnProgress onProgress, OnDone onDone) {
+
+        auto file = std::make_unique<File>();
+        if (!open(filename, file.get())) {
+            return false;
+        }
+        file->onLines = onLines;
+        file->onProgress = onProgress;
+        file->onDone = onDone;
+        LOG("Indexing " << filename << " in " << file->blockCnt << " blocks");
+
+        {
+            std::lock_guard<std::mutex> g(_mtx);
+            if (_stopped) {
+                ::munmap(const_cast<char*>(file->data), file->size);
+                return false;
+            }
+            _files.emplace_back(std::move(file));
+            if (_workers.empty()) {
+                LOG("Indexing on " << _workerCnt << " threads");
+                for (size_t i = 0; i < _workerCnt; i++) {
+                    _workers.emplace_back([this] () { work(); });
+                }
+            }
+        }
+        _handedOver.notify_all();
+        return true;
+    }
+
+    /**
+     * Stops indexing, no callbacks are made once this returns.
+     */
+    void stop() {
+        {
+            std::lock_guard<std::mutex> g(_mtx);
+            _stopped = true;
+        }
+        _handedOver.notify_all();
+        for (auto& worker : _workers) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+    }
+
+private:
+
+    static constexpr size_t kFirstBlockSize = 256u * 1024u;
+    static constexpr size_t kBlockSize = 4u * 1024u * 1024u;
+    //! Blocks workers may index ahead of the oldest one not handed over.
+    static constexpr size_t kMaxBlocksAhead = 16u;
+    //! Lines handed over at once, so readers get the lock in between.
+    static constexpr size_t kLinesPerBatch = 4096u;
+
+    struct Block {
+        std::vector<std::string_view> lines;
+        std::vector<int> classes;
+        size_t end;
+    };
+
+    struct File {
+        OnLines onLines;
+        OnProgress onProgress;
+        OnDone onDone;
+
+        const char* data{nullptr};
+        size_t size{0u};
+        //! Offset after the last newline.
+        size_t end{0u};
+        size_t blockCnt{0u};
+
+        size_t nextBlock{0u};
+        size_t nextHandover{0u};
+        bool handingOver{false};
+        bool finished{false};
+        //! Indexed blocks waiting for the ones before them.
+        std::map<size_t, Block> blocks;
+    };
+
+    static bool open(const std::string& filename, File* file) {
+
+        int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat status;
+        if (fd < 0 || ::fstat(fd, &status) != 0 || status.st_size == 0) {
+            LOG("Failed to index " << filename);
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            return false;
+        }
+
+        file->size = status.st_size;
+        void* data = ::mmap(nullptr, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            LOG("Failed to map " << filename);
+            return false;
+        }
+        file->data = static_cast<const char*>(data);
+        ::madvise(data, file->size, MADV_SEQUENTIAL);
+
+        // An incomplete last line is left to the reader continuing.
+        auto last = static_cast<const char*>(::memrchr(file->data, '\n', file->size));
+        file->end = last != nullptr ? last - file->data + 1u : 0u;
+        file->blockCnt = file->end > kFirstBlockSize ? 2u + (file->end - kFirstBlockSize - 1u) / kBlockSize : 1u;
+        return true;
+    }
+
+    //! @return Offset of the first line starting at or after the block's nominal start.
+    static size_t getBlockStart(const File& file, size_t block) {
+
+        if (block == 0u) {
+            return 0u;
+        }
+        size_t nominal = std::min(kFirstBlockSize + (block - 1u) * kBlockSize, file.end);
+        if (nominal == file.end) {
+            return file.end;
+        }
+        // A line starting exactly at the nominal offset belongs to this block.
+        auto newline = static_cast<const char*>(std::memchr(file.data + nominal - 1u, '\n', file.end - nominal + 1u));
+        return newline - file.data + 1u;
+    }
+
+    //! @return Whether a worker may take a block of the current file.
+    bool canTakeLocked() const {
+        if (_current >= _files.size()) {
+            return false;
+        }
+        const auto& file = *_files[_current];
+        return file.nextBlock < file.nextHandover + kMaxBlocksAhead;
+    }
+
+    void work() {
+
+        Classify classify = _classifierFactory ? _classifierFactory() : Classify{};
+
+        while (true) {
+
+            File* file;
+            size_t block;
+            {
+                std::unique_lock<std::mutex> lock(_mtx);
+                _handedOver.wait(lock, [this] () { return _stopped || canTakeLocked(); });
+                if (_stopped) {
+                    return;
+                }
+                file = _files[_current].get();
+                block = file->nextBlock++;
+                if (file->nextBlock == file->blockCnt) {
+                    _current++;
+                }
+            }
+
+            Block result;
+            index(*file, block, classify, &result);
+
+            {
+                std::lock_guard<std::mutex> g(_mtx);
+                file->blocks.emplace(block, std::move(result));
+            }
+            handOver(file);
+        }
+    }
+
+    static void index(const File& file, size_t block, const Classify& classify, Block* result) {
+
+        const char* begin = file.data + getBlockStart(file, block);
+        const char* end = file.data + getBlockStart(file, block + 1u);
+        const char* start = begin;
+
+        LineSplitter::forEachNewline(begin, end, [&](const char* newline) {
+            if (newline != start) {
+                result->lines.emplace_back(start, newline - start);
+            }
+            start = newline + 1;
+        });
+
+        if (classify) {
+            classify(result->lines, &result->classes);
+        }
+        result->classes.resize(result->lines.size(), -1);
+        result->end = end - file.data;
+    }
+
+    /**
+     * Hands over the completed blocks of the file in order. Only one
+     * worker hands over at a time, the others leave their blocks to it.
+     */
+    void handOver(File* file) {
+
+        std::unique_lock<std::mutex> lock(_mtx);
+        if (file->handingOver) {
+            return;
+        }
+        file->handingOver = true;
+
+        while (!_stopped) {
+            auto it = file->blocks.find(file->nextHandover);
+            if (it == file->blocks.end()) {
+                break;
+            }
+            Block block = std::move(it->second);
+            file->blocks.erase(it);
+            lock.unlock();
+
+            deliver(*file, block);
+
+            lock.lock();
+            file->nextHandover++;
+            _handedOver.notify_all();
+        }
+
+        file->handingOver = false;
+        bool done = !_stopped && file->nextHandover == file->blockCnt && !file->finished;
+        file->finished = file->finished || done;
+        lock.unlock();
+
+        if (done) {
+            LOG("Indexed " << file->end << " bytes");
+            file->onDone(file->end);
+        }
+    }
+
+    void deliver(const File& file, const Block& block) {
+
+        std::vector<std::string_view> lines;
+        std::vector<int> classes;
+        for (size_t first = 0u; first < block.lines.size() && !_stopped; first += kLinesPerBatch) {
+            size_t last = std::min(first + kLinesPerBatch, block.lines.size());
+            lines.assign(block.lines.begin() + first, block.lines.begin() + last);
+            classes.assign(block.classes.begin() + first, block.classes.begin() + last);
+            file.onLines(lines, classes);
+        }
+        if (file.onProgress) {
+            file.onProgress(block.end, file.end);
+        }
+    }
+
+    ClassifierFactory               _classifierFactory;
+    size_t                          _workerCnt;
+
+    std::mutex                      _mtx;
+    std::condition_variable         _handedOver;
+    std::atomic<bool>               _stopped{false};
+    std::vector<std::unique_ptr<File>> _files;
+    //! First file with blocks left to take.
+    size_t                          _current{0u};
+    std::vector<std::thread>        _workers;
+};
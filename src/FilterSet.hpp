@@ -0,0 +1,827 @@
+#pragma once
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "LiteralAutomaton.hpp"
+#include "Log.hpp"
+
+struct Filter {
+    int src;
+    std::string name;
+    std::string pattern;
+    std::string command;
+    //! Whether the command runs as a co-process.
+    bool coprocess{false};
+    //! Literal every matching line contains, if any.
+    std::string literal;
+    //! Whether containing the literal is all the regex checks.
+    bool literalOnly{false};
+    //! Names of the fields captured by named groups, with the group numbers.
+    std::vector<std::pair<std::string, size_t>> fields;
+    //! Compiled on the first line the filter is tried on.
+    std::unique_ptr<std::regex> regex;
+    bool invalid{false};
+
+    //! Lines the regex was tried on, and how many it matched.
+    size_t tried{0};
+    size_t matched{0};
+    //! Lines skipped for being longer than the filter accepts.
+    size_t skipped{0};
+    std::chrono::nanoseconds time{0};
+    std::chrono::nanoseconds maxTime{0};
+    //! Longest line the regex is tried on, lowered when it is slow.
+    size_t maxLength{std::numeric_limits<size_t>::max()};
+    //! Lines on which the regex exceeded its budget.
+    size_t strikes{0};
+    //! Why the filter is restricted or disabled, if it is.
+    std::string warning;
+};
+
+/**
+ * Ordered set of filters, where the first matching filter takes the line.
+ *
+ * Compiling hundreds of regular expressions dominates the startup, so a
+ * filter's regex is only compiled once a line contains the filter's
+ * required literal. Lines are screened for the literals of all filters in
+ * one pass with an Aho-Corasick automaton, which can be cached on disk,
+ * keyed by a hash of the literals, and mapped on later launches.
+ *
+ * std::regex backtracks and can't be interrupted, so a regex with
+ * ambiguous nested quantifiers is only tried on very short lines, and a
+ * filter whose regex takes longer than its budget on a line is demoted to
+ * shorter lines, on which backtracking costs less, and disabled if it
+ * stays slow.
+ */
+class FilterSet {
+
+public:
+
+    using Captures = std::match_results<std::string_view::const_iterator>;
+
+    /**
+     * Finds the longest literal contained in every line the ECMAScript
+     * regex fully matches. Alternations, groups, classes and optional
+     * atoms are skipped, so the result may be shorter than possible,
+     * but never wrong.
+     */
+    static std::string requiredLiteral(const std::string& regex) {
+
+        std::string best;
+        std::string run;
+        int depth = 0;
+
+        auto endRun = [&] () {
+            if (run.size() > best.size()) {
+                best = run;
+            }
+            run.clear();
+        };
+
+        for (size_t i = 0; i < regex.size(); i++) {
+
+            char c = regex[i];
+
+            if (c == '\\' && i + 1u < regex.size()) {
+                char escaped = regex[i + 1u];
+                if (depth == 0 && std::ispunct(static_cast<unsigned char>(escaped))) {
+                    run.push_back(escaped);
+                    i++;
+                }
+                else {
+                    // Neither the escape nor its arguments are literal text
+                    i += getEscapeLength(regex, i) - 1u;
+                    endRun();
+                }
+            }
+            else if (c == '[') {
+                i = findClassEnd(regex, i);
+                endRun();
+            }
+            else if (c == '(') {
+                depth++;
+                endRun();
+            }
+            else if (c == ')') {
+                depth--;
+                endRun();
+            }
+            else if (depth > 0) {
+                continue;
+            }
+            else if (c == '|') {
+                return {};
+            }
+            else if (c == '*' || c == '?' || c == '{') {
+                // Previous atom is optional.
+                if (!run.empty()) {
+                    run.pop_back();
+                }
+                endRun();
+                if (c == '{') {
+                    i = std::min(regex.find('}', i), regex.size());
+                }
+            }
+            else if (c == '+' || c == '.' || c == '^' || c == '$') {
+                endRun();
+            }
+            else {
+                run.push_back(c);
+            }
+        }
+
+        endRun();
+        return best;
+    }
+
+    /**
+     * @return Length of the ECMAScript escape sequence starting with the
+     *         backslash at the offset, like \d, \x41, \u0041 or \cA.
+     */
+    static size_t getEscapeLength(const std::string& regex, size_t offset) {
+
+        size_t length = 2u;
+        auto isHex = [&regex] (size_t i) {
+            return i < regex.size() && std::isxdigit(static_cast<unsigned char>(regex[i]));
+        };
+
+        switch (regex[offset + 1u]) {
+            case 'x':
+                while (length < 4u && isHex(offset + length)) {
+                    length++;
+                }
+                break;
+            case 'u':
+                while (length < 6u && isHex(offset + length)) {
+                    length++;
+                }
+                break;
+            case 'c':
+                length += offset + length < regex.size() ? 1u : 0u;
+                break;
+            case '1': case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9':
+                // Back reference, while \0 stands alone
+                while (offset + length < regex.size() && std::isdigit(static_cast<unsigned char>(regex[offset + length]))) {
+                    length++;
+                }
+                break;
+            default:
+                break;
+        }
+        return length;
+    }
+
+    /**
+     * Replaces named groups, "(?<name>...)", which std::regex doesn't
+     * support, with plain groups.
+     *
+     * @param fields Receives the names with the numbers of their groups.
+     */
+    static std::string stripNamedGroups(const std::string& regex,
+                                        std::vector<std::pair<std::string, size_t>>* fields) {
+
+        std::string stripped;
+        size_t groups = 0;
+
+        for (size_t i = 0; i < regex.size(); i++) {
+
+            char c = regex[i];
+
+            if (c == '\\' && i + 1u < regex.size()) {
+                stripped.append(regex, i, 2u);
+                i++;
+            }
+            else if (c == '[') {
+                size_t end = findClassEnd(regex, i);
+                stripped.append(regex, i, end + 1u - i);
+                i = end;
+            }
+            else if (c == '(' && regex.compare(i, 3u, "(?<") == 0
+                     && i + 3u < regex.size() && regex[i + 3u] != '=' && regex[i + 3u] != '!') {
+                size_t end = regex.find('>', i + 3u);
+                if (end == std::string::npos) {
+                    stripped.append(regex, i, std::string::npos);
+                    break;
+                }
+                fields->emplace_back(regex.substr(i + 3u, end - i - 3u), ++groups);
+                stripped.push_back('(');
+                i = end;
+            }
+            else {
+                if (c == '(' && regex.compare(i, 2u, "(?") != 0) {
+                    groups++;
+                }
+                stripped.push_back(c);
+            }
+        }
+
+        return stripped;
+    }
+
+    /**
+     * @return True if the regex is ".*literal.*", which matches exactly the
+     *         lines containing the literal, so no regex is needed.
+     */
+    static bool isLiteralPattern(const std::string& regex, const std::string& literal) {
+
+        static const std::string kAny = ".*";
+        if (literal.empty() || regex.size() <= 2u * kAny.size()
+            || regex.compare(0, kAny.size(), kAny) != 0
+            || regex.compare(regex.size() - kAny.size(), kAny.size(), kAny) != 0) {
+            return false;
+        }
+
+        std::string unescaped;
+        for (size_t i = kAny.size(); i < regex.size() - kAny.size(); i++) {
+            char c = regex[i];
+            if (c == '\\' && i + 1u < regex.size() - kAny.size()
+                && std::ispunct(static_cast<unsigned char>(regex[i + 1u]))) {
+                unescaped.push_back(regex[++i]);
+            }
+            else if (std::strchr("\\^$.*+?()[]{}|", c) != nullptr) {
+                return false;
+            }
+            else {
+                unescaped.push_back(c);
+            }
+        }
+        return unescaped == literal;
+    }
+
+    /**
+     * Detects a repeated group whose body can be split between the
+     * repetitions in many ways, like "(a+)+" or "(.*,)*", on which a
+     * backtracking matcher takes exponential time when a line almost
+     * matches. That is, the group contains a repeated atom, and all other
+     * atoms it requires can match the same characters. Groups like
+     * "(\d+\.)+" are unambiguous and are left to the time budget.
+     */
+    static bool isBacktrackProne(const std::string& regex) {
+        size_t i = 0u;
+        bool prone = false;
+        while (i < regex.size()) {
+            parseAtoms(regex, &i, &prone);
+            // Unbalanced ")"
+            i++;
+        }
+        return prone;
+    }
+
+    /**
+     * Enables caching of the automaton in the directory.
+     */
+    void setCacheDirectory(const std::string& directory) {
+        _cacheDirectory = directory;
+        _prepared = false;
+    }
+
+    const Filter& add(int src, const std::string& name, const std::string& pattern) {
+        Filter filter{src, name};
+        filter.pattern = stripNamedGroups(pattern, &filter.fields);
+        filter.literal = requiredLiteral(filter.pattern);
+        filter.literalOnly = isLiteralPattern(filter.pattern, filter.literal);
+        if (isBacktrackProne(filter.pattern)) {
+            LOG("Filter " << name << " is prone to backtracking, limited to short lines");
+            filter.maxLength = kProneMaxLength;
+            filter.warning = "backtracking";
+        }
+        _filters.emplace_back(std::move(filter));
+        _prepared = false;
+        return _filters.back();
+    }
+
+    bool setCommand(const std::string& name, const std::string& command, bool coprocess = false) {
+        for (auto& filter : _filters) {
+            if (filter.name == name) {
+                filter.command = command;
+                filter.coprocess = coprocess;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @param captures Receives the groups, if the matching filter has fields.
+     * @return First filter fully matching the text, or nullptr.
+     */
+    const Filter* match(std::string_view text, Captures* captures = nullptr) {
+
+        if (_filters.empty()) {
+            return nullptr;
+        }
+
+        if (!_prepared) {
+            prepare();
+        }
+
+        text = flatten(text);
+
+        // Mark filters whose literal occurs, using a new generation per line.
+        if (++_generation == 0u) {
+            std::fill(_candidates.begin(), _candidates.end(), 0u);
+            _generation = 1u;
+        }
+        _automaton.scan(text, [this](uint32_t literal) {
+            _candidates[_literalFilters[literal]] = _generation;
+        });
+
+        for (size_t i = 0; i < _filters.size(); i++) {
+            auto& filter = _filters[i];
+            if (!filter.literal.empty() && _candidates[i] != _generation) {
+                continue;
+            }
+            if (profile(&filter, text, captures)) {
+                return &filter;
+            }
+        }
+
+        return nullptr;
+    }
+
+    //! @return Index of the first filter fully matching the text, or -1.
+    int classify(std::string_view text) {
+        auto filter = match(text);
+        return filter != nullptr ? filter - _filters.data() : -1;
+    }
+
+    /**
+     * Takes the filter a fork classified the line with, matching the line
+     * again only to capture the fields.
+     *
+     * @return The filter, or nullptr for -1.
+     */
+    const Filter* matchClassified(int index, std::string_view text, Captures* captures = nullptr) {
+
+        if (index < 0 || static_cast<size_t>(index) >= _filters.size()) {
+            return nullptr;
+        }
+        auto& filter = _filters[index];
+        if (captures != nullptr && !filter.fields.empty() && compile(&filter)) {
+            matches(&filter, flatten(text), captures);
+        }
+        return &filter;
+    }
+
+    /**
+     * Copies the filters with their restrictions, but without statistics,
+     * to classify lines on another thread.
+     */
+    std::unique_ptr<FilterSet> fork() {
+
+        // Forks map the automaton cached by this one.
+        if (!_prepared && !_filters.empty()) {
+            prepare();
+        }
+
+        auto copy = std::make_unique<FilterSet>();
+        copy->_cacheDirectory = _cacheDirectory;
+        copy->_lineBudget = _lineBudget;
+        for (const auto& filter : _filters) {
+            Filter forked{filter.src, filter.name, filter.pattern};
+            forked.literal = filter.literal;
+            forked.literalOnly = filter.literalOnly;
+            forked.fields = filter.fields;
+            forked.invalid = filter.invalid;
+            forked.maxLength = filter.maxLength;
+            forked.warning = filter.warning;
+            copy->_filters.emplace_back(std::move(forked));
+        }
+        return copy;
+    }
+
+    /**
+     * Adds the statistics gathered by the fork, clearing them there, and
+     * shares the restrictions either of them imposed on a filter.
+     */
+    void merge(FilterSet* fork) {
+
+        for (size_t i = 0; i < _filters.size() && i < fork->_filters.size(); i++) {
+
+            auto& filter = _filters[i];
+            auto& forked = fork->_filters[i];
+
+            filter.tried += forked.tried;
+            filter.matched += forked.matched;
+            filter.skipped += forked.skipped;
+            filter.time += forked.time;
+            filter.maxTime = std::max(filter.maxTime, forked.maxTime);
+            filter.strikes += forked.strikes;
+            forked.tried = forked.matched = forked.skipped = forked.strikes = 0u;
+            forked.time = forked.maxTime = std::chrono::nanoseconds(0);
+
+            filter.maxLength = std::min(filter.maxLength, forked.maxLength);
+            if (forked.invalid && !filter.invalid) {
+                filter.invalid = true;
+                filter.warning = forked.warning;
+            }
+            else if (filter.warning.empty()) {
+                filter.warning = forked.warning;
+            }
+            if (filter.strikes >= kMaxStrikes && !filter.invalid) {
+                LOG("Filter " << filter.name << " disabled, too slow");
+                filter.invalid = true;
+                filter.warning = "disabled";
+            }
+
+            forked.maxLength = filter.maxLength;
+            forked.invalid = filter.invalid;
+            forked.warning = filter.warning;
+        }
+    }
+
+    //! @return True if the automaton was mapped from the cache.
+    bool isCached() const {
+        return _cached;
+    }
+
+    size_t size() const {
+        return _filters.size();
+    }
+
+    const std::vector<Filter>& getFilters() const {
+        return _filters;
+    }
+
+    /**
+     * Sets the time a regex may take on a line before it is demoted.
+     */
+    void setLineBudget(std::chrono::nanoseconds budget) {
+        _lineBudget = budget;
+    }
+
+private:
+
+    static constexpr std::chrono::milliseconds kDefaultLineBudget{10};
+    //! Lines over the budget after which the filter is disabled.
+    static constexpr size_t kMaxStrikes = 3u;
+    //! Longest line a regex prone to backtracking is tried on; the budget
+    //! is only checked once the match returns, and exponential backtracking
+    //! must stay within a few milliseconds on any line this long.
+    static constexpr size_t kProneMaxLength = 16u;
+
+    static uint64_t hash(const std::vector<std::string>& literals) {
+        // FNV-1a, with the lengths separating the literals.
+        uint64_t value = 14695981039346656037ull;
+        auto add = [&value] (const void* data, size_t size) {
+            auto bytes = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < size; i++) {
+                value = (value ^ bytes[i]) * 1099511628211ull;
+            }
+        };
+        uint32_t version = LiteralAutomaton::kVersion;
+        add(&version, sizeof(version));
+        for (const auto& literal : literals) {
+            uint64_t size = literal.size();
+            add(&size, sizeof(size));
+            add(literal.data(), literal.size());
+        }
+        return value;
+    }
+
+    static bool makeDirectories(const std::string& path) {
+        for (size_t separator = path.find('/', 1u); ; separator = path.find('/', separator + 1u)) {
+            auto parent = path.substr(0, separator);
+            if (::mkdir(parent.c_str(), 0755) != 0 && errno != EEXIST) {
+                return false;
+            }
+            if (separator == std::string::npos) {
+                return true;
+            }
+        }
+    }
+
+    void prepare() {
+
+        std::vector<std::string> literals;
+        _literalFilters.clear();
+        for (size_t i = 0; i < _filters.size(); i++) {
+            if (!_filters[i].literal.empty()) {
+                literals.emplace_back(_filters[i].literal);
+                _literalFilters.push_back(i);
+            }
+        }
+
+        _candidates.assign(_filters.size(), 0u);
+        _generation = 0u;
+        _prepared = true;
+        _cached = false;
+
+        uint64_t key = hash(literals);
+        char name[32];
+        std::snprintf(name, sizeof(name), "/%016llx.ac", static_cast<unsigned long long>(key));
+        std::string filename = _cacheDirectory + name;
+
+        if (!_cacheDirectory.empty() && _automaton.load(filename, key, literals.size())) {
+            LOG("Loaded " << filename);
+            _cached = true;
+            return;
+        }
+
+        _automaton.build(literals);
+        LOG("Built automaton of " << _automaton.getStateCnt() << " states");
+
+        if (!_cacheDirectory.empty()
+            && (!makeDirectories(_cacheDirectory) || !_automaton.save(filename, key))) {
+            LOG("Failed to cache " << filename);
+        }
+    }
+
+    //! @return Index of the ']' closing the class opened at the index.
+    static size_t findClassEnd(const std::string& regex, size_t start) {
+        // A leading ']' is part of the class.
+        size_t end = start + 1u;
+        if (end < regex.size() && regex[end] == '^') {
+            end++;
+        }
+        if (end < regex.size() && regex[end] == ']') {
+            end++;
+        }
+        while (end < regex.size() && regex[end] != ']') {
+            end += regex[end] == '\\' ? 2u : 1u;
+        }
+        return end;
+    }
+
+    //! @return True if "*", "+" or "{n,}" starts at the index.
+    //! Atom of a regex with its quantifier, see isBacktrackProne().
+    struct Atom {
+        std::string pattern;
+        bool group{false};
+        //! Whether a group contains a repeated atom.
+        bool repeating{false};
+        bool alternative{false};
+        size_t min{1u};
+        bool unbounded{false};
+    };
+
+    /**
+     * Parses a sequence of atoms up to the end of the regex or of the
+     * enclosing group, setting prone if a group in it is ambiguous.
+     */
+    static std::vector<Atom> parseAtoms(const std::string& regex, size_t* i, bool* prone) {
+
+        std::vector<Atom> atoms;
+
+        while (*i < regex.size() && regex[*i] != ')') {
+
+            size_t start = *i;
+            char c = regex[*i];
+            Atom atom;
+            std::vector<Atom> body;
+
+            if (c == '(') {
+                (*i)++;
+                // Lookaheads match no characters
+                if (regex.compare(*i, 2u, "?=") == 0 || regex.compare(*i, 2u, "?!") == 0) {
+                    atom.min = 0u;
+                }
+                if (*i < regex.size() && regex[*i] == '?') {
+                    *i = std::min(*i + 2u, regex.size());
+                }
+                body = parseAtoms(regex, i, prone);
+                *i = std::min(*i + 1u, regex.size());
+                atom.group = true;
+                for (const auto& inner : body) {
+                    atom.repeating = atom.repeating || inner.unbounded || inner.repeating;
+                }
+            }
+            else if (c == '\\' && *i + 1u < regex.size()) {
+                *i += getEscapeLength(regex, *i);
+                // Assertions match no characters
+                atom.min = regex[start + 1u] == 'b' || regex[start + 1u] == 'B' ? 0u : 1u;
+            }
+            else if (c == '[') {
+                *i = findClassEnd(regex, *i) + 1u;
+            }
+            else {
+                (*i)++;
+                atom.alternative = c == '|';
+                atom.min = c == '^' || c == '$' || c == '|' ? 0u : 1u;
+            }
+
+            atom.pattern = regex.substr(start, *i - start);
+            parseQuantifier(regex, i, &atom);
+            if (atom.group && atom.unbounded && isAmbiguous(body)) {
+                *prone = true;
+            }
+            atoms.emplace_back(std::move(atom));
+        }
+
+        return atoms;
+    }
+
+    static void parseQuantifier(const std::string& regex, size_t* i, Atom* atom) {
+
+        if (*i >= regex.size()) {
+            return;
+        }
+
+        char c = regex[*i];
+        if (c == '*' || c == '+' || c == '?') {
+            atom->min = c == '+' ? atom->min : 0u;
+            atom->unbounded = c != '?';
+            (*i)++;
+        }
+        else if (c == '{') {
+            size_t end = regex.find('}', *i);
+            if (end == std::string::npos) {
+                return;
+            }
+            atom->min = std::min<size_t>(atom->min, std::strtoul(regex.c_str() + *i + 1u, nullptr, 10));
+            atom->unbounded = regex[end - 1u] == ',';
+            *i = end + 1u;
+        }
+        else {
+            return;
+        }
+
+        // Lazy quantifier
+        if (*i < regex.size() && regex[*i] == '?') {
+            (*i)++;
+        }
+    }
+
+    /**
+     * @return Whether a repeated atom of the group's body can match all
+     *         the other atoms the body requires, so that repetitions of
+     *         the group can split the same text in many ways.
+     */
+    static bool isAmbiguous(const std::vector<Atom>& body) {
+
+        for (const auto& atom : body) {
+            if (atom.alternative) {
+                return false;
+            }
+        }
+
+        for (const auto& repeated : body) {
+            if (!repeated.unbounded && !repeated.repeating) {
+                continue;
+            }
+            bool ambiguous = true;
+            for (const auto& other : body) {
+                if (&other != &repeated && other.min > 0u && !canOverlap(repeated, other)) {
+                    ambiguous = false;
+                    break;
+                }
+            }
+            if (ambiguous) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    //! @return Whether both atoms may match the same character.
+    static bool canOverlap(const Atom& first, const Atom& second) {
+
+        // Groups are only known to overlap with any character
+        if (first.group || second.group) {
+            return first.pattern == "." || second.pattern == ".";
+        }
+
+        try {
+            std::regex firstRegex(first.pattern);
+            std::regex secondRegex(second.pattern);
+            for (int c = 1; c < 128; c++) {
+                std::string text(1u, static_cast<char>(c));
+                if (std::regex_match(text, firstRegex) && std::regex_match(text, secondRegex)) {
+                    return true;
+                }
+            }
+        }
+        catch (const std::regex_error&) {
+            // Invalid filters fail once compiled.
+        }
+        return false;
+    }
+
+    /**
+     * "." doesn't match a newline, so the lines of a record are matched as
+     * one line, with the newlines replaced by spaces.
+     *
+     * @return The text, or its copy valid until the next call.
+     */
+    std::string_view flatten(std::string_view text) {
+        if (text.find('\n') == std::string_view::npos) {
+            return text;
+        }
+        _flattened.assign(text);
+        std::replace(_flattened.begin(), _flattened.end(), '\n', ' ');
+        return _flattened;
+    }
+
+    /**
+     * Matches the line, measuring the time the regex takes. The steady
+     * clock is read without a system call, unlike the thread's CPU time,
+     * at the cost of charging a filter for the time its thread was
+     * preempted while matching.
+     */
+    bool profile(Filter* filter, std::string_view text, Captures* captures) {
+
+        // The automaton found the literal, which "." matches around unless
+        // the line has a carriage return.
+        bool literal = filter->literalOnly && text.find('\r') == std::string_view::npos;
+
+        if (filter->invalid || (!literal && !compile(filter))) {
+            return false;
+        }
+
+        if (text.size() > filter->maxLength) {
+            filter->skipped++;
+            return false;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bool matched = literal || matches(filter, text, captures);
+        auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+        filter->tried++;
+        filter->matched += matched;
+        filter->time += time;
+        filter->maxTime = std::max(filter->maxTime, time);
+
+        if (time > _lineBudget) {
+            demote(filter, text.size());
+        }
+        return matched;
+    }
+
+    static bool compile(Filter* filter) {
+
+        if (filter->regex) {
+            return true;
+        }
+
+        try {
+            filter->regex = std::make_unique<std::regex>(filter->pattern);
+        }
+        catch (const std::regex_error& e) {
+            LOG("Invalid filter " << filter->name << ": " << e.what());
+            filter->invalid = true;
+            filter->warning = "invalid";
+            return false;
+        }
+        return true;
+    }
+
+    static bool matches(Filter* filter, std::string_view text, Captures* captures) {
+
+        // Matching fails with an exception when it runs out of resources
+        try {
+            if (captures != nullptr && !filter->fields.empty()) {
+                return std::regex_match(text.begin(), text.end(), *captures, *filter->regex);
+            }
+            return std::regex_match(text.begin(), text.end(), *filter->regex);
+        }
+        catch (const std::regex_error& e) {
+            LOG("Filter " << filter->name << " failed: " << e.what());
+            filter->invalid = true;
+            filter->warning = "failed";
+            return false;
+        }
+    }
+
+    static void demote(Filter* filter, size_t length) {
+
+        if (++filter->strikes >= kMaxStrikes) {
+            LOG("Filter " << filter->name << " disabled, too slow");
+            filter->invalid = true;
+            filter->warning = "disabled";
+            return;
+        }
+
+        filter->maxLength = std::min(filter->maxLength, length / 2u);
+        filter->warning = "slow";
+        LOG("Filter " << filter->name << " limited to " << filter->maxLength << " bytes");
+    }
+
+    std::vector<Filter> _filters;
+    std::string _cacheDirectory;
+    LiteralAutomaton _automaton;
+    //! Filter index of each literal in the automaton.
+    std::vector<size_t> _literalFilters;
+    //! Generation of the last line each filter was a candidate for.
+    std::vector<uint32_t> _candidates;
+    uint32_t _generation{0u};
+    bool _prepared{false};
+    bool _cached{false};
+    std::string _flattened;
+    std::chrono::nanoseconds _lineBudget{kDefaultLineBudget};
+};
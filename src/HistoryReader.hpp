@@ -0,0 +1,196 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "LineSplitter.hpp"
+#include "Log.hpp"
+#include "Reactor.hpp"
+
+/**
+ * Reads a regular file opened at its end backwards, for its history.
+ *
+ * The start of the last lines is found by scanning blocks from the end of
+ * the file. Each load then reads the block of whole lines preceding the
+ * part read so far, on the shared reactor, and hands its lines over in
+ * file order.
+ */
+class HistoryReader {
+
+public:
+
+    using OnLines = std::function<void(const std::vector<std::string_view>&)>;
+    //! Receives the bytes read so far, from the tail on, and the total.
+    using OnProgress = std::function<void(size_t read, size_t total)>;
+
+    HistoryReader(Reactor& reactor, const std::string& filename, OnLines onLines, OnProgress onProgress)
+        : _reactor(reactor)
+        , _filename(filename)
+        , _onLines(onLines)
+        , _onProgress(onProgress) {
+
+        _fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat status;
+        if (_fd < 0 || ::fstat(_fd, &status) != 0 || !S_ISREG(status.st_mode)) {
+            LOG("Failed to open " << filename << " at its end");
+            close();
+            return;
+        }
+        _size = status.st_size;
+        _start = _size;
+    }
+
+    ~HistoryReader() {
+        stop();
+        // Barrier for a load posted before the reader was stopped.
+        _reactor.call([](){});
+    }
+
+    bool isOpen() const {
+        return _fd >= 0;
+    }
+
+    /**
+     * Finds where the last lines of the file start, from which on the file
+     * is read forward, and before which the history ends.
+     *
+     * @return Offset of the first of the lines.
+     */
+    size_t seekTail(size_t lines) {
+
+        std::vector<char> block(kBlockSize);
+        size_t end = _size;
+        size_t cnt = 0u;
+
+        while (end > 0u && _fd >= 0) {
+            size_t begin = end > kBlockSize ? end - kBlockSize : 0u;
+            if (!readAll(block.data(), begin, end - begin)) {
+                break;
+            }
+            for (size_t i = end - begin; i > 0u; i--) {
+                // A newline ending the file doesn't start a line.
+                if (block[i - 1u] != '\n' || begin + i == _size) {
+                    continue;
+                }
+                if (++cnt == lines) {
+                    _start = begin + i;
+                    return _start;
+                }
+            }
+            end = begin;
+        }
+
+        _start = 0u;
+        return _start;
+    }
+
+    /**
+     * Reads the block of lines preceding those read so far.
+     */
+    void load() {
+        if (_loadScheduled.exchange(true)) {
+            return;
+        }
+        _reactor.post([this] () {
+            _loadScheduled = false;
+            readBlock();
+        });
+    }
+
+    /**
+     * Stops reading, no callbacks are made once this returns.
+     */
+    void stop() {
+        _reactor.call([this] () { close(); });
+    }
+
+private:
+
+    static constexpr size_t kBlockSize = 1024u * 1024u;
+
+    void close() {
+        if (_fd >= 0) {
+            ::close(_fd);
+            _fd = -1;
+        }
+    }
+
+    bool readAll(char* data, size_t offset, size_t size) {
+        while (size > 0u) {
+            ssize_t cnt = ::pread(_fd, data, size, offset);
+            if (cnt <= 0) {
+                LOG("Failed to read " << _filename);
+                return false;
+            }
+            data += cnt;
+            offset += cnt;
+            size -= cnt;
+        }
+        return true;
+    }
+
+    void readBlock() {
+
+        if (_fd < 0 || _start == 0u) {
+            return;
+        }
+
+        // The block starts after a newline, growing until it contains one.
+        std::vector<char> block;
+        size_t begin = _start;
+        size_t first = 0u;
+        for (size_t size = kBlockSize; ; size *= 2u) {
+            begin = _start > size ? _start - size : 0u;
+            block.resize(_start - begin);
+            if (!readAll(block.data(), begin, block.size())) {
+                return;
+            }
+            if (begin == 0u) {
+                break;
+            }
+            auto newline = static_cast<const char*>(std::memchr(block.data(), '\n', block.size()));
+            if (newline != nullptr) {
+                first = newline - block.data() + 1u;
+                break;
+            }
+        }
+
+        std::vector<std::string_view> lines;
+        const char* start = block.data() + first;
+        LineSplitter::forEachNewline(start, block.data() + block.size(), [&](const char* newline) {
+            if (newline != start) {
+                lines.emplace_back(start, newline - start);
+            }
+            start = newline + 1;
+        });
+
+        _start = begin + first;
+        LOG("Loaded " << lines.size() << " older lines of " << _filename);
+
+        if (!lines.empty()) {
+            _onLines(lines);
+        }
+        if (_onProgress) {
+            _onProgress(_size - _start, _size);
+        }
+    }
+
+    Reactor&                        _reactor;
+    std::string                     _filename;
+    OnLines                         _onLines;
+    OnProgress                      _onProgress;
+    int                             _fd{-1};
+    size_t                          _size{0u};
+    //! Offset of the oldest line read so far.
+    size_t                          _start{0u};
+    std::atomic<bool>               _loadScheduled{false};
+};
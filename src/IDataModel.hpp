@@ -4,8 +4,8 @@
 #include <chrono>
 #include <functional>
 #include <vector>
-#include <regex>
 #include <string>
+#include <string_view>
 #include <limits>
 #include <map>
 
@@ -18,17 +18,66 @@ struct Tab {
     bool enabled;
     size_t rowsCnt{0};
     bool valid{false};
+    //! Lines dropped by the input's full queue.
+    size_t dropped{0};
+    //! Lines left out by sampling.
+    size_t sampled{0};
+    //! Why the tab's filter is restricted or disabled, if it is.
+    std::string warning;
+    //! Share of the input indexed so far, in percent.
+    uint8_t indexed{100};
 
     operator bool() {
         return valid;
     }
 };
 
-struct Filter {
-    int src;
+struct TemplateInfo {
+    std::string text;
+    size_t count{0};
+};
+
+//! Aggregates of a field captured by a filter.
+struct FieldInfo {
     std::string name;
-    std::regex regex;
-    std::string command;
+    uint8_t tab{0};
+    bool numeric{false};
+    size_t count{0};
+    //! Values of a numeric field which failed to parse.
+    size_t invalid{0};
+    double sum{0.0};
+    double min{0.0};
+    double max{0.0};
+    double p50{0.0};
+    double p99{0.0};
+    //! Most frequent values of a text field, with their counts.
+    std::vector<std::pair<std::string, size_t>> top;
+};
+
+//! Cost of a filter's regex.
+struct FilterInfo {
+    std::string name;
+    uint8_t tab{0};
+    size_t tried{0};
+    size_t matched{0};
+    size_t skipped{0};
+    double averageUs{0.0};
+    double maxUs{0.0};
+    std::string warning;
+    //! Whether the filter drops the lines it matches, see addDropFilter().
+    bool drop{false};
+};
+
+//! Lines sharing a correlation key with the line at the top.
+struct RelatedInfo {
+    //! Name of the key, empty if the line has none.
+    std::string name;
+    std::string key;
+    //! Position of the line among the related lines, and their count.
+    size_t position{0};
+    size_t count{0};
+    //! The first related lines, if requested.
+    std::vector<LogLine> lines;
 };
 
 class IDataModel {
@@ -39,16 +88,64 @@ public:
 
     virtual bool scrollDown() = 0;
 
+    /**
+     * Scrolls so the visible line at the given position is at the top.
+     */
+    virtual bool scrollTo(size_t position) = 0;
+
+    //! @return Position of the top line among the visible lines.
+    virtual size_t getPosition() = 0;
+
+    //! @return Number of lines in the enabled tabs.
+    virtual size_t getVisibleCnt() = 0;
+
     virtual void prepareLines() = 0;
 
     virtual LogLine nextLine() = 0;
 
+    virtual bool exportVisible(const std::string& filename, size_t* exported) = 0;
+
+    //! @return Full text of the line, which may be longer than its LogLine::text.
+    virtual std::string getText(size_t lineId) = 0;
+
+    /**
+     * Asks the inputs opened at their end for older lines, which arrive
+     * later and are shown before all the others.
+     */
+    virtual void loadHistory() = 0;
+
+    /**
+     * Scrolls to the next line sharing a key with the line at the top,
+     * wrapping around after the last one.
+     */
+    virtual RelatedInfo scrollToRelated(bool backwards = false) = 0;
+
+    //! @return Lines sharing a key with the line at the top, up to cnt.
+    virtual RelatedInfo getRelated(size_t cnt) = 0;
+
+    /**
+     * Searches all lines for the regex in the background, adding a tab
+     * which shows only the matching lines. An empty regex stops the search.
+     *
+     * @return False if the regex is invalid.
+     */
+    virtual bool startQuery(const std::string& regex) = 0;
+
     virtual void toggleTab(uint8_t src) = 0;
 
     virtual Tab getTab(uint8_t src) = 0;
 
     virtual uint8_t getTabCnt() = 0;
 
+    //! @return Message templates of all lines, most frequent first.
+    virtual std::vector<TemplateInfo> getTemplates() = 0;
+
+    //! @return Aggregates of the fields captured by the filters.
+    virtual std::vector<FieldInfo> getFields() = 0;
+
+    //! @return Costs of the filters, in the order they are tried.
+    virtual std::vector<FilterInfo> getFilters() = 0;
+
     virtual void registerOnNewDataAvailableListener(
         std::function<void()> listener) = 0;
 
@@ -56,11 +153,31 @@ public:
         const std::string& name, const std::string& regex) = 0;
 
     virtual bool addExternal(
-        const std::string& name, const std::string& command) = 0;
+        const std::string& name, const std::string& command, bool coprocess = false) = 0;
+
+    /**
+     * Adds a tab for an input.
+     *
+     * @return Source of the input's lines.
+     */
+    virtual uint8_t addSource(const std::string& name) = 0;
+
+    //! Counts lines of the source dropped before reaching the model.
+    virtual void addDropped(uint8_t src, size_t cnt) = 0;
+
+    /**
+     * Keeps only every n-th line of the tab with the given name.
+     */
+    virtual void setSampling(const std::string& name, size_t every) = 0;
 
     virtual std::function<void(std::string)> getAppender(
         std::string name) = 0;
 
+    virtual std::function<void(const std::vector<std::string_view>&)> getBatchAppender(
+        std::string name) = 0;
+
     virtual void addLine(const std::string& text, uint8_t src) = 0;
+
+    virtual void addLines(const std::vector<std::string_view>& lines, uint8_t src) = 0;
 };
 
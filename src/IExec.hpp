@@ -1,8 +1,19 @@
 #pragma once
 
+#include <functional>
 #include <string>
 
 struct IExec {
+
+    using OnResult = std::function<void(std::string result)>;
+
     virtual std::string exec(const std::string& cmd, const std::string& line) = 0;
-};
 
+    /**
+     * Passes the line to a co-process of the command, started once, and
+     * the result to the callback once it is available.
+     */
+    virtual void execAsync(const std::string& cmd, const std::string& line, OnResult onResult) {
+        onResult(exec(cmd, line));
+    }
+};
@@ -0,0 +1,362 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "Log.hpp"
+
+/**
+ * Bounded queue of lines between an input and the data model.
+ *
+ * The input only copies its lines into the queue, while a worker shared
+ * by all queues hands them to the data model in batches. When the input
+ * produces lines faster than they are processed and the queue is full,
+ * the policy either pushes back on the input, or drops the lines and
+ * reports how many were dropped.
+ *
+ * Pushing back never blocks the push itself, as inputs on the reactor
+ * share its thread: the input asks throttle() after a batch and stops
+ * reading until the queue has space again, and inputs with a thread of
+ * their own wait for it with waitForSpace(). A full queue thus holds up
+ * to a batch more than its capacity.
+ *
+ * The worker reports when no lines followed a batch for a while, and
+ * before the input finishes, e.g. to pass on lines held back.
+ */
+class IngestQueue {
+
+    //! Lines stored back to back, with the offset where each ends.
+    struct Lines {
+        std::string data;
+        std::vector<size_t> ends;
+    };
+
+public:
+
+    using OnLines = std::function<void(const std::vector<std::string_view>&)>;
+    using OnDropped = std::function<void(size_t cnt)>;
+    using OnIdle = std::function<void()>;
+    using OnSpace = std::function<void()>;
+
+    enum class Policy { Block, Drop };
+
+    static constexpr size_t kDefaultCapacity = 64u * 1024u;
+    static constexpr std::chrono::milliseconds kIdleTime{100};
+
+    /**
+     * Thread serving all queues, one batch at a time in the order they
+     * became ready. The data model takes the batches one at a time anyway,
+     * so a thread per input would only contend for it.
+     */
+    class Worker {
+
+    public:
+
+        Worker() {
+            _thread = std::thread([this] () { run(); });
+        }
+
+        ~Worker() {
+            stop();
+        }
+
+        /**
+         * Stops the worker, lines still queued are discarded.
+         */
+        void stop() {
+            {
+                std::lock_guard<std::mutex> g(_mtx);
+                _stopped = true;
+            }
+            _hasWork.notify_all();
+            _hasSpace.notify_all();
+            if (_thread.joinable()) {
+                _thread.join();
+            }
+        }
+
+    private:
+
+        friend class IngestQueue;
+
+        using Clock = std::chrono::steady_clock;
+
+        //! Called with the lock held.
+        void schedule(IngestQueue* queue) {
+            if (!queue->_scheduled) {
+                queue->_scheduled = true;
+                _ready.push_back(queue);
+                _hasWork.notify_one();
+            }
+        }
+
+        void run() {
+
+            std::unique_lock<std::mutex> lock(_mtx);
+            while (!_stopped) {
+
+                if (_ready.empty()) {
+                    auto deadline = Clock::time_point::max();
+                    for (auto queue : _queues) {
+                        deadline = std::min(deadline, queue->_idleAt);
+                    }
+                    if (deadline == Clock::time_point::max()) {
+                        _hasWork.wait(lock);
+                    }
+                    else if (_hasWork.wait_until(lock, deadline) == std::cv_status::timeout) {
+                        reportIdle(lock);
+                    }
+                    continue;
+                }
+
+                auto queue = _ready.front();
+                _ready.pop_front();
+                queue->_scheduled = false;
+                drain(queue, lock);
+            }
+        }
+
+        //! Hands the queue's lines over, or reports that it finished.
+        void drain(IngestQueue* queue, std::unique_lock<std::mutex>& lock) {
+
+            std::swap(_lines, queue->_pending);
+            std::function<void()> onFinished;
+            if (_lines.ends.empty()) {
+                onFinished.swap(queue->_onFinished);
+            }
+            OnSpace onSpace;
+            onSpace.swap(queue->_onSpace);
+            queue->_idleAt = Clock::time_point::max();
+
+            _busy = queue;
+            lock.unlock();
+            _hasSpace.notify_all();
+
+            if (onSpace) {
+                onSpace();
+            }
+
+            if (onFinished) {
+                if (queue->_onIdle) {
+                    queue->_onIdle();
+                }
+                onFinished();
+            }
+            else if (!_lines.ends.empty()) {
+                _batch.clear();
+                size_t start = 0u;
+                for (size_t end : _lines.ends) {
+                    _batch.emplace_back(_lines.data.data() + start, end - start);
+                    start = end;
+                }
+                queue->_onLines(_batch);
+            }
+
+            _lines.data.clear();
+            _lines.ends.clear();
+
+            lock.lock();
+            _busy = nullptr;
+            _done.notify_all();
+
+            if (queue->_stopped) {
+                return;
+            }
+            if (!onFinished && queue->_onIdle) {
+                queue->_idleAt = Clock::now() + kIdleTime;
+            }
+            // Lines queued before it was finished went first
+            if (queue->_onFinished) {
+                schedule(queue);
+            }
+        }
+
+        void reportIdle(std::unique_lock<std::mutex>& lock) {
+
+            auto now = Clock::now();
+            for (size_t i = 0; i < _queues.size() && !_stopped; i++) {
+                auto queue = _queues[i];
+                if (queue->_idleAt > now) {
+                    continue;
+                }
+                queue->_idleAt = Clock::time_point::max();
+
+                _busy = queue;
+                lock.unlock();
+                queue->_onIdle();
+                lock.lock();
+                _busy = nullptr;
+                _done.notify_all();
+            }
+        }
+
+        std::mutex                      _mtx;
+        std::condition_variable         _hasWork;
+        std::condition_variable         _hasSpace;
+        //! Signalled once the worker is done with a queue.
+        std::condition_variable         _done;
+        std::vector<IngestQueue*>       _queues;
+        std::deque<IngestQueue*>        _ready;
+        IngestQueue*                    _busy{nullptr};
+        bool                            _stopped{false};
+        //! Lines of the queue being drained.
+        Lines                           _lines;
+        std::vector<std::string_view>   _batch;
+        std::thread                     _thread;
+    };
+
+    /**
+     * Parses "policy[:capacity]", where the policy is block or drop and
+     * the capacity is in lines.
+     */
+    static bool parsePolicy(const std::string& spec, Policy* policy, size_t* capacity) {
+        static const std::map<std::string, Policy> kPolicies = {
+            {"block", Policy::Block}, {"drop", Policy::Drop}};
+
+        size_t separator = spec.find(':');
+        auto it = kPolicies.find(spec.substr(0, separator));
+        if (it == kPolicies.end()) {
+            return false;
+        }
+        *policy = it->second;
+        *capacity = kDefaultCapacity;
+
+        if (separator != std::string::npos) {
+            char* end = nullptr;
+            *capacity = std::strtoul(spec.c_str() + separator + 1u, &end, 10);
+            if (*end != '\0' || *capacity == 0u) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    IngestQueue(Worker& worker, Policy policy, size_t capacity, OnLines onLines, OnDropped onDropped,
+                OnIdle onIdle = {})
+        : _worker(worker)
+        , _policy(policy)
+        , _capacity(capacity)
+        , _onLines(onLines)
+        , _onDropped(onDropped)
+        , _onIdle(onIdle) {
+        std::lock_guard<std::mutex> g(_worker._mtx);
+        _worker._queues.push_back(this);
+    }
+
+    ~IngestQueue() {
+        stop();
+    }
+
+    /**
+     * Queues copies of the lines, dropping them when full under the Drop
+     * policy.
+     */
+    void push(const std::vector<std::string_view>& lines) {
+
+        size_t dropped = 0u;
+        {
+            std::lock_guard<std::mutex> g(_worker._mtx);
+            if (_stopped || _worker._stopped) {
+                return;
+            }
+            for (const auto& line : lines) {
+                if (_policy == Policy::Drop && _pending.ends.size() >= _capacity) {
+                    dropped++;
+                    continue;
+                }
+                _pending.data.append(line);
+                _pending.ends.push_back(_pending.data.size());
+            }
+            _worker.schedule(this);
+        }
+
+        if (dropped > 0u) {
+            _onDropped(dropped);
+        }
+    }
+
+    /**
+     * Has an input on the reactor pause while the queue is full under the
+     * Block policy.
+     *
+     * @param onSpace Called by the worker once the queue has space again,
+     *                if true was returned.
+     * @return True if the input should stop reading until then.
+     */
+    bool throttle(OnSpace onSpace) {
+        std::lock_guard<std::mutex> g(_worker._mtx);
+        if (!isFull()) {
+            return false;
+        }
+        _onSpace = onSpace;
+        return true;
+    }
+
+    /**
+     * Blocks an input with a thread of its own while the queue is full
+     * under the Block policy.
+     */
+    void waitForSpace() {
+        std::unique_lock<std::mutex> lock(_worker._mtx);
+        _worker._hasSpace.wait(lock, [this] () { return !isFull(); });
+    }
+
+    /**
+     * Calls the callback once all queued lines were handed over.
+     */
+    void finish(std::function<void()> onFinished) {
+        std::lock_guard<std::mutex> g(_worker._mtx);
+        _onFinished = onFinished;
+        _worker.schedule(this);
+    }
+
+    /**
+     * Stops handing lines over, lines still queued are discarded.
+     */
+    void stop() {
+        std::unique_lock<std::mutex> lock(_worker._mtx);
+        if (_stopped) {
+            return;
+        }
+        _stopped = true;
+        auto& queues = _worker._queues;
+        queues.erase(std::remove(queues.begin(), queues.end(), this), queues.end());
+        auto& ready = _worker._ready;
+        ready.erase(std::remove(ready.begin(), ready.end(), this), ready.end());
+        _worker._done.wait(lock, [this] () { return _worker._busy != this; });
+        _worker._hasSpace.notify_all();
+    }
+
+private:
+
+    //! Called with the lock held.
+    bool isFull() const {
+        return _policy == Policy::Block && _pending.ends.size() >= _capacity
+            && !_stopped && !_worker._stopped;
+    }
+
+    Worker&                         _worker;
+    Policy                          _policy;
+    size_t                          _capacity;
+    OnLines                         _onLines;
+    OnDropped                       _onDropped;
+    OnIdle                          _onIdle;
+    // Guarded by the worker's mutex
+    Lines                           _pending;
+    std::function<void()>           _onFinished;
+    OnSpace                         _onSpace;
+    bool                            _scheduled{false};
+    bool                            _stopped{false};
+    //! When to report that no lines followed the last batch.
+    std::chrono::steady_clock::time_point _idleAt{std::chrono::steady_clock::time_point::max()};
+};
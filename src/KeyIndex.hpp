@@ -0,0 +1,209 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "FilterSet.hpp"
+#include "Log.hpp"
+
+/**
+ * Index of the lines sharing a correlation key, like a request or a trace
+ * id, across all inputs.
+ *
+ * Each key is extracted by searching a line for a regex, taking its first
+ * group, named or not, or else the whole match. Values are interned per
+ * key, and each value keeps the ids of its lines as a list of varint
+ * encoded deltas, which mostly take a byte or two per line.
+ *
+ * Ids must be added in ascending order, which they are as lines are only
+ * ever appended.
+ */
+class KeyIndex {
+
+public:
+
+    //! Key found in a line, by the index of its extractor.
+    using Found = std::pair<size_t, std::string>;
+
+    /**
+     * @return False if the regex is invalid.
+     */
+    bool addKey(const std::string& name, const std::string& regex) {
+
+        Extractor extractor{name};
+        std::vector<std::pair<std::string, size_t>> groups;
+        auto pattern = FilterSet::stripNamedGroups(regex, &groups);
+        extractor.literal = FilterSet::requiredLiteral(pattern);
+        extractor.prefix = !extractor.literal.empty()
+            && pattern.compare(0, extractor.literal.size(), extractor.literal) == 0;
+
+        try {
+            extractor.regex = std::make_unique<std::regex>(pattern);
+        }
+        catch (const std::regex_error& e) {
+            LOG("Invalid key " << name << ": " << e.what());
+            return false;
+        }
+        extractor.group = !groups.empty() ? groups.front().second
+                        : extractor.regex->mark_count() > 0u ? 1u : 0u;
+
+        _extractors.emplace_back(std::move(extractor));
+        return true;
+    }
+
+    bool empty() const {
+        return _extractors.empty();
+    }
+
+    const std::string& getName(size_t extractor) const {
+        return _extractors[extractor].name;
+    }
+
+    //! @return Number of distinct values of all keys.
+    size_t getValueCnt() const {
+        return _postings.size();
+    }
+
+    /**
+     * Indexes the line under the keys it contains.
+     */
+    void add(std::string_view text, size_t lineId) {
+        for (size_t i = 0; i < _extractors.size(); i++) {
+            std::string_view value;
+            if (extract(_extractors[i], text, &value)) {
+                append(&_postings[intern(i, value)], lineId);
+            }
+        }
+    }
+
+    //! @return Keys the text contains, in the order they were added.
+    std::vector<Found> find(std::string_view text) const {
+        std::vector<Found> found;
+        for (size_t i = 0; i < _extractors.size(); i++) {
+            std::string_view value;
+            if (extract(_extractors[i], text, &value)) {
+                found.emplace_back(i, std::string(value));
+            }
+        }
+        return found;
+    }
+
+    //! @return Ids of the lines with the key, in ascending order.
+    std::vector<size_t> getLines(size_t extractor, const std::string& value) const {
+
+        std::vector<size_t> lines;
+        if (extractor >= _extractors.size()) {
+            return lines;
+        }
+        const auto& values = _extractors[extractor].values;
+        auto it = values.find(value);
+        if (it == values.end()) {
+            return lines;
+        }
+
+        const auto& posting = _postings[it->second];
+        lines.reserve(posting.cnt);
+        size_t lineId = 0u;
+        for (size_t i = 0; i < posting.deltas.size(); ) {
+            uint64_t delta = 0u;
+            for (int shift = 0; ; shift += 7) {
+                uint8_t byte = posting.deltas[i++];
+                delta |= static_cast<uint64_t>(byte & 0x7fu) << shift;
+                if ((byte & 0x80u) == 0u) {
+                    break;
+                }
+            }
+            lineId += delta;
+            lines.push_back(lineId);
+        }
+        return lines;
+    }
+
+private:
+
+    struct Extractor {
+        std::string name;
+        //! Contained in every match, checked before running the regex.
+        std::string literal;
+        //! Whether every match starts with the literal.
+        bool prefix{false};
+        std::unique_ptr<std::regex> regex;
+        size_t group{0u};
+        //! Posting of each value of the key.
+        std::unordered_map<std::string, uint32_t> values;
+    };
+
+    struct Posting {
+        std::string deltas;
+        size_t last{0u};
+        size_t cnt{0u};
+    };
+
+    static bool extract(const Extractor& extractor, std::string_view text, std::string_view* value) {
+
+        size_t start = extractor.literal.empty() ? 0u : text.find(extractor.literal);
+        if (start == std::string_view::npos) {
+            return false;
+        }
+
+        std::match_results<std::string_view::const_iterator> match;
+        try {
+            bool found = false;
+            if (extractor.prefix) {
+                // A match starts at an occurrence of the literal
+                for (; start != std::string_view::npos && !found; start = text.find(extractor.literal, start + 1u)) {
+                    auto flags = std::regex_constants::match_continuous;
+                    if (start > 0u) {
+                        flags |= std::regex_constants::match_prev_avail;
+                    }
+                    found = std::regex_search(text.begin() + start, text.end(), match, *extractor.regex, flags);
+                }
+            }
+            else {
+                found = std::regex_search(text.begin(), text.end(), match, *extractor.regex);
+            }
+            if (!found || !match[extractor.group].matched || match[extractor.group].length() == 0) {
+                return false;
+            }
+        }
+        catch (const std::regex_error& e) {
+            LOG("Key " << extractor.name << " failed: " << e.what());
+            return false;
+        }
+
+        *value = text.substr(match[extractor.group].first - text.begin(), match[extractor.group].length());
+        return true;
+    }
+
+    uint32_t intern(size_t extractor, std::string_view value) {
+        auto& values = _extractors[extractor].values;
+        auto it = values.find(std::string(value));
+        if (it != values.end()) {
+            return it->second;
+        }
+        values.emplace(std::string(value), _postings.size());
+        _postings.emplace_back();
+        return _postings.size() - 1u;
+    }
+
+    static void append(Posting* posting, size_t lineId) {
+        uint64_t delta = lineId - posting->last;
+        do {
+            uint8_t byte = delta & 0x7fu;
+            delta >>= 7;
+            posting->deltas.push_back(static_cast<char>(delta > 0u ? byte | 0x80u : byte));
+        } while (delta > 0u);
+        posting->last = lineId;
+        posting->cnt++;
+    }
+
+    std::vector<Extractor> _extractors;
+    std::vector<Posting> _postings;
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Splits blocks of raw input into lines.
+ *
+ * Newlines are located with a vectorized comparison of 16 or 32 bytes at a
+ * time, depending on the instruction set the program is built for. Lines are
+ * returned as views, either into the block itself or, for a line continued
+ * from the previous block, into an internal buffer. No memory is allocated
+ * per line.
+ *
+ * Empty lines are skipped. Lines longer than the maximum length are split,
+ * so a missing newline can't make the buffer grow without bounds.
+ */
+class LineSplitter {
+
+public:
+
+    static constexpr size_t kDefaultMaxLineLength = 16u * 1024u * 1024u;
+
+    explicit LineSplitter(size_t maxLineLength = kDefaultMaxLineLength)
+        : _maxLineLength(maxLineLength) {}
+
+    /**
+     * Splits the block, keeping the incomplete last line for the next one.
+     *
+     * @return Complete lines, valid until the next call.
+     */
+    const std::vector<std::string_view>& split(const char* data, size_t size) {
+
+        _batch.clear();
+
+        const char* start = data;
+        bool joined = false;
+
+        forEachNewline(data, data + size, [&](const char* newline) {
+            if (!joined && !_pending.empty()) {
+                _joined.swap(_pending);
+                _pending.clear();
+                _joined.append(start, newline);
+                add(_joined);
+                joined = true;
+            }
+            else {
+                add(std::string_view(start, newline - start));
+            }
+            start = newline + 1;
+        });
+
+        _pending.append(start, data + size);
+
+        if (_pending.size() >= _maxLineLength) {
+            _overflow.swap(_pending);
+            _pending.clear();
+            add(_overflow);
+        }
+
+        return _batch;
+    }
+
+    /**
+     * @return The incomplete last line, if any, valid until the next call.
+     */
+    const std::vector<std::string_view>& flush() {
+        _batch.clear();
+        _joined.swap(_pending);
+        _pending.clear();
+        add(_joined);
+        return _batch;
+    }
+
+    /**
+     * Calls f with the position of every newline in [begin, end).
+     */
+    template <typename F>
+    static void forEachNewline(const char* begin, const char* end, F f) {
+
+        const char* ptr = begin;
+
+#if defined(__AVX2__)
+        const __m256i newlines = _mm256_set1_epi8('\n');
+        for (; ptr + 32 <= end; ptr += 32) {
+            __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+            uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newlines));
+            for (; mask != 0u; mask &= mask - 1u) {
+                f(ptr + __builtin_ctz(mask));
+            }
+        }
+#elif defined(__SSE2__)
+        const __m128i newlines = _mm_set1_epi8('\n');
+        for (; ptr + 16 <= end; ptr += 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+            uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newlines));
+            for (; mask != 0u; mask &= mask - 1u) {
+                f(ptr + __builtin_ctz(mask));
+            }
+        }
+#endif
+
+        // Tail, or the whole block without SIMD support.
+        while (ptr < end) {
+            auto newline = static_cast<const char*>(std::memchr(ptr, '\n', end - ptr));
+            if (newline == nullptr) {
+                return;
+            }
+            f(newline);
+            ptr = newline + 1;
+        }
+    }
+
+private:
+
+    void add(std::string_view line) {
+        if (!line.empty()) {
+            _batch.emplace_back(line);
+        }
+    }
+
+    size_t                          _maxLineLength;
+    //! Incomplete line carried over to the next block.
+    std::string                     _pending;
+    //! Carried over line completed by the current block.
+    std::string                     _joined;
+    //! Line split at the maximum length.
+    std::string                     _overflow;
+    std::vector<std::string_view>   _batch;
+};
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <zlib.h>
+
+#include "Log.hpp"
+
+/**
+ * Append-only store of line payloads, compressed in blocks.
+ *
+ * Payloads are collected in an open block until it reaches the block size,
+ * after which the block is sealed with deflate. The first sealed block serves
+ * as the preset dictionary of all the following ones, which keeps the ratio
+ * high despite the small blocks. Reads are served from a small LRU cache of
+ * decompressed blocks, so scrolling through a block inflates it only once.
+ *
+ * Block layout, before compression, is a table of cnt + 1 offsets followed
+ * by the concatenated payloads.
+ */
+class LineStore {
+
+    struct Block {
+        size_t firstId;
+        uint32_t cnt;
+        uint32_t rawSize;
+        std::string compressed;
+    };
+
+    struct CacheEntry {
+        size_t block;
+        size_t lastUse;
+        std::string raw;
+    };
+
+public:
+
+    /**
+     * Reader with its own decompressed block, for concurrent reads of the
+     * sealed blocks. Most efficient when ids are read in increasing order.
+     * The store must not be appended to while cursors are used.
+     */
+    class Cursor {
+
+    public:
+
+        explicit Cursor(const LineStore& store) : _store(store) {}
+
+        std::string_view get(size_t id) {
+
+            if (id >= _store._size) {
+                return {};
+            }
+
+            if (id >= _store.getOpenFirstId()) {
+                return _store.getOpen(id);
+            }
+
+            if (_block == kNoBlock || id < _store._blocks[_block].firstId
+                || id >= _store._blocks[_block].firstId + _store._blocks[_block].cnt) {
+                _block = _store.findBlock(id);
+                _raw = _store.decompress(_store._blocks[_block]);
+            }
+
+            const auto& block = _store._blocks[_block];
+            return extract(_raw, block.cnt, id - block.firstId);
+        }
+
+    private:
+
+        static constexpr size_t kNoBlock = SIZE_MAX;
+
+        const LineStore& _store;
+        size_t _block{kNoBlock};
+        std::string _raw;
+    };
+
+    static constexpr size_t kDefaultBlockSize = 64u * 1024u;
+    static constexpr size_t kDefaultCacheSize = 16u;
+
+    LineStore(size_t blockSize = kDefaultBlockSize, size_t cacheSize = kDefaultCacheSize)
+        : _blockSize(blockSize)
+        , _cacheSize(cacheSize) {}
+
+    /**
+     * @return Id of the payload, ids are assigned sequentially from 0.
+     */
+    size_t append(std::string_view payload) {
+
+        _openOffsets.push_back(_open.size());
+        _open.append(payload);
+        _size++;
+
+        if (_open.size() >= _blockSize) {
+            seal();
+        }
+
+        return _size - 1u;
+    }
+
+    std::string get(size_t id) {
+
+        if (id >= _size) {
+            return {};
+        }
+
+        if (id >= getOpenFirstId()) {
+            return std::string(getOpen(id));
+        }
+
+        size_t block = findBlock(id);
+        return std::string(extract(getCached(block), _blocks[block].cnt, id - _blocks[block].firstId));
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    //! @return Bytes held for the payloads, excluding the cache.
+    size_t getMemoryUsage() const {
+        size_t usage = _open.capacity() + _openOffsets.capacity() * sizeof(uint32_t) + _dictionary.capacity();
+        for (const auto& block : _blocks) {
+            usage += sizeof(Block) + block.compressed.capacity();
+        }
+        return usage;
+    }
+
+private:
+
+    static constexpr size_t kMaxDictionarySize = 32u * 1024u;
+    static constexpr int kWindowBits = -15; // Raw deflate
+
+    size_t getOpenFirstId() const {
+        return _size - _openOffsets.size();
+    }
+
+    std::string_view getOpen(size_t id) const {
+        size_t i = id - getOpenFirstId();
+        size_t end = i + 1u < _openOffsets.size() ? _openOffsets[i + 1u] : _open.size();
+        return std::string_view(_open).substr(_openOffsets[i], end - _openOffsets[i]);
+    }
+
+    void seal() {
+
+        uint32_t cnt = _openOffsets.size();
+        std::string raw((cnt + 1u) * sizeof(uint32_t), '\0');
+        _openOffsets.push_back(_open.size());
+        std::memcpy(&raw[0], _openOffsets.data(), raw.size());
+        raw.append(_open);
+
+        Block block{_size - cnt, cnt, static_cast<uint32_t>(raw.size()), compress(raw)};
+        LOG("Sealed block " << _blocks.size() << ": " << raw.size() << " -> " << block.compressed.size());
+        _blocks.emplace_back(std::move(block));
+
+        if (_dictionary.empty()) {
+            _dictionary = _open.substr(_open.size() - std::min(_open.size(), kMaxDictionarySize));
+        }
+
+        _open.clear();
+        _openOffsets.clear();
+    }
+
+    std::string compress(const std::string& raw) const {
+
+        z_stream stream{};
+        deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, kWindowBits, 8, Z_DEFAULT_STRATEGY);
+        if (!_dictionary.empty()) {
+            deflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(_dictionary.data()), _dictionary.size());
+        }
+
+        std::string compressed(deflateBound(&stream, raw.size()), '\0');
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(raw.data()));
+        stream.avail_in = raw.size();
+        stream.next_out = reinterpret_cast<Bytef*>(&compressed[0]);
+        stream.avail_out = compressed.size();
+        deflate(&stream, Z_FINISH);
+
+        compressed.resize(stream.total_out);
+        compressed.shrink_to_fit();
+        deflateEnd(&stream);
+        return compressed;
+    }
+
+    std::string decompress(const Block& block) const {
+
+        z_stream stream{};
+        inflateInit2(&stream, kWindowBits);
+        // The first block is compressed before the dictionary exists.
+        if (block.firstId > 0u) {
+            inflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(_dictionary.data()), _dictionary.size());
+        }
+
+        std::string raw(block.rawSize, '\0');
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(block.compressed.data()));
+        stream.avail_in = block.compressed.size();
+        stream.next_out = reinterpret_cast<Bytef*>(&raw[0]);
+        stream.avail_out = raw.size();
+
+        if (inflate(&stream, Z_FINISH) != Z_STREAM_END) {
+            LOG("Failed to inflate block starting at " << block.firstId);
+        }
+
+        inflateEnd(&stream);
+        return raw;
+    }
+
+    size_t findBlock(size_t id) const {
+        auto it = std::upper_bound(_blocks.begin(), _blocks.end(), id, [](size_t id, const Block& block) {
+            return id < block.firstId;
+        });
+        return std::distance(_blocks.begin(), it) - 1u;
+    }
+
+    const std::string& getCached(size_t block) {
+
+        _useCnt++;
+
+        auto lru = _cache.begin();
+        for (auto it = _cache.begin(); it != _cache.end(); it++) {
+            if (it->block == block) {
+                it->lastUse = _useCnt;
+                return it->raw;
+            }
+            if (it->lastUse < lru->lastUse) {
+                lru = it;
+            }
+        }
+
+        if (_cache.size() < _cacheSize) {
+            _cache.emplace_back(CacheEntry{block, _useCnt, decompress(_blocks[block])});
+            return _cache.back().raw;
+        }
+
+        *lru = CacheEntry{block, _useCnt, decompress(_blocks[block])};
+        return lru->raw;
+    }
+
+    static std::string_view extract(const std::string& raw, size_t cnt, size_t i) {
+        uint32_t offsets[2];
+        std::memcpy(offsets, raw.data() + i * sizeof(uint32_t), sizeof(offsets));
+        size_t payloads = (cnt + 1u) * sizeof(uint32_t);
+        return std::string_view(raw).substr(payloads + offsets[0], offsets[1] - offsets[0]);
+    }
+
+    size_t _blockSize;
+    size_t _cacheSize;
+    size_t _size{0u};
+    size_t _useCnt{0u};
+    std::string _open;
+    std::vector<uint32_t> _openOffsets;
+    std::string _dictionary;
+    std::vector<Block> _blocks;
+    std::vector<CacheEntry> _cache;
+};
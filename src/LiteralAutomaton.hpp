@@ -0,0 +1,295 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Log.hpp"
+
+/**
+ * Aho-Corasick automaton finding a set of literals in a single pass.
+ *
+ * The automaton is kept as a dense transition table with 256 entries per
+ * state and a flattened list of the literals ending in each state, so it
+ * can be written to a file as is and later mapped back into memory instead
+ * of being rebuilt.
+ *
+ * File layout: Header, transitions, output offsets (states + 1 entries),
+ * outputs. All entries are 32 bit. The header holds a checksum of the
+ * tables, so loading checks a file in one sequential pass instead of
+ * validating every transition.
+ */
+class LiteralAutomaton {
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint32_t states;
+        uint32_t outputs;
+        uint64_t checksum;
+    };
+
+public:
+
+    static constexpr uint32_t kMagic = 0x43414c4c; // "LLAC"
+    static constexpr uint32_t kVersion = 2;
+
+    LiteralAutomaton() = default;
+
+    LiteralAutomaton(const LiteralAutomaton&) = delete;
+    LiteralAutomaton& operator=(const LiteralAutomaton&) = delete;
+
+    ~LiteralAutomaton() {
+        unmap();
+    }
+
+    void build(const std::vector<std::string>& literals) {
+
+        unmap();
+        _ownTransitions.assign(kAlphabet, 0u);
+        std::vector<std::vector<uint32_t>> outputs(1);
+
+        // Trie, state 0 is the root
+        for (uint32_t id = 0; id < literals.size(); id++) {
+            uint32_t state = 0;
+            for (unsigned char c : literals[id]) {
+                uint32_t& next = _ownTransitions[state * kAlphabet + c];
+                if (next == 0u) {
+                    next = outputs.size();
+                    outputs.emplace_back();
+                    _ownTransitions.resize(_ownTransitions.size() + kAlphabet, 0u);
+                }
+                state = _ownTransitions[state * kAlphabet + c];
+            }
+            outputs[state].push_back(id);
+        }
+
+        // Breadth first, turn the trie into a DFA through failure links
+        std::vector<uint32_t> fail(outputs.size(), 0u);
+        std::queue<uint32_t> queue;
+        for (size_t c = 0; c < kAlphabet; c++) {
+            if (_ownTransitions[c] != 0u) {
+                queue.push(_ownTransitions[c]);
+            }
+        }
+
+        while (!queue.empty()) {
+            uint32_t state = queue.front();
+            queue.pop();
+
+            const auto& inherited = outputs[fail[state]];
+            outputs[state].insert(outputs[state].end(), inherited.begin(), inherited.end());
+
+            for (size_t c = 0; c < kAlphabet; c++) {
+                uint32_t& next = _ownTransitions[state * kAlphabet + c];
+                uint32_t fallback = _ownTransitions[fail[state] * kAlphabet + c];
+                if (next != 0u) {
+                    fail[next] = fallback;
+                    queue.push(next);
+                }
+                else {
+                    next = fallback;
+                }
+            }
+        }
+
+        _ownOffsets.assign(1, 0u);
+        _ownOutputs.clear();
+        for (const auto& output : outputs) {
+            _ownOutputs.insert(_ownOutputs.end(), output.begin(), output.end());
+            _ownOffsets.push_back(_ownOutputs.size());
+        }
+
+        _states = outputs.size();
+        _transitions = _ownTransitions.data();
+        _offsets = _ownOffsets.data();
+        _outputs = _ownOutputs.data();
+    }
+
+    /**
+     * Writes the automaton to a file, tagged with the key.
+     */
+    bool save(const std::string& filename, uint64_t key) const {
+
+        // Written to a file of its own and renamed, so readers never see a
+        // partial file, even with several processes saving at once.
+        std::string temporary = filename + ".XXXXXX";
+        int fd = ::mkostemp(&temporary[0], O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        ::fchmod(fd, 0644);
+
+        Header header{kMagic, kVersion, key, _states, _offsets[_states], 0u};
+        header.checksum = checksum(_transitions, _offsets, _outputs, header.states, header.outputs);
+        bool success = write(fd, &header, sizeof(header))
+            && write(fd, _transitions, size_t{_states} * kAlphabet * sizeof(uint32_t))
+            && write(fd, _offsets, (size_t{_states} + 1u) * sizeof(uint32_t))
+            && write(fd, _outputs, size_t{header.outputs} * sizeof(uint32_t));
+
+        success = ::close(fd) == 0 && success;
+        if (!success || ::rename(temporary.c_str(), filename.c_str()) != 0) {
+            ::unlink(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Maps an automaton written by save().
+     *
+     * @param literals Number of literals the automaton was built from.
+     * @return False if the file is missing, malformed, corrupt or has
+     *         another key.
+     */
+    bool load(const std::string& filename, uint64_t key, uint32_t literals) {
+
+        int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat st;
+        void* mapping = MAP_FAILED;
+        if (::fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Header)) {
+            mapping = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        ::close(fd);
+
+        if (mapping == MAP_FAILED) {
+            return false;
+        }
+
+        Header header;
+        std::memcpy(&header, mapping, sizeof(header));
+        size_t expected = sizeof(Header) + (size_t{header.states} * kAlphabet
+            + header.states + 1u + header.outputs) * sizeof(uint32_t);
+
+        if (header.magic != kMagic || header.version != kVersion || header.key != key
+            || header.states == 0u || expected != static_cast<size_t>(st.st_size)) {
+            LOG("Discarding " << filename);
+            ::munmap(mapping, st.st_size);
+            return false;
+        }
+
+        auto transitions = reinterpret_cast<const uint32_t*>(static_cast<const char*>(mapping) + sizeof(Header));
+        auto offsets = transitions + size_t{header.states} * kAlphabet;
+        auto outputs = offsets + header.states + 1u;
+        if (checksum(transitions, offsets, outputs, header.states, header.outputs) != header.checksum
+            || !isUsable(outputs, header.outputs, literals)) {
+            LOG("Discarding corrupt " << filename);
+            ::munmap(mapping, st.st_size);
+            return false;
+        }
+
+        unmap();
+        _mapping = mapping;
+        _mappingSize = st.st_size;
+        _states = header.states;
+        _transitions = transitions;
+        _offsets = offsets;
+        _outputs = outputs;
+        return true;
+    }
+
+    /**
+     * Calls f with the id of every literal found in the text, once per
+     * occurrence.
+     */
+    template <typename F>
+    void scan(std::string_view text, F f) const {
+
+        if (_states == 0u) {
+            return;
+        }
+
+        uint32_t state = 0u;
+        for (unsigned char c : text) {
+            state = _transitions[state * kAlphabet + c];
+            for (uint32_t i = _offsets[state]; i < _offsets[state + 1u]; i++) {
+                f(_outputs[i]);
+            }
+        }
+    }
+
+    uint32_t getStateCnt() const {
+        return _states;
+    }
+
+private:
+
+    static constexpr size_t kAlphabet = 256u;
+
+    /**
+     * Outputs are far fewer than transitions, so they are still checked
+     * against literals, in case another set of literals has the same key.
+     */
+    static bool isUsable(const uint32_t* outputs, uint32_t outputCnt, uint32_t literals) {
+        for (size_t i = 0; i < outputCnt; i++) {
+            if (outputs[i] >= literals) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //! @return FNV-1a hash of the tables' entries.
+    static uint64_t checksum(const uint32_t* transitions, const uint32_t* offsets, const uint32_t* outputs,
+                             uint32_t states, uint32_t outputCnt) {
+
+        uint64_t hash = 14695981039346656037ull;
+        auto add = [&hash](const uint32_t* data, size_t size) {
+            for (size_t i = 0; i < size; i++) {
+                hash = (hash ^ data[i]) * 1099511628211ull;
+            }
+        };
+        add(transitions, size_t{states} * kAlphabet);
+        add(offsets, size_t{states} + 1u);
+        add(outputs, outputCnt);
+        return hash;
+    }
+
+    static bool write(int fd, const void* data, size_t size) {
+        auto ptr = static_cast<const char*>(data);
+        while (size > 0u) {
+            ssize_t written = ::write(fd, ptr, size);
+            if (written <= 0) {
+                return false;
+            }
+            ptr += written;
+            size -= written;
+        }
+        return true;
+    }
+
+    void unmap() {
+        if (_mapping != nullptr) {
+            ::munmap(_mapping, _mappingSize);
+            _mapping = nullptr;
+        }
+        _states = 0u;
+    }
+
+    uint32_t _states{0u};
+    const uint32_t* _transitions{nullptr};
+    const uint32_t* _offsets{nullptr};
+    const uint32_t* _outputs{nullptr};
+
+    //! Storage of a built automaton.
+    std::vector<uint32_t> _ownTransitions;
+    std::vector<uint32_t> _ownOffsets;
+    std::vector<uint32_t> _ownOutputs;
+
+    //! Storage of a loaded automaton.
+    void* _mapping{nullptr};
+    size_t _mappingSize{0u};
+};
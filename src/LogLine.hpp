@@ -14,7 +14,7 @@ struct LogLine {
     //! Comment associated with the line.
     std::string comment;
 
-    //! Unique id of line, growing monotonically
+    //! Unique id of line, growing monotonically as lines are added
     size_t id{0};
 
     //! Source of the line, or filter id if line matches filter
@@ -25,5 +25,8 @@ struct LogLine {
     //! to be properly constructed.
     bool valid{false};
 
+    //! Length of the whole line, if the text is only its prefix, or 0.
+    size_t fullLength{0};
+
     bool isValid() { return valid; }
 };
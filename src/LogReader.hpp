@@ -1,61 +1,286 @@
 #pragma once
 
-#include <fstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
 #include <functional>
-#include <future>
+#include <string>
+#include <string_view>
+#include <vector>
 
+#include "LineSplitter.hpp"
 #include "Log.hpp"
+#include "Reactor.hpp"
 
+/**
+ * Reads lines of an input file on the shared reactor.
+ *
+ * Pipes and FIFOs are read when epoll reports them readable, until the
+ * writer closes them. Regular files are read in chunks interleaved with
+ * other inputs, and afterwards, if requested, followed through inotify
+ * as they grow. A followed file is reread from its start when truncated,
+ * and once rotated, the file then at its path is followed instead.
+ * Complete lines are handed over in batches, one per chunk read. A
+ * throttle may pause the reading after a batch, e.g. while the consumer
+ * catches up, leaving the writer blocked or the file unread meanwhile.
+ */
 class LogReader {
 
 public:
 
     using OnStop = std::function<void()>;
-    using OnReadLine = std::function<void(std::string)>;
+    using OnReadLines = std::function<void(const std::vector<std::string_view>&)>;
+    //! @return True to pause until resume is called.
+    using Throttle = std::function<bool(std::function<void()> resume)>;
 
-    LogReader(std::string filename, OnStop onStop, OnReadLine onReadLine)
-        : _filename(filename)
+    /**
+     * @param deferred Whether to wait for start() instead of reading right away.
+     */
+    LogReader(Reactor& reactor, std::string filename, OnStop onStop, OnReadLines onReadLines,
+              bool follow = true, bool deferred = false)
+        : _reactor(reactor)
+        , _filename(filename)
         , _onStop(onStop)
-        , _onReadLine(onReadLine) {
-        _file.open(filename);
-        start();
+        , _onReadLines(onReadLines)
+        , _follow(follow) {
+        if (!deferred) {
+            start();
+        }
+    }
+
+    ~LogReader() {
+        stop();
+        // Barrier for a read task posted before the reader was stopped.
+        _reactor.call([](){});
     }
 
-    void start() {
-        _worker = std::async(std::launch::async, [this] () {
-            _isOn = true;
-            while(_isOn && read_line());
-            _onStop();
+    /**
+     * @param offset Where to start reading a regular file, e.g. after the
+     *               part already indexed.
+     */
+    void start(off_t offset = 0) {
+        _reactor.call([this, offset] () {
+            _fd = ::open(_filename.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+            if (_fd < 0) {
+                LOG("Failed to open " << _filename);
+                _onStop();
+                return;
+            }
+
+            if (offset > 0 && ::lseek(_fd, offset, SEEK_SET) != offset) {
+                LOG("Failed to seek " << _filename << " to " << offset);
+            }
+
+            _buffer.resize(kChunkSize);
+
+            _polled = _reactor.add(_fd, [this](uint32_t) { readAvailable(); });
+            if (!_polled) {
+                // Regular files can't be polled, they are read until the end
+                // and then followed for modifications.
+                if (_follow) {
+                    watch();
+                }
+                scheduleRead();
+            }
         });
     }
 
+    /**
+     * Asks the throttle after each batch whether to pause.
+     */
+    void setThrottle(Throttle throttle) {
+        _reactor.call([this, throttle] () { _throttle = throttle; });
+    }
+
+    /**
+     * Stops reading, no callbacks are made once this returns.
+     */
     void stop() {
-        _isOn = false;
+        _reactor.call([this] () { close(); });
+    }
+
+private:
+
+    static constexpr size_t kChunkSize = 256u * 1024u;
+    //! Chunks read at once from a pollable input, before yielding to others.
+    static constexpr int kMaxChunksPerEvent = 16;
+
+    void close() {
+        if (_fd < 0) {
+            return;
+        }
+        _reactor.remove(_fd);
+        _reactor.unwatch(_wd);
+        _reactor.unwatch(_directoryWd);
+        ::close(_fd);
+        _fd = -1;
+        _wd = -1;
+        _directoryWd = -1;
+    }
+
+    void watch() {
+        _wd = _reactor.watch(_filename, [this] () { scheduleRead(); },
+                             IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF | IN_ATTRIB);
+        if (_directoryWd < 0) {
+            // Where a rotated file is replaced
+            size_t slash = _filename.rfind('/');
+            auto directory = slash == std::string::npos ? std::string(".")
+                : slash == 0u ? std::string("/") : _filename.substr(0, slash);
+            _directoryWd = _reactor.watch(directory, [this] () { scheduleRead(); }, IN_CREATE | IN_MOVED_TO);
+        }
     }
 
-    bool read_line() {
+    /**
+     * Called once caught up with a followed file.
+     */
+    void checkReplaced() {
 
-        if (!_file.good()) {
-            LOG("End of input reached.");
-            return false;
+        struct stat current;
+        off_t offset = ::lseek(_fd, 0, SEEK_CUR);
+        if (::fstat(_fd, &current) != 0 || offset < 0) {
+            return;
         }
 
-        std::string line;
-        std::getline(_file, line);
-        if (!line.empty()) {
-            _onReadLine(line);
+        if (current.st_size < offset) {
+            LOG("Rereading truncated " << _filename);
+            flush();
+            ::lseek(_fd, 0, SEEK_SET);
+            scheduleRead();
+            return;
         }
 
-        return true;
+        struct stat replacement;
+        if (::stat(_filename.c_str(), &replacement) != 0
+            || (replacement.st_dev == current.st_dev && replacement.st_ino == current.st_ino)) {
+            return;
+        }
+
+        int fd = ::open(_filename.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        LOG("Following rotated " << _filename);
+        flush();
+        _reactor.unwatch(_wd);
+        ::close(_fd);
+        _fd = fd;
+        watch();
+        scheduleRead();
     }
 
-private:
+    void finish() {
+        LOG("End of input reached.");
+        flush();
+        close();
+        _onStop();
+    }
 
-    std::ifstream            _file;
-    std::string              _filename;
-    OnStop                   _onStop;
-    OnReadLine               _onReadLine;
-    std::future<void>        _worker;
-    std::atomic<bool>        _isOn;
-};
+    void pause() {
+        _paused = true;
+        if (_polled) {
+            _reactor.pause(_fd);
+        }
+    }
 
+    void resume() {
+        _reactor.post([this] () {
+            _paused = false;
+            if (_fd < 0) {
+                return;
+            }
+            if (_polled) {
+                _reactor.resume(_fd);
+            }
+            else {
+                scheduleRead();
+            }
+        });
+    }
+
+    void scheduleRead() {
+        if (_readScheduled || _paused) {
+            return;
+        }
+        _readScheduled = true;
+        _reactor.post([this] () {
+            _readScheduled = false;
+            readFileChunk();
+        });
+    }
+
+    void readFileChunk() {
+
+        if (_fd < 0 || _paused) {
+            return;
+        }
+
+        ssize_t size = ::read(_fd, _buffer.data(), _buffer.size());
+        if (size > 0) {
+            split(_buffer.data(), size);
+            scheduleRead();
+        }
+        else if (size == 0 && _follow) {
+            // Caught up, wait for the file to grow. An incomplete last line
+            // may still be being written, so it's kept until it ends.
+            checkReplaced();
+        }
+        else if (size == 0) {
+            finish();
+        }
+        else if (errno != EAGAIN && errno != EINTR) {
+            finish();
+        }
+    }
+
+    void readAvailable() {
+
+        for (int i = 0; i < kMaxChunksPerEvent && _fd >= 0 && !_paused; i++) {
+            ssize_t size = ::read(_fd, _buffer.data(), _buffer.size());
+            if (size > 0) {
+                split(_buffer.data(), size);
+            }
+            else if (size == 0 || (errno != EAGAIN && errno != EINTR)) {
+                finish();
+                return;
+            }
+            else {
+                return;
+            }
+        }
+    }
+
+    void split(const char* data, size_t size) {
+        emit(_splitter.split(data, size));
+    }
+
+    void flush() {
+        emit(_splitter.flush());
+    }
+
+    void emit(const std::vector<std::string_view>& lines) {
+        if (lines.empty()) {
+            return;
+        }
+        _onReadLines(lines);
+        if (_throttle && _fd >= 0 && _throttle([this] () { resume(); })) {
+            pause();
+        }
+    }
+
+    Reactor&                        _reactor;
+    std::string                     _filename;
+    OnStop                          _onStop;
+    OnReadLines                     _onReadLines;
+    bool                            _follow;
+    int                             _fd{-1};
+    int                             _wd{-1};
+    int                             _directoryWd{-1};
+    bool                            _polled{false};
+    bool                            _readScheduled{false};
+    bool                            _paused{false};
+    Throttle                        _throttle;
+    std::vector<char>               _buffer;
+    LineSplitter                    _splitter;
+};
@@ -0,0 +1,423 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Log.hpp"
+#include "Reactor.hpp"
+
+/**
+ * Listens for log messages on a network socket.
+ *
+ * Supported protocols:
+ *   udp - syslog over UDP, one message per datagram (RFC 3164/5424).
+ *   tcp - syslog over TCP, with either octet counting or newline framing
+ *         (RFC 6587), detected per message.
+ *   raw - newline delimited text over TCP.
+ *
+ * The address is either a port or host:port. Sockets are served by the
+ * shared reactor and messages are handed over in batches. Messages are
+ * kept as received, their PRI and header aren't parsed.
+ *
+ * Octet counted messages are limited to the size of a datagram, longer
+ * counts are taken as newline framed text. Newline framed lines beyond
+ * 16 MB are truncated, the client stays connected.
+ *
+ * A throttle may pause the reading after a batch, e.g. while the consumer
+ * catches up, leaving the messages in the socket buffers meanwhile.
+ */
+class NetReader {
+
+public:
+
+    using OnStop = std::function<void()>;
+    using OnReadLines = std::function<void(const std::vector<std::string_view>&)>;
+    //! @return True to pause until resume is called.
+    using Throttle = std::function<bool(std::function<void()> resume)>;
+
+    enum class Protocol { Udp, Tcp, Raw };
+
+    static bool parseProtocol(const std::string& name, Protocol* protocol) {
+        static const std::map<std::string, Protocol> kProtocols = {
+            {"udp", Protocol::Udp}, {"tcp", Protocol::Tcp}, {"raw", Protocol::Raw}};
+
+        auto it = kProtocols.find(name);
+        if (it == kProtocols.end()) {
+            return false;
+        }
+        *protocol = it->second;
+        return true;
+    }
+
+    NetReader(Reactor& reactor, Protocol protocol, std::string address, OnStop onStop, OnReadLines onReadLines)
+        : _reactor(reactor)
+        , _protocol(protocol)
+        , _onStop(onStop)
+        , _onReadLines(onReadLines) {
+        if (open(address)) {
+            start();
+        }
+    }
+
+    ~NetReader() {
+        stop();
+    }
+
+    bool isOpen() const {
+        return _socket >= 0;
+    }
+
+    //! @return Port the socket is bound to, useful when binding to port 0.
+    uint16_t getPort() const {
+        sockaddr_in addr{};
+        socklen_t len = sizeof(addr);
+        if (::getsockname(_socket, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+            return 0;
+        }
+        return ntohs(addr.sin_port);
+    }
+
+    void start() {
+        _reactor.call([this] () {
+            if (_protocol == Protocol::Udp) {
+                _reactor.add(_socket, [this](uint32_t) { receiveDatagrams(); });
+            }
+            else {
+                _reactor.add(_socket, [this](uint32_t) { accept(); });
+            }
+        });
+    }
+
+    /**
+     * Asks the throttle after each batch whether to pause.
+     */
+    void setThrottle(Throttle throttle) {
+        _reactor.call([this, throttle] () { _throttle = throttle; });
+    }
+
+    /**
+     * Stops listening and closes all connections.
+     */
+    void stop() {
+        _reactor.call([this] () {
+            if (_socket < 0) {
+                return;
+            }
+            for (const auto& client : _clients) {
+                _reactor.remove(client.first);
+                ::close(client.first);
+            }
+            _clients.clear();
+            _reactor.remove(_socket);
+            ::close(_socket);
+            _socket = -1;
+            _onStop();
+        });
+    }
+
+private:
+
+    static constexpr int kReceiveBufferSize = 8 * 1024 * 1024;
+    static constexpr size_t kBatchSize = 64;
+    static constexpr size_t kMaxDatagramSize = 64 * 1024;
+    //! Newline framed lines are truncated beyond it.
+    static constexpr size_t kMaxLineSize = 16 * 1024 * 1024;
+    //! Digits of an octet count, more can't be a valid length.
+    static constexpr size_t kMaxLengthDigits = 10;
+    static constexpr size_t kReadSize = 64 * 1024;
+    //! Receive calls per event, before yielding to other inputs.
+    static constexpr int kMaxReadsPerEvent = 16;
+
+    //! Stream client's data not handed over yet.
+    struct Client {
+        std::string pending;
+        //! Where to continue looking for the end of the last line.
+        size_t scanned{0u};
+        //! Whether the rest of a truncated line is skipped.
+        bool truncated{false};
+    };
+
+    /**
+     * @return False if the port isn't a number up to 65535, 0 binds to
+     *         any free port.
+     */
+    static bool parsePort(const std::string& raw, uint16_t* port) {
+        if (raw.empty() || !std::all_of(raw.begin(), raw.end(), [](unsigned char c) { return std::isdigit(c); })) {
+            return false;
+        }
+        unsigned long value = std::strtoul(raw.c_str(), nullptr, 10);
+        if (value > 65535u) {
+            return false;
+        }
+        *port = value;
+        return true;
+    }
+
+    bool open(const std::string& address) {
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+        std::string port = address;
+        size_t separator = address.rfind(':');
+        if (separator != std::string::npos) {
+            port = address.substr(separator + 1u);
+            if (::inet_pton(AF_INET, address.substr(0, separator).c_str(), &addr.sin_addr) != 1) {
+                LOG("Invalid address: " << address);
+                return false;
+            }
+        }
+        uint16_t number;
+        if (!parsePort(port, &number)) {
+            LOG("Invalid port: " << address);
+            return false;
+        }
+        addr.sin_port = htons(number);
+
+        int type = _protocol == Protocol::Udp ? SOCK_DGRAM : SOCK_STREAM;
+        _socket = ::socket(AF_INET, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (_socket < 0) {
+            return false;
+        }
+
+        int enable = 1;
+        ::setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+        // Absorbs bursts while the batch is being processed.
+        ::setsockopt(_socket, SOL_SOCKET, SO_RCVBUF, &kReceiveBufferSize, sizeof(kReceiveBufferSize));
+
+        if (::bind(_socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+            || (type == SOCK_STREAM && ::listen(_socket, SOMAXCONN) != 0)) {
+            LOG("Failed to listen on " << address);
+            ::close(_socket);
+            _socket = -1;
+            return false;
+        }
+
+        LOG("Listening on " << address);
+        return true;
+    }
+
+    void pause() {
+        _paused = true;
+        _reactor.pause(_socket);
+        for (const auto& client : _clients) {
+            _reactor.pause(client.first);
+        }
+    }
+
+    void resume() {
+        _reactor.post([this] () {
+            _paused = false;
+            if (_socket < 0) {
+                return;
+            }
+            _reactor.resume(_socket);
+            for (const auto& client : _clients) {
+                _reactor.resume(client.first);
+            }
+        });
+    }
+
+    void receiveDatagrams() {
+
+        if (_datagrams.empty()) {
+            _datagrams.resize(kBatchSize * kMaxDatagramSize);
+        }
+
+        std::array<iovec, kBatchSize> iovecs;
+        std::array<mmsghdr, kBatchSize> messages{};
+        for (size_t i = 0; i < kBatchSize; i++) {
+            iovecs[i] = {&_datagrams[i * kMaxDatagramSize], kMaxDatagramSize};
+            messages[i].msg_hdr.msg_iov = &iovecs[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        for (int i = 0; i < kMaxReadsPerEvent && !_paused; i++) {
+            int received = ::recvmmsg(_socket, messages.data(), kBatchSize, MSG_DONTWAIT, nullptr);
+            if (received <= 0) {
+                return;
+            }
+            for (int j = 0; j < received; j++) {
+                addMessage(&_datagrams[j * kMaxDatagramSize], messages[j].msg_len);
+            }
+            emit();
+        }
+    }
+
+    void accept() {
+        int client = ::accept4(_socket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client >= 0) {
+            _clients[client];
+            _reactor.add(client, [this, client](uint32_t) { receiveStream(client); });
+        }
+    }
+
+    void receiveStream(int client) {
+
+        char buffer[kReadSize];
+        auto& state = _clients[client];
+
+        for (int i = 0; i < kMaxReadsPerEvent && !_paused; i++) {
+            ssize_t size = ::read(client, buffer, sizeof(buffer));
+            if (size > 0) {
+                state.pending.append(buffer, size);
+                emitFrames(&state, false);
+            }
+            else if (size == 0 || (errno != EAGAIN && errno != EINTR)) {
+                emitFrames(&state, true);
+                disconnect(client);
+                return;
+            }
+            else {
+                return;
+            }
+        }
+    }
+
+    void disconnect(int client) {
+        _reactor.remove(client);
+        ::close(client);
+        _clients.erase(client);
+    }
+
+    enum class Count { Valid, Incomplete, Invalid };
+
+    /**
+     * Parses the octet count of a message, "<length> <message>", which is
+     * up to ten digits followed by a space, for a length up to the
+     * maximum message size.
+     *
+     * @param body Receives the offset of the message.
+     */
+    static Count parseCount(const std::string& pending, size_t start, size_t* length, size_t* body) {
+
+        size_t end = start;
+        while (end < pending.size() && end - start <= kMaxLengthDigits
+               && std::isdigit(static_cast<unsigned char>(pending[end]))) {
+            end++;
+        }
+        if (end == pending.size() && end - start <= kMaxLengthDigits) {
+            return Count::Incomplete;
+        }
+        if (end == start || end - start > kMaxLengthDigits || pending[end] != ' ') {
+            return Count::Invalid;
+        }
+
+        *length = std::strtoull(pending.c_str() + start, nullptr, 10);
+        *body = end + 1u;
+        return *length > 0u && *length <= kMaxDatagramSize ? Count::Valid : Count::Invalid;
+    }
+
+    /**
+     * Emits complete messages from the stream buffer. Messages which
+     * don't start with a valid octet count are framed by newlines.
+     *
+     * @param flush Emit the incomplete remainder as well.
+     */
+    void emitFrames(Client* client, bool flush) {
+
+        auto& pending = client->pending;
+        size_t start = 0;
+
+        if (client->truncated) {
+            size_t newline = pending.find('\n');
+            if (newline == std::string::npos) {
+                pending.clear();
+                return;
+            }
+            client->truncated = false;
+            start = newline + 1u;
+        }
+
+        while (start < pending.size()) {
+
+            size_t length = 0;
+            size_t body = start;
+
+            if (_protocol == Protocol::Tcp && std::isdigit(static_cast<unsigned char>(pending[start]))) {
+                auto count = parseCount(pending, start, &length, &body);
+                if (count == Count::Incomplete && !flush) {
+                    break;
+                }
+                if (count == Count::Valid) {
+                    if (pending.size() - body < length && !flush) {
+                        break;
+                    }
+                    length = std::min(length, pending.size() - body);
+                    addMessage(pending.data() + body, length);
+                    start = body + length;
+                    continue;
+                }
+            }
+
+            // A long line arrives in many reads, each only scanned once
+            size_t newline = pending.find('\n', std::max(start, client->scanned));
+            if (newline == std::string::npos) {
+                client->scanned = pending.size();
+                if (pending.size() - start > kMaxLineSize) {
+                    LOG("Truncating a line over " << kMaxLineSize << " bytes");
+                    addMessage(pending.data() + start, kMaxLineSize);
+                    client->truncated = true;
+                    start = pending.size();
+                }
+                break;
+            }
+            addMessage(pending.data() + start, newline - start);
+            start = newline + 1u;
+        }
+
+        if (flush && start < pending.size()) {
+            addMessage(pending.data() + start, pending.size() - start);
+            start = pending.size();
+        }
+
+        emit();
+        pending.erase(0, start);
+        client->scanned = client->scanned > start ? client->scanned - start : 0u;
+    }
+
+    void addMessage(const char* data, size_t size) {
+        while (size > 0 && (data[size - 1] == '\n' || data[size - 1] == '\r' || data[size - 1] == '\0')) {
+            size--;
+        }
+        if (size > 0) {
+            _batch.emplace_back(data, size);
+        }
+    }
+
+    void emit() {
+        if (_batch.empty()) {
+            return;
+        }
+        _onReadLines(_batch);
+        _batch.clear();
+        if (_throttle && _throttle([this] () { resume(); })) {
+            pause();
+        }
+    }
+
+    Reactor&                        _reactor;
+    Protocol                        _protocol;
+    OnStop                          _onStop;
+    OnReadLines                     _onReadLines;
+    int                             _socket{-1};
+    std::vector<char>               _datagrams;
+    std::map<int, Client>           _clients;
+    std::vector<std::string_view>   _batch;
+    bool                            _paused{false};
+    Throttle                        _throttle;
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstring>
+#include <fstream>
 #include <vector>
 #include <string>
 #include <optional>
@@ -14,11 +15,74 @@ namespace {
         "Log Analysis tool.\n\n"
         "Options:\n"
         "  -i <file>\n"
-        "     Input file to be read.\n"
+        "     Input file to be read. Files of 16 MiB and more\n"
+        "     are indexed on all cores, showing the progress in\n"
+        "     the tab title.\n"
+        "  -F Follows the input files once read, like tail -F,\n"
+        "     rereading a truncated file from its start and switching\n"
+        "     to the new file at the path of a rotated one.\n"
+        "  -u <depth>\n"
+        "     Reads the smaller input files, like a set of rotated\n"
+        "     logs, through io_uring with up to depth reads in flight\n"
+        "     across them, one file after another in the order given.\n"
+        "     Without io_uring they are read as usual.\n"
+        "  -t <lines>\n"
+        "     Opens the input files at their end, showing their last\n"
+        "     lines right away. Older lines are loaded in blocks when\n"
+        "     scrolling up past the first line, the share of the file\n"
+        "     loaded is shown in the tab title.\n"
+        "  -m <name:rule>\n"
+        "     Joins the lines of the input with the given name into\n"
+        "     records, like a message and its stack trace, which are\n"
+        "     filtered and shown as one line. The rule is one of:\n"
+        "       indent    - indented lines continue a record\n"
+        "       timestamp - lines starting with a date or a time,\n"
+        "                   like 2024-01-31 or 12:30:00, start one\n"
+        "       <regex>   - lines starting with a match start one\n"
+        "     Filters match records with their lines joined by spaces.\n"
+        "     Inputs with records aren't indexed on all cores.\n"
+        "  -l <bytes>\n"
+        "     Keeps only the first bytes of longer lines in memory,\n"
+        "     with the whole lines in a temporary file. Filters,\n"
+        "     queries and exports use the whole lines, which are\n"
+        "     shown with key 'x'.\n"
+        "  -n <protocol:[host:]port>\n"
+        "     Listens for input on a network port. Protocol is one of:\n"
+        "       udp - syslog over UDP\n"
+        "       tcp - syslog over TCP, octet counted or newline framed\n"
+        "       raw - newline delimited text over TCP\n"
         "  -f <name:regex>\n"
         "     Defines a regular expression with the given name.\n"
         "     Matching lines will be marked with a color and\n"
         "     their visibility can be toggled.\n"
+        "     Named groups, (?<name>...), capture fields of the\n"
+        "     matching lines, aggregated per filter (key 'a').\n"
+        "     The cost of each filter is shown with key 'p'. A regex\n"
+        "     taking over 10 ms on a line is limited to shorter\n"
+        "     lines, marked !slow, and disabled after three such\n"
+        "     lines, marked !disabled. Ambiguous nested quantifiers,\n"
+        "     as in (a+)+, limit the filter to lines of 16 bytes\n"
+        "     from the start, marked !backtracking.\n"
+        "  -d <name:regex>\n"
+        "     Drops the lines matching the regular expression before\n"
+        "     they are stored, so they take neither memory nor time\n"
+        "     when scrolling. Drop filters are tried before the other\n"
+        "     filters, a regex like .*text.* only looks for the text.\n"
+        "     The lines dropped by each are shown with key 'p'.\n"
+        "  -k <name:regex>\n"
+        "     Defines a correlation key, like a request or trace id,\n"
+        "     whose value is the regex's first group, or its match,\n"
+        "     found anywhere in a line. Key 'k' scrolls to the next\n"
+        "     line sharing a key with the top line, across all tabs,\n"
+        "     'K' to the previous one, and key 'r' lists them.\n"
+        "  -p <file>\n"
+        "     Reads filters from a profile, one name:regex per line.\n"
+        "     Empty lines and lines starting with # are ignored.\n"
+        "     The regexes are compiled when first used.\n"
+        "  -C <directory>\n"
+        "     Caches the automaton finding the literals the filters\n"
+        "     require in the directory, e.g. ~/.cache/logalizer, and\n"
+        "     maps it on later launches while they stay the same.\n"
         "  -e <name:command>\n"
         "     Defines a command to be executed whenever a line\n"
         "     with matches a filter with the same name.\n"
@@ -26,7 +90,56 @@ namespace {
         "     as its first argument and anything outputed to the\n"
         "     standard output by the command will be recorded and\n"
         "     displayed as a comment.\n"
+        "  -c <name:command>\n"
+        "     Like -e, but the command is started once and comments\n"
+        "     the lines it reads from its standard input. Each line\n"
+        "     is sent as \"<id> <length>\\n\" followed by the line's\n"
+        "     <length> bytes, and the command answers in any order\n"
+        "     with \"<id> <length>\\n\" followed by the comment.\n"
+        "  -q <[input=]policy[:capacity]>\n"
+        "     What the named input, or without a name the others,\n"
+        "     does when its queue of unprocessed lines is full.\n"
+        "     The capacity is in lines, 65536 by default.\n"
+        "       block - stop reading until the queue drains (default)\n"
+        "       drop  - drop the lines, their count is shown as\n"
+        "               -N in the tab title\n"
+        "  -s <name:N>\n"
+        "     Keeps only every N-th line of the tab with the given\n"
+        "     name, an input or a filter. The count of the left out\n"
+        "     lines is shown as ~N. Lines matching other filters\n"
+        "     are kept, as they belong to the filters' tabs.\n"
+        "  -r <file>\n"
+        "     Records the lines of all inputs with their arrival\n"
+        "     times to the file.\n"
+        "  -R <file>\n"
+        "     Replays a recording made with -r as the inputs, each\n"
+        "     in a tab with its recorded name.\n"
+        "  -x <speed>\n"
+        "     Speed of the replay: 1 for the recorded timing (default),\n"
+        "     N for N times faster, or max to replay without pauses.\n"
+        "  -o <file>\n"
+        "     Reads the inputs to their end, writes the lines of the\n"
+        "     enabled tabs with their comments to the file and exits\n"
+        "     without starting the UI.\n"
+        "  -D <socket>\n"
+        "     Runs the session in the background, without the UI,\n"
+        "     until it receives SIGINT or SIGTERM. Viewers attach\n"
+        "     to it through the Unix socket at the given path.\n"
+        "  -a <socket>\n"
+        "     Attaches the UI to a session started with -D. Several\n"
+        "     viewers may attach at once, each with its own scroll\n"
+        "     position and tabs. Quitting the UI detaches it and\n"
+        "     leaves the session running.\n"
         "  -h Prints this help.\n\n"
+        "Keys:\n\n"
+        "  /  Searches all lines for a regular expression on all\n"
+        "     cores, in a new tab showing only the matching lines\n"
+        "     of the enabled tabs, with the share searched in its\n"
+        "     title. Matches show up as the search goes on, an empty\n"
+        "     expression stops the search and removes the tab.\n"
+        "  x  Shows the whole text of the top line, scrolled with the\n"
+        "     arrow and page keys, including the part of a line\n"
+        "     beyond the -l limit.\n\n"
         "Example:\n\n"
 		"  log-analyzer -i  <(journalctl) -f 'KERNEL:.*kernel.*' 'SYSTEMD:.*systemd.*' 2> err.txt\n\n"
 		"     Reads the contents of journalctl and marks all lines containing \"kernel\" and \"systemd\".\n";
@@ -44,10 +157,43 @@ struct External {
     std::string command;
 };
 
+struct Listener {
+    std::string protocol;
+    std::string address;
+};
+
+struct Multiline {
+    std::string name;
+    std::string rule;
+};
+
+struct Sampling {
+    std::string name;
+    std::string every;
+};
+
 struct Options {
     std::vector<std::string> inputs;
+    bool follow{false};
+    std::string uring;
+    std::string tail;
+    std::vector<Multiline> multilines;
+    std::string lineLimit;
     std::vector<Filter> filters;
+    std::vector<Filter> drops;
+    std::vector<Filter> keys;
+    std::string filterCache;
     std::vector<External> externals;
+    std::vector<External> coprocesses;
+    std::vector<Listener> listeners;
+    std::vector<Sampling> samplings;
+    std::vector<std::string> queues;
+    std::string record;
+    std::string replay;
+    std::string speed{"1"};
+    std::string output;
+    std::string session;
+    std::string attach;
 };
 
 const char* getHelp() {
@@ -83,9 +229,42 @@ void parse(bool *success, std::vector<std::string>* out, const std::string& raw)
     *success = true;
 }
 
+void parse(bool *success, std::string* out, const std::string& raw) {
+    *out = raw;
+    *success = true;
+}
+
+/**
+ * Reads the filters of a profile, one "name:regex" per line.
+ */
+bool loadProfile(std::vector<Filter>* out, const std::string& filename) {
+
+    std::ifstream profile(filename);
+    if (!profile) {
+        LOG("Failed to open profile " << filename);
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(profile, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        bool success = false;
+        parse(&success, out, line);
+        if (!success) {
+            LOG("Invalid filter in " << filename << ": " << line);
+            return false;
+        }
+    }
+
+    return true;
+}
+
 bool parseOptions(Options* options, int argc, char* argv[]) {
 
-    enum class Option { Input, Filter, External } option;
+    enum class Option { Input, Uring, Tail, Multiline, LineLimit, Filter, Drop, Key, Profile, FilterCache, External, Coprocess, Listener, Queue, Sampling, Record, Replay, Speed, Output, Session, Attach } option;
     int id = 0;
 
     for (int i=1; i<argc; i++) {
@@ -96,24 +275,135 @@ bool parseOptions(Options* options, int argc, char* argv[]) {
         else if (std::strcmp(argv[i], "-i") == 0) {
             option = Option::Input;
         }
+        else if (std::strcmp(argv[i], "-F") == 0) {
+            options->follow = true;
+        }
+        else if (std::strcmp(argv[i], "-t") == 0) {
+            option = Option::Tail;
+        }
+        else if (std::strcmp(argv[i], "-u") == 0) {
+            option = Option::Uring;
+        }
+        else if (std::strcmp(argv[i], "-m") == 0) {
+            option = Option::Multiline;
+        }
+        else if (std::strcmp(argv[i], "-l") == 0) {
+            option = Option::LineLimit;
+        }
         else if (std::strcmp(argv[i], "-f") == 0) {
             option = Option::Filter;
         }
+        else if (std::strcmp(argv[i], "-d") == 0) {
+            option = Option::Drop;
+        }
+        else if (std::strcmp(argv[i], "-k") == 0) {
+            option = Option::Key;
+        }
+        else if (std::strcmp(argv[i], "-p") == 0) {
+            option = Option::Profile;
+        }
+        else if (std::strcmp(argv[i], "-C") == 0) {
+            option = Option::FilterCache;
+        }
         else if (std::strcmp(argv[i], "-e") == 0) {
             option = Option::External;
         }
+        else if (std::strcmp(argv[i], "-c") == 0) {
+            option = Option::Coprocess;
+        }
+        else if (std::strcmp(argv[i], "-n") == 0) {
+            option = Option::Listener;
+        }
+        else if (std::strcmp(argv[i], "-q") == 0) {
+            option = Option::Queue;
+        }
+        else if (std::strcmp(argv[i], "-s") == 0) {
+            option = Option::Sampling;
+        }
+        else if (std::strcmp(argv[i], "-r") == 0) {
+            option = Option::Record;
+        }
+        else if (std::strcmp(argv[i], "-R") == 0) {
+            option = Option::Replay;
+        }
+        else if (std::strcmp(argv[i], "-x") == 0) {
+            option = Option::Speed;
+        }
+        else if (std::strcmp(argv[i], "-o") == 0) {
+            option = Option::Output;
+        }
+        else if (std::strcmp(argv[i], "-D") == 0) {
+            option = Option::Session;
+        }
+        else if (std::strcmp(argv[i], "-a") == 0) {
+            option = Option::Attach;
+        }
         else {
             bool success = false;
             switch (option) {
                 case Option::Input:
                     parse(&success, &options->inputs, argv[i]);
                     break;
+                case Option::Tail:
+                    parse(&success, &options->tail, argv[i]);
+                    break;
+                case Option::Uring:
+                    parse(&success, &options->uring, argv[i]);
+                    break;
+                case Option::Multiline:
+                    parse(&success, &options->multilines, argv[i]);
+                    break;
+                case Option::LineLimit:
+                    parse(&success, &options->lineLimit, argv[i]);
+                    break;
                 case Option::Filter:
                     parse(&success, &options->filters,  argv[i]);
                     break;
+                case Option::Drop:
+                    parse(&success, &options->drops, argv[i]);
+                    break;
+                case Option::Key:
+                    parse(&success, &options->keys, argv[i]);
+                    break;
+                case Option::Profile:
+                    success = loadProfile(&options->filters, argv[i]);
+                    break;
+                case Option::FilterCache:
+                    parse(&success, &options->filterCache, argv[i]);
+                    break;
                 case Option::External:
                     parse(&success, &options->externals, argv[i]);
                     break;
+                case Option::Coprocess:
+                    parse(&success, &options->coprocesses, argv[i]);
+                    break;
+                case Option::Listener:
+                    parse(&success, &options->listeners, argv[i]);
+                    break;
+                case Option::Queue:
+                    parse(&success, &options->queues, argv[i]);
+                    break;
+                case Option::Sampling:
+                    parse(&success, &options->samplings, argv[i]);
+                    break;
+                case Option::Record:
+                    parse(&success, &options->record, argv[i]);
+                    break;
+                case Option::Replay:
+                    parse(&success, &options->replay, argv[i]);
+                    break;
+                case Option::Speed:
+                    parse(&success, &options->speed, argv[i]);
+                    break;
+                case Option::Output:
+                    parse(&success, &options->output, argv[i]);
+                    break;
+                case Option::Session:
+                    parse(&success, &options->session, argv[i]);
+                    break;
+                case Option::Attach:
+                    parse(&success, &options->attach, argv[i]);
+                    break;
             }
 
             if (!success) {
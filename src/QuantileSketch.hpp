@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Quantile sketch with relative error guarantees (DDSketch).
+ *
+ * Values are counted in logarithmically sized buckets, so any quantile is
+ * estimated within the relative accuracy, in constant memory and time per
+ * value. Negative values are counted in a mirrored set of buckets.
+ */
+class QuantileSketch {
+
+    //! Contiguous bucket counts, the first one at the bucket index offset.
+    struct Buckets {
+        int offset{0};
+        std::vector<uint64_t> counts;
+    };
+
+public:
+
+    explicit QuantileSketch(double accuracy = kDefaultAccuracy)
+        : _gamma((1.0 + accuracy) / (1.0 - accuracy))
+        , _logGamma(std::log(_gamma)) {}
+
+    void add(double value) {
+        if (std::isnan(value)) {
+            return;
+        }
+        if (value > kMinValue) {
+            add(&_positive, index(value));
+        }
+        else if (value < -kMinValue) {
+            add(&_negative, index(-value));
+        }
+        else {
+            _zeros++;
+        }
+        _count++;
+    }
+
+    uint64_t getCount() const {
+        return _count;
+    }
+
+    /**
+     * @param quantile In [0, 1].
+     * @return Estimated value at the quantile, NaN if empty.
+     */
+    double getQuantile(double quantile) const {
+
+        if (_count == 0u) {
+            return NAN;
+        }
+
+        uint64_t rank = static_cast<uint64_t>(quantile * (_count - 1u));
+        uint64_t seen = 0u;
+
+        // Negative values from the largest magnitude.
+        for (size_t i = _negative.counts.size(); i-- > 0u; ) {
+            seen += _negative.counts[i];
+            if (seen > rank) {
+                return -value(_negative.offset + static_cast<int>(i));
+            }
+        }
+
+        seen += _zeros;
+        if (seen > rank) {
+            return 0.0;
+        }
+
+        for (size_t i = 0; i < _positive.counts.size(); i++) {
+            seen += _positive.counts[i];
+            if (seen > rank) {
+                return value(_positive.offset + static_cast<int>(i));
+            }
+        }
+
+        return value(_positive.offset + static_cast<int>(_positive.counts.size()) - 1);
+    }
+
+private:
+
+    static constexpr double kDefaultAccuracy = 0.01;
+    static constexpr double kMinValue = 1e-9;
+    //! Buckets kept per sign, the smallest magnitudes are merged beyond it.
+    static constexpr size_t kMaxBuckets = 2048u;
+
+    int index(double value) const {
+        return static_cast<int>(std::ceil(std::log(value) / _logGamma));
+    }
+
+    //! @return Value in the middle of the bucket, in relative terms.
+    double value(int index) const {
+        return 2.0 * std::pow(_gamma, index) / (_gamma + 1.0);
+    }
+
+    static void add(Buckets* buckets, int index) {
+
+        auto& counts = buckets->counts;
+        if (counts.empty()) {
+            buckets->offset = index;
+            counts.push_back(0u);
+        }
+        else if (index < buckets->offset) {
+            counts.insert(counts.begin(), buckets->offset - index, 0u);
+            buckets->offset = index;
+        }
+        else if (index >= buckets->offset + static_cast<int>(counts.size())) {
+            counts.resize(index - buckets->offset + 1, 0u);
+        }
+
+        counts[index - buckets->offset]++;
+
+        if (counts.size() > kMaxBuckets) {
+            size_t merged = counts.size() - kMaxBuckets;
+            for (size_t i = 0; i < merged; i++) {
+                counts[merged] += counts[i];
+            }
+            counts.erase(counts.begin(), counts.begin() + merged);
+            buckets->offset += merged;
+        }
+    }
+
+    double _gamma;
+    double _logGamma;
+    Buckets _positive;
+    Buckets _negative;
+    uint64_t _zeros{0u};
+    uint64_t _count{0u};
+};
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Rank/select index over the tab membership of lines.
+ *
+ * Lines are grouped into blocks of kBlockSize and, for every tab, a Fenwick
+ * tree keeps the number of member lines per block. Queries combine the trees
+ * of the enabled tabs only, so toggling a tab needs no update at all, and
+ * resolve the remainder by scanning a single block.
+ *
+ * Membership of an individual line is not stored here; the caller provides
+ * it as a predicate which is only ever called for lines of one block.
+ */
+class RankIndex {
+
+public:
+
+    using Mask = std::bitset<256>;
+
+    static constexpr size_t kBlockSize = 1024u;
+
+    /**
+     * Registers line `pos` as a member of `tab`.
+     */
+    void add(size_t pos, uint8_t tab) {
+
+        if (tab >= _trees.size()) {
+            _trees.resize(tab + 1u, std::vector<uint32_t>(_blocks + 1u, 0u));
+        }
+
+        reserve(pos + 1u);
+
+        auto& tree = _trees[tab];
+        for (size_t i = pos / kBlockSize + 1u; i <= _blocks; i += lowbit(i)) {
+            tree[i]++;
+        }
+    }
+
+    /**
+     * Extends the index so it covers `size` lines.
+     */
+    void reserve(size_t size) {
+
+        while (_blocks * kBlockSize < size) {
+            _blocks++;
+            for (auto& tree : _trees) {
+                // Node covers blocks (n - lowbit(n), n], the last one is empty.
+                tree.push_back(prefix(tree, _blocks - 1u) - prefix(tree, _blocks - lowbit(_blocks)));
+            }
+        }
+
+        if (size > _size) {
+            _size = size;
+        }
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    /**
+     * @return Number of member lines with position lower than `pos`.
+     */
+    template <typename IsMember>
+    size_t countBefore(size_t pos, const Mask& mask, IsMember isMember) const {
+
+        if (pos > _size) {
+            pos = _size;
+        }
+
+        size_t block = pos / kBlockSize;
+        size_t cnt = 0u;
+
+        for (size_t tab = 0u; tab < _trees.size(); tab++) {
+            if (mask[tab]) {
+                cnt += prefix(_trees[tab], block);
+            }
+        }
+
+        for (size_t i = block * kBlockSize; i < pos; i++) {
+            if (isMember(i)) {
+                cnt++;
+            }
+        }
+
+        return cnt;
+    }
+
+    template <typename IsMember>
+    size_t count(const Mask& mask, IsMember isMember) const {
+        return countBefore(_size, mask, isMember);
+    }
+
+    /**
+     * Finds the `k`-th (zero based) member line.
+     *
+     * @return Position of the line, or _size if there are not enough members.
+     */
+    template <typename IsMember>
+    size_t select(size_t k, const Mask& mask, IsMember isMember) const {
+
+        size_t block = 0u;
+        size_t step = 1u;
+        while (step * 2u <= _blocks) {
+            step *= 2u;
+        }
+
+        for (; step > 0u; step /= 2u) {
+
+            if (block + step > _blocks) {
+                continue;
+            }
+
+            size_t cnt = 0u;
+            for (size_t tab = 0u; tab < _trees.size(); tab++) {
+                if (mask[tab]) {
+                    cnt += _trees[tab][block + step];
+                }
+            }
+
+            if (cnt <= k) {
+                block += step;
+                k -= cnt;
+            }
+        }
+
+        size_t end = std::min(_size, (block + 1u) * kBlockSize);
+        for (size_t i = block * kBlockSize; i < end; i++) {
+            if (isMember(i)) {
+                if (k == 0u) {
+                    return i;
+                }
+                k--;
+            }
+        }
+
+        return _size;
+    }
+
+private:
+
+    static size_t lowbit(size_t i) {
+        return i & (~i + 1u);
+    }
+
+    //! Sum of the first `blocks` blocks.
+    static size_t prefix(const std::vector<uint32_t>& tree, size_t blocks) {
+        size_t sum = 0u;
+        for (size_t i = blocks; i > 0u; i -= lowbit(i)) {
+            sum += tree[i];
+        }
+        return sum;
+    }
+
+    //! One tree per tab, 1-based, node i covers blocks (i - lowbit(i), i].
+    std::vector<std::vector<uint32_t>> _trees;
+    size_t _blocks{0u};
+    size_t _size{0u};
+};
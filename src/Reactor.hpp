@@ -0,0 +1,271 @@
+#pragma once
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Log.hpp"
+
+/**
+ * Single threaded I/O event loop shared by all inputs.
+ *
+ * Pollable descriptors (pipes, FIFOs, sockets) are multiplexed with epoll,
+ * while modifications of regular files, which epoll does not support, are
+ * reported through inotify. Work that must not block the loop for long, like
+ * reading a large file, is split into tasks which are interleaved with
+ * the I/O events.
+ *
+ * Descriptors and watches may only be added or removed from the reactor
+ * thread, other threads do so through post() or call().
+ */
+class Reactor {
+
+public:
+
+    using Handler = std::function<void(uint32_t events)>;
+    using Task = std::function<void()>;
+
+    Reactor() {
+        _epoll = ::epoll_create1(EPOLL_CLOEXEC);
+        _wakeup = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        _inotify = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+        add(_wakeup, [this](uint32_t) {
+            uint64_t value;
+            while (::read(_wakeup, &value, sizeof(value)) > 0);
+        });
+        add(_inotify, [this](uint32_t) { readNotifications(); });
+
+        start();
+    }
+
+    ~Reactor() {
+        stop();
+        ::close(_inotify);
+        ::close(_wakeup);
+        ::close(_epoll);
+    }
+
+    void start() {
+        _isOn = true;
+        _thread = std::thread([this] () {
+            while (_isOn) {
+                poll();
+            }
+            runTasks();
+        });
+    }
+
+    /**
+     * Stops the loop and waits for the reactor thread to finish.
+     */
+    void stop() {
+        if (!_thread.joinable()) {
+            return;
+        }
+        post([this] () { _isOn = false; });
+        _thread.join();
+    }
+
+    bool isReactorThread() const {
+        return std::this_thread::get_id() == _thread.get_id();
+    }
+
+    /**
+     * Queues a task to be run on the reactor thread. Thread-safe.
+     */
+    void post(Task task) {
+        {
+            std::lock_guard<std::mutex> g(_mtx);
+            _tasks.emplace_back(std::move(task));
+        }
+        uint64_t value = 1;
+        ::write(_wakeup, &value, sizeof(value));
+    }
+
+    /**
+     * Runs the task on the reactor thread and waits for it to complete.
+     */
+    void call(Task task) {
+        if (isReactorThread() || !_thread.joinable()) {
+            task();
+            return;
+        }
+        std::promise<void> done;
+        post([&task, &done] () {
+            task();
+            done.set_value();
+        });
+        done.get_future().wait();
+    }
+
+    /**
+     * Registers a handler for readability of the descriptor.
+     *
+     * @return False if the descriptor can't be polled, e.g. a regular file.
+     */
+    bool add(int fd, Handler handler) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (::epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+            return false;
+        }
+        _handlers[fd] = std::move(handler);
+        return true;
+    }
+
+    /**
+     * Also calls the descriptor's handler when it is writable, or stops doing so.
+     */
+    void pollWritable(int fd, bool writable) {
+        epoll_event event{};
+        event.events = writable ? EPOLLIN | EPOLLOUT : EPOLLIN;
+        event.data.fd = fd;
+        ::epoll_ctl(_epoll, EPOLL_CTL_MOD, fd, &event);
+    }
+
+    /**
+     * Stops polling the descriptor, keeping its handler, until resume().
+     */
+    void pause(int fd) {
+        ::epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    void resume(int fd) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        ::epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    void remove(int fd) {
+        ::epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, nullptr);
+        _handlers.erase(fd);
+    }
+
+    /**
+     * Calls the handler on the inotify events of the mask, by default
+     * whenever the file at the path is modified. Watches of the same file
+     * or directory share its inotify watch and get each other's events.
+     *
+     * @return Id of the watch, or -1 on failure.
+     */
+    int watch(const std::string& path, Task onEvent, uint32_t mask = IN_MODIFY) {
+        int wd = ::inotify_add_watch(_inotify, path.c_str(), mask | IN_MASK_ADD);
+        if (wd < 0) {
+            return -1;
+        }
+        int id = _nextWatchId++;
+        _watches[wd][id] = std::move(onEvent);
+        _watchIds[id] = wd;
+        return id;
+    }
+
+    void unwatch(int id) {
+        auto it = _watchIds.find(id);
+        if (it == _watchIds.end()) {
+            return;
+        }
+        auto& handlers = _watches[it->second];
+        handlers.erase(id);
+        if (handlers.empty()) {
+            ::inotify_rm_watch(_inotify, it->second);
+            _watches.erase(it->second);
+        }
+        _watchIds.erase(it);
+    }
+
+private:
+
+    static constexpr int kMaxEvents = 64;
+
+    void poll() {
+
+        bool hasTasks;
+        {
+            std::lock_guard<std::mutex> g(_mtx);
+            hasTasks = !_tasks.empty();
+        }
+
+        epoll_event events[kMaxEvents];
+        int cnt = ::epoll_wait(_epoll, events, kMaxEvents, hasTasks ? 0 : -1);
+
+        for (int i = 0; i < cnt; i++) {
+            // Handler may have been removed by a previous one.
+            auto it = _handlers.find(events[i].data.fd);
+            if (it != _handlers.end()) {
+                auto handler = it->second;
+                handler(events[i].events);
+            }
+        }
+
+        runTasks();
+    }
+
+    void runTasks() {
+        std::vector<Task> tasks;
+        {
+            std::lock_guard<std::mutex> g(_mtx);
+            tasks.swap(_tasks);
+        }
+        for (auto& task : tasks) {
+            task();
+        }
+    }
+
+    void readNotifications() {
+
+        alignas(inotify_event) char buffer[4096];
+        ssize_t size;
+        while ((size = ::read(_inotify, buffer, sizeof(buffer))) > 0) {
+            for (char* ptr = buffer; ptr < buffer + size; ) {
+                auto event = reinterpret_cast<inotify_event*>(ptr);
+                ptr += sizeof(inotify_event) + event->len;
+                auto it = _watches.find(event->wd);
+                if (it == _watches.end()) {
+                    continue;
+                }
+
+                // Handlers may unwatch
+                std::vector<Task> handlers;
+                for (const auto& handler : it->second) {
+                    handlers.push_back(handler.second);
+                }
+                if (event->mask & IN_IGNORED) {
+                    // Removed with its file, the descriptor may be reused
+                    for (const auto& handler : it->second) {
+                        _watchIds.erase(handler.first);
+                    }
+                    _watches.erase(it);
+                }
+                for (const auto& handler : handlers) {
+                    handler();
+                }
+            }
+        }
+    }
+
+    int                             _epoll{-1};
+    int                             _wakeup{-1};
+    int                             _inotify{-1};
+    std::atomic<bool>               _isOn{false};
+    std::thread                     _thread;
+    std::mutex                      _mtx;
+    std::vector<Task>               _tasks;
+    std::map<int, Handler>          _handlers;
+    //! Handlers by inotify watch descriptor and watch id.
+    std::map<int, std::map<int, Task>> _watches;
+    std::map<int, int>              _watchIds;
+    int                             _nextWatchId{0};
+};
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <cctype>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Log.hpp"
+
+/**
+ * Joins lines into records, like a message followed by its stack trace,
+ * so a record is classified once and stored and shown as a unit.
+ *
+ * A rule decides whether a line starts a new record or continues the
+ * current one:
+ *
+ *     indent    - lines starting with a space or a tab continue
+ *     timestamp - lines starting with a date or a time start a record
+ *     <regex>   - lines starting with a match of the regex start a record
+ *
+ * The lines of a record are separated by newlines. Records are limited in
+ * lines and size, so a rule which never matches can't join the whole input.
+ */
+class RecordAssembler {
+
+public:
+
+    static constexpr size_t kMaxLines = 1024u;
+    static constexpr size_t kMaxSize = 1024u * 1024u;
+
+    explicit RecordAssembler(const std::string& rule) {
+        if (rule == "indent") {
+            _rule = Rule::Indent;
+        }
+        else if (rule == "timestamp") {
+            _rule = Rule::Timestamp;
+        }
+        else {
+            _rule = Rule::Start;
+            try {
+                _start = std::make_unique<std::regex>(rule);
+            }
+            catch (const std::regex_error& e) {
+                LOG("Invalid record rule " << rule << ": " << e.what());
+            }
+        }
+    }
+
+    bool isValid() const {
+        return _rule != Rule::Start || _start != nullptr;
+    }
+
+    /**
+     * Adds lines, keeping the last record open for the following lines.
+     *
+     * @param last Closes the last record too, as no lines follow.
+     * @return Complete records, valid until the next call.
+     */
+    const std::vector<std::string_view>& add(const std::vector<std::string_view>& lines, bool last = false) {
+
+        _records.clear();
+        _storage.clear();
+
+        for (const auto& line : lines) {
+            if (_hasPending && continues(line) && _lineCnt < kMaxLines
+                && (_joined ? _buffer.size() : getPending().size()) + 1u + line.size() <= kMaxSize) {
+                if (!_joined) {
+                    _buffer.assign(getPending());
+                    _joined = true;
+                }
+                _buffer.push_back('\n');
+                _buffer.append(line);
+                _lineCnt++;
+                continue;
+            }
+            emit();
+            _pending = line;
+            _hasPending = true;
+            _lineCnt = 1u;
+        }
+
+        if (last) {
+            emit();
+        }
+
+        // The lines are only valid during the call
+        if (_hasPending && !_joined && !_carried) {
+            _carry.assign(_pending);
+            _carried = true;
+        }
+
+        return _records;
+    }
+
+    /**
+     * @return The open record, if any, valid until the next call.
+     */
+    const std::vector<std::string_view>& flush() {
+        return add({}, true);
+    }
+
+    /**
+     * @return True if the line starts with a date, like 2024-01-31, or a
+     *         time, like 12:30:00 or Jan 31 12:30:00, optionally in brackets.
+     */
+    static bool isTimestamp(std::string_view line) {
+
+        auto digits = [&line] (size_t first, size_t cnt) {
+            if (line.size() < first + cnt) {
+                return false;
+            }
+            for (size_t i = first; i < first + cnt; i++) {
+                if (!std::isdigit(static_cast<unsigned char>(line[i]))) {
+                    return false;
+                }
+            }
+            return true;
+        };
+        auto is = [&line] (size_t i, const char* chars) {
+            return i < line.size() && std::strchr(chars, line[i]) != nullptr && line[i] != '\0';
+        };
+
+        if (!line.empty() && line[0] == '[') {
+            line.remove_prefix(1u);
+        }
+
+        if (digits(0u, 4u) && is(4u, "-/") && digits(5u, 2u)) {
+            return true;
+        }
+        if (digits(0u, 2u) && is(2u, ":") && digits(3u, 2u) && is(5u, ":")) {
+            return true;
+        }
+        // Syslog, "Jan  1 00:00:00"
+        return line.size() >= 7u && std::isupper(static_cast<unsigned char>(line[0]))
+            && std::islower(static_cast<unsigned char>(line[1])) && std::islower(static_cast<unsigned char>(line[2]))
+            && line[3] == ' ' && (line[4] == ' ' || digits(4u, 1u)) && digits(5u, 1u) && line[6] == ' ';
+    }
+
+private:
+
+    enum class Rule { Indent, Timestamp, Start };
+
+    bool continues(std::string_view line) const {
+        switch (_rule) {
+            case Rule::Indent:
+                return !line.empty() && (line[0] == ' ' || line[0] == '\t');
+            case Rule::Timestamp:
+                return !isTimestamp(line);
+            case Rule::Start:
+                return _start == nullptr
+                    || !std::regex_search(line.begin(), line.end(), *_start, std::regex_constants::match_continuous);
+        }
+        return false;
+    }
+
+    std::string_view getPending() const {
+        return _carried ? std::string_view(_carry) : _pending;
+    }
+
+    void emit() {
+
+        if (!_hasPending) {
+            return;
+        }
+
+        if (_joined) {
+            _storage.emplace_back(std::move(_buffer));
+            _records.emplace_back(_storage.back());
+            _buffer.clear();
+        }
+        else if (_carried) {
+            _storage.emplace_back(_carry);
+            _records.emplace_back(_storage.back());
+        }
+        else {
+            _records.emplace_back(_pending);
+        }
+
+        _hasPending = false;
+        _joined = false;
+        _carried = false;
+    }
+
+    Rule                            _rule;
+    std::unique_ptr<std::regex>     _start;
+
+    //! First line of the open record, while it has no continuation.
+    std::string_view                _pending;
+    bool                            _hasPending{false};
+    //! Open record of several lines.
+    std::string                     _buffer;
+    bool                            _joined{false};
+    //! First line of the open record, kept from the previous call.
+    std::string                     _carry;
+    bool                            _carried{false};
+    size_t                          _lineCnt{0u};
+
+    std::vector<std::string_view>   _records;
+    //! Records not backed by the lines of the current call.
+    std::deque<std::string>         _storage;
+};
@@ -0,0 +1,385 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "Log.hpp"
+
+/**
+ * Lines of the inputs as they arrived, with their arrival times, so the
+ * same traffic can be fed to the model again.
+ *
+ * The file starts with a magic, followed by records of two kinds:
+ *
+ *     input: type 0, u8 id, u16 name length, name
+ *     batch: type 1, u64 microseconds since the start, u8 input id,
+ *            u32 line count, u32 body size, body
+ *
+ * The body holds each line as a varint length followed by the line. A
+ * batch keeps the lines which arrived together, preserving bursts.
+ */
+namespace Recording {
+
+static constexpr char kMagic[8] = {'L', 'G', 'Z', 'R', 'E', 'C', '1', '\n'};
+
+enum class Record : uint8_t { Input = 0, Batch = 1 };
+
+//! Bytes of the fixed part of a batch record, after its type.
+static constexpr size_t kBatchHeaderSize = sizeof(uint64_t) + sizeof(uint8_t) + 2u * sizeof(uint32_t);
+
+} // namespace Recording
+
+class Recorder {
+
+public:
+
+    explicit Recorder(const std::string& filename) {
+        _fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (_fd < 0) {
+            LOG("Failed to create recording " << filename);
+            return;
+        }
+        _buffer.append(Recording::kMagic, sizeof(Recording::kMagic));
+    }
+
+    ~Recorder() {
+        if (_fd >= 0) {
+            flushLocked();
+            ::close(_fd);
+        }
+    }
+
+    bool isOpen() const {
+        return _fd >= 0;
+    }
+
+    //! @return Id of the input in the recording.
+    uint8_t addInput(const std::string& name) {
+        std::lock_guard<std::mutex> g(_mtx);
+        uint8_t id = _inputCnt++;
+        _buffer.push_back(static_cast<char>(Recording::Record::Input));
+        _buffer.push_back(static_cast<char>(id));
+        put<uint16_t>(name.size());
+        _buffer.append(name);
+        return id;
+    }
+
+    /**
+     * Records lines which arrived at the input. Thread-safe.
+     */
+    void record(uint8_t input, const std::vector<std::string_view>& lines) {
+
+        uint64_t time = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - _start).count();
+
+        std::lock_guard<std::mutex> g(_mtx);
+        if (_fd < 0) {
+            return;
+        }
+
+        _buffer.push_back(static_cast<char>(Recording::Record::Batch));
+        put(time);
+        put(input);
+        put<uint32_t>(lines.size());
+        size_t sizeOffset = _buffer.size();
+        put<uint32_t>(0u);
+
+        size_t bodyStart = _buffer.size();
+        for (const auto& line : lines) {
+            putVarint(line.size());
+            _buffer.append(line);
+        }
+        uint32_t bodySize = _buffer.size() - bodyStart;
+        std::memcpy(&_buffer[sizeOffset], &bodySize, sizeof(bodySize));
+
+        if (_buffer.size() >= kFlushSize) {
+            flushLocked();
+        }
+    }
+
+private:
+
+    static constexpr size_t kFlushSize = 1024u * 1024u;
+
+    template <typename T>
+    void put(T value) {
+        _buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void putVarint(size_t value) {
+        while (value >= 0x80u) {
+            _buffer.push_back(static_cast<char>(value | 0x80u));
+            value >>= 7u;
+        }
+        _buffer.push_back(static_cast<char>(value));
+    }
+
+    void flushLocked() {
+        size_t offset = 0u;
+        while (offset < _buffer.size()) {
+            ssize_t written = ::write(_fd, _buffer.data() + offset, _buffer.size() - offset);
+            if (written <= 0) {
+                LOG("Failed to write recording");
+                break;
+            }
+            offset += written;
+        }
+        _buffer.clear();
+    }
+
+    std::mutex _mtx;
+    int _fd{-1};
+    uint8_t _inputCnt{0};
+    std::string _buffer;
+    std::chrono::steady_clock::time_point _start{std::chrono::steady_clock::now()};
+};
+
+/**
+ * Feeds a recording to the inputs with the recorded timing, scaled by
+ * the speed, or as fast as possible.
+ */
+class Replayer {
+
+public:
+
+    using OnLines = std::function<void(const std::vector<std::string_view>&)>;
+
+    //! Replays without waiting between batches.
+    static constexpr double kMaxSpeed = 0.0;
+
+    /**
+     * Parses a speed factor, or "max" for kMaxSpeed.
+     */
+    static bool parseSpeed(const std::string& spec, double* speed) {
+        if (spec == "max") {
+            *speed = kMaxSpeed;
+            return true;
+        }
+        char* end = nullptr;
+        *speed = std::strtod(spec.c_str(), &end);
+        return !spec.empty() && *end == '\0' && *speed > 0.0;
+    }
+
+    Replayer(const std::string& filename, double speed)
+        : _speed(speed) {
+        open(filename);
+    }
+
+    ~Replayer() {
+        stop();
+        if (_data != nullptr) {
+            ::munmap(const_cast<char*>(_data), _size);
+        }
+    }
+
+    bool isOpen() const {
+        return _data != nullptr;
+    }
+
+    //! @return Names of the recorded inputs, by their ids.
+    const std::vector<std::string>& getInputs() const {
+        return _inputs;
+    }
+
+    /**
+     * Starts feeding the lines of each input to its callback.
+     *
+     * @param onStop Called once all lines were fed.
+     */
+    void start(std::vector<OnLines> onLines, std::function<void()> onStop) {
+        _thread = std::thread([this, onLines, onStop] () {
+            auto start = std::chrono::steady_clock::now();
+            replay(start, onLines);
+            _duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start);
+            onStop();
+        });
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> g(_mtx);
+            _stopped = true;
+        }
+        _stopping.notify_all();
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+    }
+
+    //! @return Lines fed so far.
+    size_t getLineCnt() const {
+        return _lineCnt;
+    }
+
+    //! @return Time the replay took, once it has finished.
+    std::chrono::milliseconds getDuration() const {
+        return _duration;
+    }
+
+private:
+
+    void open(const std::string& filename) {
+
+        int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat status;
+        if (fd < 0 || ::fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) < sizeof(Recording::kMagic)) {
+            LOG("Failed to open recording " << filename);
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            return;
+        }
+
+        _size = status.st_size;
+        void* data = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            return;
+        }
+        _data = static_cast<const char*>(data);
+
+        if (std::memcmp(_data, Recording::kMagic, sizeof(Recording::kMagic)) != 0 || !readInputs()) {
+            LOG("Invalid recording " << filename);
+            ::munmap(data, _size);
+            _data = nullptr;
+        }
+    }
+
+    template <typename T>
+    bool get(size_t* offset, T* value) const {
+        if (_size - *offset < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(value, _data + *offset, sizeof(T));
+        *offset += sizeof(T);
+        return true;
+    }
+
+    bool getVarint(size_t* offset, size_t end, size_t* value) const {
+        *value = 0u;
+        for (unsigned shift = 0u; *offset < end && shift < 64u; shift += 7u) {
+            uint8_t byte = _data[(*offset)++];
+            *value |= static_cast<size_t>(byte & 0x7fu) << shift;
+            if ((byte & 0x80u) == 0u) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Collects the inputs, skipping over the batches.
+     */
+    bool readInputs() {
+
+        size_t offset = sizeof(Recording::kMagic);
+        while (offset < _size) {
+            uint8_t type;
+            get(&offset, &type);
+            if (type == static_cast<uint8_t>(Recording::Record::Input)) {
+                uint8_t id;
+                uint16_t length;
+                if (!get(&offset, &id) || !get(&offset, &length) || _size - offset < length || id != _inputs.size()) {
+                    return false;
+                }
+                _inputs.emplace_back(_data + offset, length);
+                offset += length;
+            }
+            else if (type == static_cast<uint8_t>(Recording::Record::Batch)) {
+                uint32_t bodySize;
+                if (_size - offset < Recording::kBatchHeaderSize) {
+                    return false;
+                }
+                offset += Recording::kBatchHeaderSize - sizeof(bodySize);
+                if (!get(&offset, &bodySize) || _size - offset < bodySize) {
+                    return false;
+                }
+                offset += bodySize;
+            }
+            else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void replay(std::chrono::steady_clock::time_point start, const std::vector<OnLines>& onLines) {
+
+        std::vector<std::string_view> lines;
+        size_t offset = sizeof(Recording::kMagic);
+
+        while (offset < _size) {
+
+            uint8_t type;
+            get(&offset, &type);
+            if (type == static_cast<uint8_t>(Recording::Record::Input)) {
+                uint16_t length;
+                offset += sizeof(uint8_t);
+                get(&offset, &length);
+                offset += length;
+                continue;
+            }
+
+            uint64_t time;
+            uint8_t input;
+            uint32_t cnt, bodySize;
+            get(&offset, &time);
+            get(&offset, &input);
+            get(&offset, &cnt);
+            get(&offset, &bodySize);
+            size_t end = offset + bodySize;
+
+            lines.clear();
+            size_t length;
+            while (lines.size() < cnt && getVarint(&offset, end, &length) && end - offset >= length) {
+                lines.emplace_back(_data + offset, length);
+                offset += length;
+            }
+            offset = end;
+
+            if (_speed != kMaxSpeed) {
+                auto due = start + std::chrono::microseconds(static_cast<uint64_t>(time / _speed));
+                std::unique_lock<std::mutex> lock(_mtx);
+                if (_stopping.wait_until(lock, due, [this] () { return _stopped.load(); })) {
+                    return;
+                }
+            }
+            else if (_stopped) {
+                return;
+            }
+
+            if (input < onLines.size()) {
+                onLines[input](lines);
+                _lineCnt += lines.size();
+            }
+        }
+    }
+
+    double _speed;
+    const char* _data{nullptr};
+    size_t _size{0u};
+    std::vector<std::string> _inputs;
+    std::atomic<size_t> _lineCnt{0u};
+    std::atomic<std::chrono::milliseconds> _duration{std::chrono::milliseconds(0)};
+
+    std::mutex _mtx;
+    std::condition_variable _stopping;
+    std::atomic<bool> _stopped{false};
+    std::thread _thread;
+};
@@ -0,0 +1,419 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "IDataModel.hpp"
+#include "Log.hpp"
+#include "SessionProtocol.hpp"
+
+/**
+ * Data model of a session running in another process, attached over its
+ * Unix socket.
+ *
+ * Only the lines being shown are transferred, so attaching takes the same
+ * time however many lines the session holds. Requests are answered on one
+ * connection, while a second one waits for the session to report new data,
+ * which is then passed on to the listener.
+ *
+ * The viewer only reads the session, lines are added by its inputs.
+ */
+class RemoteDataModel : public IDataModel {
+
+public:
+
+    explicit RemoteDataModel(const std::string& path) {
+        _requests = connect(path);
+        _waits = connect(path);
+        if (isOpen()) {
+            _waiter = std::thread([this] () { waitForData(); });
+        }
+    }
+
+    ~RemoteDataModel() {
+        stop();
+        for (int fd : {_requests, _waits}) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+    }
+
+    /**
+     * Stops waiting for new data, after which the listener isn't called.
+     */
+    void stop() {
+        _isOn = false;
+        if (_waits >= 0) {
+            ::shutdown(_waits, SHUT_RDWR);
+        }
+        if (_waiter.joinable()) {
+            _waiter.join();
+        }
+    }
+
+    bool isOpen() const {
+        return _requests >= 0 && _waits >= 0;
+    }
+
+    bool scrollUp() {
+        return requestResult(SessionProtocol::Encoder(Request::ScrollUp));
+    }
+
+    bool scrollDown() {
+        return requestResult(SessionProtocol::Encoder(Request::ScrollDown));
+    }
+
+    bool scrollTo(size_t position) {
+        SessionProtocol::Encoder request(Request::ScrollTo);
+        request.put<uint64_t>(position);
+        return requestResult(request);
+    }
+
+    size_t getPosition() {
+        std::lock_guard<std::mutex> g(_mtx);
+        updateStateLocked();
+        return _position;
+    }
+
+    size_t getVisibleCnt() {
+        std::lock_guard<std::mutex> g(_mtx);
+        updateStateLocked();
+        return _visibleCnt;
+    }
+
+    void prepareLines() {
+        std::lock_guard<std::mutex> g(_mtx);
+        updateStateLocked();
+        _lines.clear();
+        _nextLine = 0u;
+        _linesPosition = _position;
+        _hasMoreLines = _visibleCnt > 0u;
+    }
+
+    LogLine nextLine() {
+
+        std::lock_guard<std::mutex> g(_mtx);
+
+        if (_nextLine == _lines.size() && _hasMoreLines) {
+            fetchLinesLocked();
+        }
+        if (_nextLine == _lines.size()) {
+            return {};
+        }
+        return _lines[_nextLine++];
+    }
+
+    bool exportVisible(const std::string& filename, size_t* exported) {
+
+        // The session may run in another directory
+        std::string path = filename;
+        char cwd[PATH_MAX];
+        if (!filename.empty() && filename[0] != '/' && ::getcwd(cwd, sizeof(cwd)) != nullptr) {
+            path = std::string(cwd) + "/" + filename;
+        }
+
+        SessionProtocol::Encoder request(Request::Export);
+        request.put(path);
+
+        std::lock_guard<std::mutex> g(_mtx);
+        std::string response;
+        if (!requestLocked(request, &response)) {
+            return false;
+        }
+
+        SessionProtocol::Decoder decoder(response);
+        uint8_t success;
+        uint64_t cnt;
+        if (!decoder.get(&success) || !decoder.get(&cnt)) {
+            return false;
+        }
+        *exported = cnt;
+        return success != 0u;
+    }
+
+    void loadHistory() {
+        requestResult(SessionProtocol::Encoder(Request::History));
+    }
+
+    RelatedInfo scrollToRelated(bool backwards = false) {
+        SessionProtocol::Encoder request(Request::Related);
+        request.put<uint8_t>(backwards);
+        std::lock_guard<std::mutex> g(_mtx);
+        _stateValid = false;
+        return requestRelatedLocked(request);
+    }
+
+    RelatedInfo getRelated(size_t cnt) {
+        SessionProtocol::Encoder request(Request::RelatedLines);
+        request.put<uint32_t>(std::min<size_t>(cnt, kLinesPerRequest));
+        std::lock_guard<std::mutex> g(_mtx);
+        return requestRelatedLocked(request);
+    }
+
+    std::string getText(size_t lineId) {
+        SessionProtocol::Encoder request(Request::Text);
+        request.put<uint64_t>(lineId);
+        std::lock_guard<std::mutex> g(_mtx);
+        std::string response, text;
+        if (requestLocked(request, &response)) {
+            SessionProtocol::Decoder(response).get(&text);
+        }
+        return text;
+    }
+
+    bool startQuery(const std::string& regex) {
+        SessionProtocol::Encoder request(Request::Query);
+        request.put(regex);
+        return requestResult(request);
+    }
+
+    void toggleTab(uint8_t src) {
+        SessionProtocol::Encoder request(Request::ToggleTab);
+        request.put(src);
+        requestResult(request);
+    }
+
+    Tab getTab(uint8_t src) {
+        std::lock_guard<std::mutex> g(_mtx);
+        updateStateLocked();
+        return src < _tabs.size() ? _tabs[src] : Tab{};
+    }
+
+    uint8_t getTabCnt() {
+        std::lock_guard<std::mutex> g(_mtx);
+        updateStateLocked();
+        return _tabs.size();
+    }
+
+    std::vector<TemplateInfo> getTemplates() {
+        return requestList<TemplateInfo>(Request::Templates);
+    }
+
+    std::vector<FieldInfo> getFields() {
+        return requestList<FieldInfo>(Request::Fields);
+    }
+
+    std::vector<FilterInfo> getFilters() {
+        return requestList<FilterInfo>(Request::Filters);
+    }
+
+    void registerOnNewDataAvailableListener(std::function<void()> listener) {
+        std::lock_guard<std::mutex> g(_mtx);
+        _onNewDataAvailable = listener;
+    }
+
+    uint8_t addFilter(const std::string&, const std::string&) {
+        return 0u;
+    }
+
+    bool addExternal(const std::string&, const std::string&, bool) {
+        return false;
+    }
+
+    uint8_t addSource(const std::string&) {
+        return 0u;
+    }
+
+    void addDropped(uint8_t, size_t) {}
+
+    void setSampling(const std::string&, size_t) {}
+
+    std::function<void(std::string)> getAppender(std::string) {
+        return [](std::string) {};
+    }
+
+    std::function<void(const std::vector<std::string_view>&)> getBatchAppender(std::string) {
+        return [](const std::vector<std::string_view>&) {};
+    }
+
+    void addLine(const std::string&, uint8_t) {}
+
+    void addLines(const std::vector<std::string_view>&, uint8_t) {}
+
+private:
+
+    using Request = SessionProtocol::Request;
+
+    static constexpr uint64_t kUndefined = std::numeric_limits<uint64_t>::max();
+    //! Lines fetched at once, enough to fill a screen.
+    static constexpr uint32_t kLinesPerRequest = 128u;
+
+    static int connect(const std::string& path) {
+
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) {
+            LOG("Socket path too long: " << path);
+            return -1;
+        }
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1u);
+
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            LOG("Failed to attach to " << path);
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    bool requestLocked(SessionProtocol::Encoder& request, std::string* response) {
+        return _requests >= 0
+            && SessionProtocol::writeAll(_requests, request.getFrame())
+            && SessionProtocol::readFrame(_requests, response);
+    }
+
+    //! Sends a request which changes the view and answers with a flag.
+    bool requestResult(SessionProtocol::Encoder request) {
+
+        std::lock_guard<std::mutex> g(_mtx);
+        _stateValid = false;
+
+        std::string response;
+        uint8_t result;
+        return requestLocked(request, &response)
+            && SessionProtocol::Decoder(response).get(&result)
+            && result != 0u;
+    }
+
+    RelatedInfo requestRelatedLocked(SessionProtocol::Encoder& request) {
+        std::string response;
+        RelatedInfo info;
+        if (requestLocked(request, &response)) {
+            SessionProtocol::Decoder decoder(response);
+            SessionProtocol::decode(&decoder, &info);
+        }
+        return info;
+    }
+
+    template <typename T>
+    std::vector<T> requestList(Request type) {
+
+        std::lock_guard<std::mutex> g(_mtx);
+        SessionProtocol::Encoder request(type);
+        std::string response;
+        std::vector<T> list;
+        if (!requestLocked(request, &response)) {
+            return list;
+        }
+
+        SessionProtocol::Decoder decoder(response);
+        uint32_t cnt;
+        if (!decoder.get(&cnt)) {
+            return list;
+        }
+        for (uint32_t i = 0; i < cnt; i++) {
+            T item;
+            if (!SessionProtocol::decode(&decoder, &item)) {
+                break;
+            }
+            list.emplace_back(std::move(item));
+        }
+        return list;
+    }
+
+    void updateStateLocked() {
+
+        if (_stateValid) {
+            return;
+        }
+
+        SessionProtocol::Encoder request(Request::State);
+        std::string response;
+        if (!requestLocked(request, &response)) {
+            return;
+        }
+
+        SessionProtocol::Decoder decoder(response);
+        uint64_t cnt, position;
+        uint8_t tabCnt;
+        if (!decoder.get(&cnt) || !decoder.get(&position) || !decoder.get(&tabCnt)) {
+            return;
+        }
+
+        _visibleCnt = cnt;
+        _position = position;
+        _tabs.resize(tabCnt);
+        for (auto& tab : _tabs) {
+            SessionProtocol::decode(&decoder, &tab);
+        }
+        _stateValid = true;
+    }
+
+    void fetchLinesLocked() {
+
+        SessionProtocol::Encoder request(Request::Lines);
+        request.put<uint64_t>(_linesPosition).put(kLinesPerRequest);
+
+        std::string response;
+        uint32_t cnt = 0u;
+        _lines.clear();
+        _nextLine = 0u;
+        if (requestLocked(request, &response)) {
+            SessionProtocol::Decoder decoder(response);
+            decoder.get(&cnt);
+            _lines.resize(cnt);
+            for (auto& line : _lines) {
+                SessionProtocol::decode(&decoder, &line);
+            }
+        }
+
+        _linesPosition += cnt;
+        _hasMoreLines = cnt == kLinesPerRequest;
+    }
+
+    void waitForData() {
+
+        uint64_t version = 0u;
+
+        while (_isOn) {
+            SessionProtocol::Encoder request(Request::Wait);
+            request.put(version);
+            std::string response;
+            if (!SessionProtocol::writeAll(_waits, request.getFrame())
+                || !SessionProtocol::readFrame(_waits, &response)
+                || !SessionProtocol::Decoder(response).get(&version)) {
+                break;
+            }
+
+            std::function<void()> onNewDataAvailable;
+            {
+                std::lock_guard<std::mutex> g(_mtx);
+                _stateValid = false;
+                onNewDataAvailable = _onNewDataAvailable;
+            }
+            if (onNewDataAvailable) {
+                onNewDataAvailable();
+            }
+        }
+    }
+
+    int                             _requests{-1};
+    int                             _waits{-1};
+    std::atomic<bool>               _isOn{true};
+    std::thread                     _waiter;
+
+    std::mutex                      _mtx;
+    std::function<void()>           _onNewDataAvailable;
+
+    bool                            _stateValid{false};
+    size_t                          _visibleCnt{0u};
+    size_t                          _position{kUndefined};
+    std::vector<Tab>                _tabs;
+
+    std::vector<LogLine>            _lines;
+    size_t                          _nextLine{0u};
+    size_t                          _linesPosition{0u};
+    bool                            _hasMoreLines{false};
+};
@@ -0,0 +1,340 @@
+#pragma once
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "IDataModel.hpp"
+#include "LogLine.hpp"
+
+/**
+ * Binary protocol between a session daemon and attached viewers.
+ *
+ * Every message is a frame of a 32 bit payload length followed by the
+ * payload. A request starts with its type, the response to it carries
+ * only the result. Integers are in host byte order, as both ends are on
+ * the same machine, and strings are prefixed with their 32 bit length.
+ */
+namespace SessionProtocol {
+
+enum class Request : uint8_t {
+    //! -> visible count, position, tabs.
+    State = 1,
+    //! position, count -> lines.
+    Lines,
+    //! -> success.
+    ScrollUp,
+    //! -> success.
+    ScrollDown,
+    //! position -> success.
+    ScrollTo,
+    //! tab -> success.
+    ToggleTab,
+    //! -> templates.
+    Templates,
+    //! -> fields.
+    Fields,
+    //! -> filters.
+    Filters,
+    //! filename -> success, exported count.
+    Export,
+    //! version -> version, answered once data newer than the version arrives.
+    Wait,
+    //! -> success, older lines are reported like new ones.
+    History,
+    //! backwards -> related lines, without the lines.
+    Related,
+    //! count -> related lines.
+    RelatedLines,
+    //! regex -> success, progress is reported like new data.
+    Query,
+    //! line id -> full text.
+    Text,
+};
+
+static constexpr uint32_t kMaxFrameSize = 64u * 1024u * 1024u;
+//! Time a peer may block the writer before it is given up.
+static constexpr int kWriteTimeoutMs = 1000;
+
+class Encoder {
+
+public:
+
+    Encoder() : _frame(sizeof(uint32_t), '\0') {}
+
+    explicit Encoder(Request request) : Encoder() {
+        put(static_cast<uint8_t>(request));
+    }
+
+    template <typename T, typename = std::enable_if_t<std::is_arithmetic<T>::value>>
+    Encoder& put(T value) {
+        _frame.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        return *this;
+    }
+
+    Encoder& put(std::string_view value) {
+        put(static_cast<uint32_t>(value.size()));
+        _frame.append(value);
+        return *this;
+    }
+
+    //! @return Frame with the length prefix.
+    const std::string& getFrame() {
+        uint32_t size = _frame.size() - sizeof(uint32_t);
+        std::memcpy(&_frame[0], &size, sizeof(size));
+        return _frame;
+    }
+
+private:
+
+    std::string _frame;
+};
+
+class Decoder {
+
+public:
+
+    explicit Decoder(std::string_view payload) : _payload(payload) {}
+
+    template <typename T, typename = std::enable_if_t<std::is_arithmetic<T>::value>>
+    bool get(T* value) {
+        if (_payload.size() < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(value, _payload.data(), sizeof(T));
+        _payload.remove_prefix(sizeof(T));
+        return true;
+    }
+
+    bool get(std::string* value) {
+        uint32_t size;
+        if (!get(&size) || _payload.size() < size) {
+            return false;
+        }
+        value->assign(_payload.data(), size);
+        _payload.remove_prefix(size);
+        return true;
+    }
+
+private:
+
+    std::string_view _payload;
+};
+
+/**
+ * Writes all data to a socket, waiting for a non-blocking one to drain.
+ * A peer which went away fails the write instead of raising SIGPIPE.
+ */
+inline bool writeAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t written = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (written > 0) {
+            data.remove_prefix(written);
+        }
+        else if (written < 0 && errno == EAGAIN) {
+            pollfd writable{fd, POLLOUT, 0};
+            if (::poll(&writable, 1, kWriteTimeoutMs) <= 0) {
+                return false;
+            }
+        }
+        else if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline bool readAll(int fd, char* data, size_t size) {
+    while (size > 0u) {
+        ssize_t received = ::read(fd, data, size);
+        if (received > 0) {
+            data += received;
+            size -= received;
+        }
+        else if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Reads a frame from a blocking descriptor.
+ */
+inline bool readFrame(int fd, std::string* payload) {
+    uint32_t size;
+    if (!readAll(fd, reinterpret_cast<char*>(&size), sizeof(size)) || size > kMaxFrameSize) {
+        return false;
+    }
+    payload->resize(size);
+    return readAll(fd, &(*payload)[0], size);
+}
+
+/**
+ * Takes the first complete frame out of received data.
+ *
+ * @return False if the frame is incomplete.
+ */
+inline bool extractFrame(std::string* received, size_t* offset, std::string_view* payload) {
+    uint32_t size;
+    if (received->size() - *offset < sizeof(size)) {
+        return false;
+    }
+    std::memcpy(&size, received->data() + *offset, sizeof(size));
+    if (received->size() - *offset - sizeof(size) < size) {
+        return false;
+    }
+    *payload = std::string_view(received->data() + *offset + sizeof(size), size);
+    *offset += sizeof(size) + size;
+    return true;
+}
+
+inline void encode(Encoder* encoder, const Tab& tab) {
+    encoder->put(tab.name).put<uint8_t>(tab.enabled).put<uint64_t>(tab.rowsCnt)
+        .put<uint64_t>(tab.dropped).put<uint64_t>(tab.sampled).put(tab.warning)
+        .put(tab.indexed);
+}
+
+inline bool decode(Decoder* decoder, Tab* tab) {
+    uint8_t enabled;
+    uint64_t rowsCnt, dropped, sampled;
+    if (!decoder->get(&tab->name) || !decoder->get(&enabled) || !decoder->get(&rowsCnt)
+        || !decoder->get(&dropped) || !decoder->get(&sampled) || !decoder->get(&tab->warning)
+        || !decoder->get(&tab->indexed)) {
+        return false;
+    }
+    tab->enabled = enabled != 0u;
+    tab->rowsCnt = rowsCnt;
+    tab->dropped = dropped;
+    tab->sampled = sampled;
+    tab->valid = true;
+    return true;
+}
+
+inline void encode(Encoder* encoder, const LogLine& line) {
+    encoder->put<uint64_t>(line.id).put<uint8_t>(line.src).put(line.text).put(line.comment)
+        .put<uint64_t>(line.fullLength);
+}
+
+inline bool decode(Decoder* decoder, LogLine* line) {
+    uint64_t id, fullLength;
+    uint8_t src;
+    if (!decoder->get(&id) || !decoder->get(&src) || !decoder->get(&line->text) || !decoder->get(&line->comment)
+        || !decoder->get(&fullLength)) {
+        return false;
+    }
+    line->id = id;
+    line->src = src;
+    line->fullLength = fullLength;
+    line->valid = true;
+    return true;
+}
+
+inline void encode(Encoder* encoder, const TemplateInfo& info) {
+    encoder->put(info.text).put<uint64_t>(info.count);
+}
+
+inline bool decode(Decoder* decoder, TemplateInfo* info) {
+    uint64_t count;
+    if (!decoder->get(&info->text) || !decoder->get(&count)) {
+        return false;
+    }
+    info->count = count;
+    return true;
+}
+
+inline void encode(Encoder* encoder, const FieldInfo& info) {
+    encoder->put(info.name).put<uint8_t>(info.tab).put<uint8_t>(info.numeric)
+        .put<uint64_t>(info.count).put<uint64_t>(info.invalid)
+        .put(info.sum).put(info.min).put(info.max).put(info.p50).put(info.p99)
+        .put<uint32_t>(info.top.size());
+    for (const auto& top : info.top) {
+        encoder->put(top.first).put<uint64_t>(top.second);
+    }
+}
+
+inline bool decode(Decoder* decoder, FieldInfo* info) {
+    uint8_t numeric;
+    uint64_t count, invalid;
+    uint32_t topCnt;
+    if (!decoder->get(&info->name) || !decoder->get(&info->tab) || !decoder->get(&numeric)
+        || !decoder->get(&count) || !decoder->get(&invalid)
+        || !decoder->get(&info->sum) || !decoder->get(&info->min) || !decoder->get(&info->max)
+        || !decoder->get(&info->p50) || !decoder->get(&info->p99) || !decoder->get(&topCnt)) {
+        return false;
+    }
+    info->numeric = numeric != 0u;
+    info->count = count;
+    info->invalid = invalid;
+    for (uint32_t i = 0; i < topCnt; i++) {
+        std::string value;
+        uint64_t valueCount;
+        if (!decoder->get(&value) || !decoder->get(&valueCount)) {
+            return false;
+        }
+        info->top.emplace_back(std::move(value), valueCount);
+    }
+    return true;
+}
+
+inline void encode(Encoder* encoder, const FilterInfo& info) {
+    encoder->put(info.name).put<uint8_t>(info.tab).put<uint64_t>(info.tried).put<uint64_t>(info.matched)
+        .put<uint64_t>(info.skipped).put(info.averageUs).put(info.maxUs).put(info.warning)
+        .put<uint8_t>(info.drop);
+}
+
+inline bool decode(Decoder* decoder, FilterInfo* info) {
+    uint64_t tried, matched, skipped;
+    uint8_t drop;
+    if (!decoder->get(&info->name) || !decoder->get(&info->tab) || !decoder->get(&tried)
+        || !decoder->get(&matched) || !decoder->get(&skipped) || !decoder->get(&info->averageUs)
+        || !decoder->get(&info->maxUs) || !decoder->get(&info->warning) || !decoder->get(&drop)) {
+        return false;
+    }
+    info->drop = drop != 0u;
+    info->tried = tried;
+    info->matched = matched;
+    info->skipped = skipped;
+    return true;
+}
+
+inline void encode(Encoder* encoder, const RelatedInfo& info) {
+    encoder->put(info.name).put(info.key).put<uint64_t>(info.position).put<uint64_t>(info.count)
+        .put<uint32_t>(info.lines.size());
+    for (const auto& line : info.lines) {
+        encode(encoder, line);
+    }
+}
+
+inline bool decode(Decoder* decoder, RelatedInfo* info) {
+    uint64_t position, count;
+    uint32_t lineCnt;
+    if (!decoder->get(&info->name) || !decoder->get(&info->key) || !decoder->get(&position)
+        || !decoder->get(&count) || !decoder->get(&lineCnt)) {
+        return false;
+    }
+    info->position = position;
+    info->count = count;
+    info->lines.resize(lineCnt);
+    for (auto& line : info->lines) {
+        if (!decode(decoder, &line)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace SessionProtocol
@@ -0,0 +1,510 @@
+#pragma once
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "DataModel.hpp"
+#include "Log.hpp"
+#include "Reactor.hpp"
+#include "SessionProtocol.hpp"
+
+/**
+ * Serves a session's data model to viewers attached over a Unix socket.
+ *
+ * Every connection has its own view, so viewers scroll and toggle tabs
+ * independently, only the query and its tab are shared. Requests only
+ * touch the lines being shown, so they take the same time regardless of
+ * how many lines the session holds. Requests are handled on the shared
+ * reactor, except exports, which run on a worker thread while the
+ * viewer's later requests wait for them. Responses are queued and sent as
+ * the viewer reads them, so a viewer which doesn't read never stalls the
+ * others.
+ */
+class SessionServer {
+
+public:
+
+    SessionServer(Reactor& reactor, DataModel& data, std::string path)
+        : _reactor(reactor)
+        , _data(data)
+        , _path(std::move(path)) {
+        if (open()) {
+            _reactor.call([this] () {
+                _reactor.add(_socket, [this](uint32_t) { accept(); });
+            });
+        }
+    }
+
+    ~SessionServer() {
+        stop();
+    }
+
+    /**
+     * @return True if a session is listening on the socket at the path.
+     */
+    static bool isRunning(const std::string& path) {
+
+        sockaddr_un addr{};
+        if (!getAddress(path, &addr)) {
+            return false;
+        }
+
+        int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool running = ::connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+        ::close(probe);
+        return running;
+    }
+
+    bool isOpen() const {
+        return _socket >= 0;
+    }
+
+    /**
+     * Answers viewers waiting for new data. Thread-safe.
+     */
+    void notify() {
+        _version++;
+        if (!_notifyPosted.exchange(true)) {
+            _reactor.post([this] () {
+                _notifyPosted = false;
+                answerWaiting();
+            });
+        }
+    }
+
+    void stop() {
+        std::vector<std::future<void>> exports;
+        _reactor.call([this, &exports] () {
+            exports.swap(_exports);
+            if (_socket < 0) {
+                return;
+            }
+            for (const auto& client : _clients) {
+                _reactor.remove(client.first);
+                ::close(client.first);
+            }
+            _clients.clear();
+            _reactor.remove(_socket);
+            ::close(_socket);
+            ::unlink(_path.c_str());
+            _socket = -1;
+        });
+
+        // Exports still running post responses, which find their viewers gone
+        for (auto& exporting : exports) {
+            exporting.wait();
+        }
+        _reactor.call([] () {});
+    }
+
+private:
+
+    using Request = SessionProtocol::Request;
+
+    static constexpr size_t kReadSize = 64u * 1024u;
+    static constexpr uint64_t kUndefined = std::numeric_limits<uint64_t>::max();
+    //! Most lines sent in one response.
+    static constexpr uint32_t kMaxLines = 4096u;
+
+    struct Client {
+        //! Tells the client apart from a later one reusing the descriptor.
+        uint64_t id{0};
+        std::string received;
+        //! Responses not yet taken by the viewer.
+        std::string output;
+        bool pollingWritable{false};
+        DataModel::View view;
+        bool waiting{false};
+        uint64_t waitVersion{0};
+        bool exporting{false};
+    };
+
+    static bool getAddress(const std::string& path, sockaddr_un* addr) {
+        addr->sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr->sun_path)) {
+            LOG("Socket path too long: " << path);
+            return false;
+        }
+        std::strncpy(addr->sun_path, path.c_str(), sizeof(addr->sun_path) - 1u);
+        return true;
+    }
+
+    bool open() {
+
+        sockaddr_un addr{};
+        if (!getAddress(_path, &addr)) {
+            return false;
+        }
+
+        // A socket left behind by a session which is gone may be replaced
+        struct stat status;
+        if (::lstat(_path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode) && !isRunning(_path)) {
+            ::unlink(_path.c_str());
+        }
+
+        _socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (_socket < 0) {
+            return false;
+        }
+
+        if (::bind(_socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+            || ::listen(_socket, SOMAXCONN) != 0) {
+            LOG("Failed to listen on " << _path);
+            ::close(_socket);
+            _socket = -1;
+            return false;
+        }
+
+        LOG("Session on " << _path);
+        return true;
+    }
+
+    void accept() {
+        int client = ::accept4(_socket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client >= 0) {
+            _clients[client].id = ++_lastClientId;
+            _reactor.add(client, [this, client](uint32_t events) { handleEvents(client, events); });
+        }
+    }
+
+    void handleEvents(int fd, uint32_t events) {
+        if ((events & EPOLLOUT) != 0u && !flush(fd, &_clients[fd])) {
+            close(fd);
+            return;
+        }
+        if ((events & ~EPOLLOUT) != 0u) {
+            receive(fd);
+        }
+    }
+
+    void close(int fd) {
+        _reactor.remove(fd);
+        ::close(fd);
+        _clients.erase(fd);
+    }
+
+    void receive(int fd) {
+
+        char buffer[kReadSize];
+        ssize_t size = ::read(fd, buffer, sizeof(buffer));
+        if (size == 0 || (size < 0 && errno != EAGAIN && errno != EINTR)) {
+            close(fd);
+            return;
+        }
+        if (size < 0) {
+            return;
+        }
+
+        _clients[fd].received.append(buffer, size);
+        handleReceived(fd);
+    }
+
+    void handleReceived(int fd) {
+
+        auto& client = _clients[fd];
+
+        size_t offset = 0u;
+        std::string_view request;
+        while (!client.exporting && SessionProtocol::extractFrame(&client.received, &offset, &request)) {
+            if (!handle(fd, &client, request)) {
+                close(fd);
+                return;
+            }
+        }
+        client.received.erase(0, offset);
+
+        if (client.received.size() > SessionProtocol::kMaxFrameSize) {
+            close(fd);
+        }
+    }
+
+    /**
+     * Queues the response and sends as much of the queue as the socket takes.
+     *
+     * @return False if the viewer is gone or doesn't read its responses.
+     */
+    bool send(int fd, Client* client, const std::string& frame) {
+        client->output.append(frame);
+        return flush(fd, client);
+    }
+
+    bool flush(int fd, Client* client) {
+
+        size_t sent = 0u;
+        while (sent < client->output.size()) {
+            ssize_t written = ::send(fd, client->output.data() + sent, client->output.size() - sent, MSG_NOSIGNAL);
+            if (written > 0) {
+                sent += written;
+            }
+            else if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            else if (written < 0 && errno == EAGAIN) {
+                break;
+            }
+            else {
+                return false;
+            }
+        }
+        client->output.erase(0, sent);
+
+        if (client->output.size() > SessionProtocol::kMaxFrameSize) {
+            LOG("Viewer " << fd << " doesn't read its responses");
+            return false;
+        }
+
+        bool pending = !client->output.empty();
+        if (pending != client->pollingWritable) {
+            _reactor.pollWritable(fd, pending);
+            client->pollingWritable = pending;
+        }
+        return true;
+    }
+
+    /**
+     * Exports the viewer's lines on a worker thread, its later requests
+     * are handled once the export is answered.
+     */
+    void startExport(int fd, Client* client, std::string filename) {
+
+        client->exporting = true;
+
+        for (auto it = _exports.begin(); it != _exports.end(); ) {
+            if (it->wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                it = _exports.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+
+        uint64_t id = client->id;
+        _exports.emplace_back(std::async(std::launch::async,
+            [this, fd, id, view = client->view, filename = std::move(filename)] () {
+                size_t exported = 0u;
+                bool success = _data.exportVisible(view, filename, &exported);
+                _reactor.post([this, fd, id, success, exported] () {
+                    auto it = _clients.find(fd);
+                    if (it == _clients.end() || it->second.id != id) {
+                        return;
+                    }
+                    it->second.exporting = false;
+                    SessionProtocol::Encoder response;
+                    response.put<uint8_t>(success).put<uint64_t>(exported);
+                    if (!send(fd, &it->second, response.getFrame())) {
+                        close(fd);
+                        return;
+                    }
+                    handleReceived(fd);
+                });
+            }));
+    }
+
+    bool handle(int fd, Client* client, std::string_view request) {
+
+        SessionProtocol::Decoder decoder(request);
+        SessionProtocol::Encoder response;
+        auto& view = client->view;
+
+        uint8_t type;
+        if (!decoder.get(&type)) {
+            return false;
+        }
+
+        switch (static_cast<Request>(type)) {
+
+            case Request::State: {
+                size_t cnt = _data.getVisibleCnt(view);
+                size_t position = cnt > 0u ? _data.getPosition(view) : kUndefined;
+                uint8_t tabCnt = _data.getTabCnt();
+                response.put<uint64_t>(cnt).put<uint64_t>(position).put(tabCnt);
+                for (uint8_t i = 0; i < tabCnt; i++) {
+                    SessionProtocol::encode(&response, _data.getTab(view, i));
+                }
+                break;
+            }
+
+            case Request::Lines: {
+                uint64_t position;
+                uint32_t cnt;
+                if (!decoder.get(&position) || !decoder.get(&cnt)) {
+                    return false;
+                }
+                auto lines = _data.getLines(view, position, std::min(cnt, kMaxLines));
+                response.put<uint32_t>(lines.size());
+                for (const auto& line : lines) {
+                    SessionProtocol::encode(&response, line);
+                }
+                break;
+            }
+
+            case Request::ScrollUp:
+                response.put<uint8_t>(_data.scrollUp(&view));
+                break;
+
+            case Request::ScrollDown:
+                response.put<uint8_t>(_data.scrollDown(&view));
+                break;
+
+            case Request::ScrollTo: {
+                uint64_t position;
+                if (!decoder.get(&position)) {
+                    return false;
+                }
+                response.put<uint8_t>(_data.scrollTo(&view, position));
+                break;
+            }
+
+            case Request::ToggleTab: {
+                uint8_t src;
+                if (!decoder.get(&src)) {
+                    return false;
+                }
+                _data.toggleTab(&view, src);
+                response.put<uint8_t>(1u);
+                break;
+            }
+
+            case Request::Templates: {
+                auto templates = _data.getTemplates();
+                response.put<uint32_t>(templates.size());
+                for (const auto& info : templates) {
+                    SessionProtocol::encode(&response, info);
+                }
+                break;
+            }
+
+            case Request::Fields: {
+                auto fields = _data.getFields();
+                response.put<uint32_t>(fields.size());
+                for (const auto& info : fields) {
+                    SessionProtocol::encode(&response, info);
+                }
+                break;
+            }
+
+            case Request::Filters: {
+                auto filters = _data.getFilters();
+                response.put<uint32_t>(filters.size());
+                for (const auto& info : filters) {
+                    SessionProtocol::encode(&response, info);
+                }
+                break;
+            }
+
+            case Request::Export: {
+                std::string filename;
+                if (!decoder.get(&filename)) {
+                    return false;
+                }
+                startExport(fd, client, std::move(filename));
+                return true;
+            }
+
+            case Request::Wait: {
+                if (!decoder.get(&client->waitVersion)) {
+                    return false;
+                }
+                if (client->waitVersion >= _version) {
+                    client->waiting = true;
+                    return true;
+                }
+                response.put<uint64_t>(_version);
+                break;
+            }
+
+            case Request::History:
+                _data.loadHistory();
+                response.put<uint8_t>(1u);
+                break;
+
+            case Request::Related: {
+                uint8_t backwards;
+                if (!decoder.get(&backwards)) {
+                    return false;
+                }
+                SessionProtocol::encode(&response, _data.scrollToRelated(&view, backwards != 0u));
+                break;
+            }
+
+            case Request::Query: {
+                std::string regex;
+                if (!decoder.get(&regex)) {
+                    return false;
+                }
+                response.put<uint8_t>(_data.startQuery(regex));
+                break;
+            }
+
+            case Request::Text: {
+                uint64_t lineId;
+                if (!decoder.get(&lineId)) {
+                    return false;
+                }
+                response.put(_data.getText(lineId));
+                break;
+            }
+
+            case Request::RelatedLines: {
+                uint32_t cnt;
+                if (!decoder.get(&cnt)) {
+                    return false;
+                }
+                SessionProtocol::encode(&response, _data.getRelated(view, std::min(cnt, kMaxLines)));
+                break;
+            }
+
+            default:
+                LOG("Unknown request " << static_cast<int>(type));
+                return false;
+        }
+
+        return send(fd, client, response.getFrame());
+    }
+
+    void answerWaiting() {
+
+        uint64_t version = _version;
+        std::vector<int> failed;
+
+        for (auto& client : _clients) {
+            if (!client.second.waiting || client.second.waitVersion >= version) {
+                continue;
+            }
+            client.second.waiting = false;
+            SessionProtocol::Encoder response;
+            response.put(version);
+            if (!send(client.first, &client.second, response.getFrame())) {
+                failed.push_back(client.first);
+            }
+        }
+
+        for (int fd : failed) {
+            close(fd);
+        }
+    }
+
+    Reactor&                        _reactor;
+    DataModel&                      _data;
+    std::string                     _path;
+    int                             _socket{-1};
+    std::map<int, Client>           _clients;
+    uint64_t                        _lastClientId{0u};
+    //! Exports running on worker threads.
+    std::vector<std::future<void>>  _exports;
+    std::atomic<uint64_t>           _version{0u};
+    std::atomic<bool>               _notifyPosted{false};
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+#include "Log.hpp"
+
+/**
+ * Append-only file keeping the full text of lines too long to be kept in
+ * memory, read back by offset and length.
+ *
+ * The file is removed right after it is created, so it goes away with the
+ * process. Reads may run concurrently with each other, appends may not.
+ */
+class SpillStore {
+
+public:
+
+    SpillStore() = default;
+
+    ~SpillStore() {
+        if (_fd >= 0) {
+            ::close(_fd);
+        }
+    }
+
+    SpillStore(const SpillStore&) = delete;
+    SpillStore& operator=(const SpillStore&) = delete;
+
+    /**
+     * Writes the text at the end of the file, which is created on first use.
+     *
+     * @param offset Receives where the text starts.
+     */
+    bool append(std::string_view text, uint64_t* offset) {
+
+        if (_fd < 0 && !open()) {
+            return false;
+        }
+
+        *offset = _size;
+        while (!text.empty()) {
+            ssize_t written = ::pwrite(_fd, text.data(), text.size(), _size);
+            if (written <= 0) {
+                LOG("Failed to spill a line");
+                return false;
+            }
+            text.remove_prefix(written);
+            _size += written;
+        }
+        return true;
+    }
+
+    bool read(uint64_t offset, size_t length, std::string* text) const {
+
+        text->resize(length);
+        size_t done = 0u;
+        while (done < length) {
+            ssize_t cnt = ::pread(_fd, &(*text)[done], length - done, offset + done);
+            if (cnt <= 0) {
+                LOG("Failed to read a spilled line");
+                text->resize(done);
+                return false;
+            }
+            done += cnt;
+        }
+        return true;
+    }
+
+    uint64_t size() const {
+        return _size;
+    }
+
+private:
+
+    bool open() {
+
+        const char* directory = std::getenv("TMPDIR");
+        std::string path = std::string(directory != nullptr ? directory : "/tmp") + "/logalizer-spill-XXXXXX";
+
+        _fd = ::mkstemp(&path[0]);
+        if (_fd < 0) {
+            LOG("Failed to create " << path);
+            return false;
+        }
+        ::unlink(path.c_str());
+        ::fcntl(_fd, F_SETFD, FD_CLOEXEC);
+        LOG("Spilling long lines to " << path);
+        return true;
+    }
+
+    int                             _fd{-1};
+    uint64_t                        _size{0u};
+};
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Online log template miner, modeled after Drain.
+ *
+ * Lines are split into space separated tokens and grouped by token count and
+ * first token. Within a group, a line joins the most similar template or
+ * starts a new one. Tokens in which the line differs from its template turn
+ * into wildcards, whose values are the parameters stored for each line.
+ *
+ * Templates only ever gain wildcards. The order in which positions turned
+ * into wildcards is kept together with the constant they replaced, so lines
+ * encoded against an older version of a template are still rendered exactly.
+ */
+class TemplateMiner {
+
+    struct Template {
+        std::vector<std::string> tokens;
+        std::vector<bool> wildcard;
+        //! Positions in the order they became wildcards.
+        std::vector<uint16_t> wildcardOrder;
+        //! Constant each wildcard replaced, in wildcardOrder.
+        std::vector<std::string> replaced;
+        size_t count{0};
+    };
+
+public:
+
+    static constexpr char kSeparator = ' ';
+    static constexpr const char* kWildcard = "<*>";
+
+    /**
+     * @param threshold Minimum share of matching tokens to join a template.
+     * @param maxTemplatesPerGroup Once reached, lines join the most
+     *        similar template of the group regardless of the threshold.
+     */
+    TemplateMiner(double threshold = 0.5, size_t maxTemplatesPerGroup = 64)
+        : _threshold(threshold)
+        , _maxTemplatesPerGroup(maxTemplatesPerGroup) {}
+
+    /**
+     * Assigns the text to a template.
+     *
+     * @param params Receives the wildcard values, separated by kSeparator.
+     * @param paramCnt Receives the number of wildcard values.
+     * @return Template id.
+     */
+    uint32_t add(std::string_view text, std::string* params, uint16_t* paramCnt) {
+
+        auto tokens = split(text);
+        auto& group = _groups[groupKey(tokens)];
+
+        uint32_t id = findTemplate(group, tokens);
+        if (id == kNone) {
+            id = createTemplate(tokens);
+            group.push_back(id);
+        }
+        else {
+            generalize(&_templates[id], tokens);
+        }
+
+        auto& tmpl = _templates[id];
+        tmpl.count++;
+
+        params->clear();
+        for (size_t i = 0; i < tmpl.wildcardOrder.size(); i++) {
+            if (i > 0) {
+                params->push_back(kSeparator);
+            }
+            params->append(tokens[tmpl.wildcardOrder[i]]);
+        }
+        *paramCnt = tmpl.wildcardOrder.size();
+
+        return id;
+    }
+
+    /**
+     * Rebuilds the text of a line encoded by add().
+     */
+    std::string render(uint32_t id, std::string_view params, uint16_t paramCnt) const {
+
+        const auto& tmpl = _templates[id];
+        std::vector<std::string_view> values(tmpl.tokens.begin(), tmpl.tokens.end());
+
+        std::string_view rest = params;
+        for (size_t i = 0; i < tmpl.wildcardOrder.size(); i++) {
+            auto position = tmpl.wildcardOrder[i];
+            if (i + 1u == paramCnt) {
+                values[position] = rest;
+            }
+            else if (i < paramCnt) {
+                size_t end = std::min(rest.find(kSeparator), rest.size());
+                values[position] = rest.substr(0, end);
+                rest.remove_prefix(std::min(end + 1u, rest.size()));
+            }
+            else {
+                values[position] = tmpl.replaced[i];
+            }
+        }
+
+        std::string text;
+        for (size_t i = 0; i < values.size(); i++) {
+            if (i > 0) {
+                text.push_back(kSeparator);
+            }
+            text.append(values[i]);
+        }
+        return text;
+    }
+
+    //! @return Template text, with wildcards shown as kWildcard.
+    std::string getText(uint32_t id) const {
+
+        const auto& tmpl = _templates[id];
+        std::string text;
+        for (size_t i = 0; i < tmpl.tokens.size(); i++) {
+            if (i > 0) {
+                text.push_back(kSeparator);
+            }
+            text.append(tmpl.wildcard[i] ? kWildcard : tmpl.tokens[i]);
+        }
+        return text;
+    }
+
+    size_t getCount(uint32_t id) const {
+        return _templates[id].count;
+    }
+
+    size_t size() const {
+        return _templates.size();
+    }
+
+private:
+
+    static constexpr uint32_t kNone = UINT32_MAX;
+    //! Lines with more tokens are kept as a single token.
+    static constexpr size_t kMaxTokens = 1024;
+    static constexpr size_t kMaxKeyLength = 32;
+
+    static std::vector<std::string_view> split(std::string_view text) {
+        std::vector<std::string_view> tokens;
+        if (static_cast<size_t>(std::count(text.begin(), text.end(), kSeparator)) >= kMaxTokens) {
+            tokens.emplace_back(text);
+            return tokens;
+        }
+
+        std::string_view rest = text;
+        while (true) {
+            size_t end = rest.find(kSeparator);
+            tokens.push_back(rest.substr(0, end));
+            if (end == std::string_view::npos) {
+                return tokens;
+            }
+            rest.remove_prefix(end + 1u);
+        }
+    }
+
+    static bool hasDigits(std::string_view token) {
+        return std::any_of(token.begin(), token.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); });
+    }
+
+    static std::string groupKey(const std::vector<std::string_view>& tokens) {
+        std::string key = std::to_string(tokens.size());
+        key.push_back(kSeparator);
+        key.append(hasDigits(tokens[0]) ? std::string_view{kWildcard} : tokens[0].substr(0, kMaxKeyLength));
+        return key;
+    }
+
+    double similarity(const Template& tmpl, const std::vector<std::string_view>& tokens) const {
+        size_t same = 0;
+        for (size_t i = 0; i < tokens.size(); i++) {
+            if (!tmpl.wildcard[i] && tmpl.tokens[i] == tokens[i]) {
+                same++;
+            }
+        }
+        return static_cast<double>(same) / tokens.size();
+    }
+
+    uint32_t findTemplate(const std::vector<uint32_t>& group, const std::vector<std::string_view>& tokens) const {
+
+        uint32_t best = kNone;
+        double bestSimilarity = -1.0;
+
+        for (auto id : group) {
+            double current = similarity(_templates[id], tokens);
+            if (current > bestSimilarity) {
+                best = id;
+                bestSimilarity = current;
+            }
+        }
+
+        if (bestSimilarity >= _threshold || group.size() >= _maxTemplatesPerGroup) {
+            return best;
+        }
+        return kNone;
+    }
+
+    uint32_t createTemplate(const std::vector<std::string_view>& tokens) {
+
+        Template tmpl;
+        for (size_t i = 0; i < tokens.size(); i++) {
+            bool wildcard = hasDigits(tokens[i]);
+            tmpl.tokens.emplace_back(wildcard ? std::string_view{} : tokens[i]);
+            tmpl.wildcard.push_back(wildcard);
+            if (wildcard) {
+                tmpl.wildcardOrder.push_back(i);
+                tmpl.replaced.emplace_back();
+            }
+        }
+
+        _templates.emplace_back(std::move(tmpl));
+        return _templates.size() - 1u;
+    }
+
+    static void generalize(Template* tmpl, const std::vector<std::string_view>& tokens) {
+        for (size_t i = 0; i < tokens.size(); i++) {
+            if (!tmpl->wildcard[i] && tmpl->tokens[i] != tokens[i]) {
+                tmpl->wildcard[i] = true;
+                tmpl->wildcardOrder.push_back(i);
+                tmpl->replaced.emplace_back(std::move(tmpl->tokens[i]));
+                tmpl->tokens[i].clear();
+            }
+        }
+    }
+
+    double _threshold;
+    size_t _maxTemplatesPerGroup;
+    std::vector<Template> _templates;
+    std::map<std::string, std::vector<uint32_t>> _groups;
+};
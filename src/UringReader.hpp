@@ -0,0 +1,423 @@
+#pragma once
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "LineSplitter.hpp"
+#include "Log.hpp"
+
+/**
+ * Reads many regular files, like a set of rotated logs, through io_uring
+ * with a number of reads in flight across all of them.
+ *
+ * The files are read as if they were concatenated, in chunks into buffers
+ * registered with the ring, so one file's last chunks and the next file's
+ * first ones are read at the same time. Chunks complete in any order but
+ * are handed over in file order, one file after another, on the reader's
+ * own thread.
+ *
+ * Like the FileIndexer, only complete lines are handed over, and the
+ * offset after each file's last newline is reported once the file is
+ * done, for a reader to continue from there.
+ *
+ * The ring is set up with raw system calls. When the kernel doesn't allow
+ * io_uring the reader isn't open, and the files are left to be read the
+ * usual way.
+ */
+class UringReader {
+
+public:
+
+    using OnLines = std::function<void(size_t file, const std::vector<std::string_view>& lines)>;
+    //! Receives the bytes handed over and the total of the file.
+    using OnProgress = std::function<void(size_t file, size_t read, size_t total)>;
+    //! Receives the offset after the last line handed over.
+    using OnDone = std::function<void(size_t file, size_t end)>;
+
+    static constexpr unsigned kDefaultDepth = 32u;
+
+    UringReader(const std::vector<std::string>& filenames, OnLines onLines, OnProgress onProgress, OnDone onDone,
+                unsigned depth = kDefaultDepth)
+        : _onLines(onLines)
+        , _onProgress(onProgress)
+        , _onDone(onDone) {
+
+        if (!setup(std::max(depth, 1u))) {
+            close();
+            return;
+        }
+
+        for (const auto& filename : filenames) {
+            File file;
+            file.fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+            struct stat status;
+            if (file.fd >= 0 && ::fstat(file.fd, &status) == 0 && S_ISREG(status.st_mode)) {
+                file.size = status.st_size;
+                ::posix_fadvise(file.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            }
+            else {
+                LOG("Failed to open " << filename << " for io_uring");
+            }
+            _files.emplace_back(std::move(file));
+        }
+
+        LOG("Reading " << _files.size() << " files with " << _slots.size() << " reads in flight"
+            << (_registered ? " into registered buffers" : ""));
+        _thread = std::thread([this] () { run(); });
+    }
+
+    ~UringReader() {
+        stop();
+        for (auto& file : _files) {
+            if (file.fd >= 0) {
+                ::close(file.fd);
+            }
+        }
+        close();
+    }
+
+    bool isOpen() const {
+        return _ring >= 0;
+    }
+
+    /**
+     * Stops reading, no callbacks are made once this returns.
+     */
+    void stop() {
+        _stopped = true;
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+    }
+
+private:
+
+    static constexpr size_t kChunkSize = 256u * 1024u;
+
+    struct File {
+        int fd{-1};
+        size_t size{0u};
+        //! Offset of the next chunk to read.
+        size_t next{0u};
+        //! Bytes handed over, or skipped after a failed read.
+        size_t delivered{0u};
+        //! Offset after the last newline handed over.
+        size_t end{0u};
+        bool failed{false};
+        LineSplitter splitter;
+    };
+
+    //! Chunk read into the registered buffer of the same index.
+    struct Slot {
+        size_t file{0u};
+        size_t offset{0u};
+        size_t length{0u};
+        size_t done{0u};
+        bool complete{false};
+        bool failed{false};
+    };
+
+    static int enter(int ring, unsigned submit, unsigned wait) {
+        return ::syscall(__NR_io_uring_enter, ring, submit, wait, wait > 0u ? IORING_ENTER_GETEVENTS : 0u,
+                         nullptr, 0u);
+    }
+
+    bool setup(unsigned depth) {
+
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        _ring = ::syscall(__NR_io_uring_setup, depth, &params);
+        if (_ring < 0) {
+            LOG("io_uring isn't available: " << std::strerror(errno));
+            return false;
+        }
+
+        _sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        _cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0u;
+        if (single) {
+            _sqSize = _cqSize = std::max(_sqSize, _cqSize);
+        }
+
+        _sq = map(_sqSize, IORING_OFF_SQ_RING);
+        _cq = single ? _sq : map(_cqSize, IORING_OFF_CQ_RING);
+        _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        _sqes = static_cast<io_uring_sqe*>(static_cast<void*>(map(_sqesSize, IORING_OFF_SQES)));
+        if (_sq == nullptr || _cq == nullptr || _sqes == nullptr) {
+            LOG("Failed to map the io_uring queues");
+            return false;
+        }
+
+        _sqTail = reinterpret_cast<unsigned*>(_sq + params.sq_off.tail);
+        _sqMask = *reinterpret_cast<unsigned*>(_sq + params.sq_off.ring_mask);
+        _sqArray = reinterpret_cast<unsigned*>(_sq + params.sq_off.array);
+        _cqHead = reinterpret_cast<unsigned*>(_cq + params.cq_off.head);
+        _cqTail = reinterpret_cast<unsigned*>(_cq + params.cq_off.tail);
+        _cqMask = *reinterpret_cast<unsigned*>(_cq + params.cq_off.ring_mask);
+        _cqes = reinterpret_cast<io_uring_cqe*>(_cq + params.cq_off.cqes);
+
+        // The submission queue never holds more than the reads in flight.
+        _slots.resize(std::min(depth, params.sq_entries));
+        _buffersSize = _slots.size() * kChunkSize;
+        void* buffers = ::mmap(nullptr, _buffersSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buffers == MAP_FAILED) {
+            LOG("Failed to allocate the io_uring buffers");
+            return false;
+        }
+        _buffers = static_cast<char*>(buffers);
+
+        // Without registered buffers, e.g. over the locked memory limit,
+        // each read maps its buffer.
+        std::vector<iovec> iovecs(_slots.size());
+        for (size_t i = 0; i < iovecs.size(); i++) {
+            iovecs[i] = {_buffers + i * kChunkSize, kChunkSize};
+        }
+        _registered = ::syscall(__NR_io_uring_register, _ring, IORING_REGISTER_BUFFERS,
+                                iovecs.data(), static_cast<unsigned>(iovecs.size())) == 0;
+        if (!_registered) {
+            LOG("Failed to register the io_uring buffers: " << std::strerror(errno));
+        }
+        return true;
+    }
+
+    char* map(size_t size, off_t offset) const {
+        void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring, offset);
+        return data != MAP_FAILED ? static_cast<char*>(data) : nullptr;
+    }
+
+    void close() {
+        if (_buffers != nullptr) {
+            ::munmap(_buffers, _buffersSize);
+            _buffers = nullptr;
+        }
+        if (_sqes != nullptr) {
+            ::munmap(_sqes, _sqesSize);
+            _sqes = nullptr;
+        }
+        if (_cq != nullptr && _cq != _sq) {
+            ::munmap(_cq, _cqSize);
+        }
+        _cq = nullptr;
+        if (_sq != nullptr) {
+            ::munmap(_sq, _sqSize);
+            _sq = nullptr;
+        }
+        if (_ring >= 0) {
+            ::close(_ring);
+            _ring = -1;
+        }
+    }
+
+    void run() {
+
+        for (size_t i = 0; i < _slots.size(); i++) {
+            _free.push_back(i);
+        }
+
+        while (!_stopped) {
+
+            deliver();
+            queueChunks();
+            reportDone();
+            if (_window.empty()) {
+                break;
+            }
+
+            // The front of the window is still being read.
+            int submitted = enter(_ring, _queued, 1u);
+            if (submitted < 0 && errno != EINTR) {
+                LOG("io_uring failed: " << std::strerror(errno));
+                break;
+            }
+            if (submitted > 0) {
+                _queued -= submitted;
+                _inFlight += submitted;
+            }
+            reap();
+        }
+
+        // The buffers may only go once the kernel is done with them.
+        while (_inFlight > 0u) {
+            if (enter(_ring, 0u, 1u) < 0 && errno != EINTR) {
+                break;
+            }
+            reap();
+        }
+    }
+
+    //! Queues reads of the following chunks into the free buffers.
+    void queueChunks() {
+
+        while (_nextFile < _files.size()) {
+
+            auto& file = _files[_nextFile];
+            if (file.failed || file.next >= file.size) {
+                _nextFile++;
+                continue;
+            }
+            if (_free.empty()) {
+                break;
+            }
+
+            size_t index = _free.front();
+            _free.pop_front();
+            _slots[index] = Slot{_nextFile, file.next, std::min(kChunkSize, file.size - file.next)};
+            file.next += _slots[index].length;
+            _window.push_back(index);
+            queueRead(index);
+        }
+    }
+
+    void queueRead(size_t index) {
+
+        const auto& slot = _slots[index];
+        unsigned tail = *_sqTail;
+        unsigned entry = tail & _sqMask;
+        io_uring_sqe* sqe = &_sqes[entry];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = _registered ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe->fd = _files[slot.file].fd;
+        sqe->addr = reinterpret_cast<uint64_t>(_buffers + index * kChunkSize + slot.done);
+        sqe->len = slot.length - slot.done;
+        sqe->off = slot.offset + slot.done;
+        sqe->buf_index = _registered ? index : 0u;
+        sqe->user_data = index;
+        _sqArray[entry] = entry;
+        __atomic_store_n(_sqTail, tail + 1u, __ATOMIC_RELEASE);
+        _queued++;
+    }
+
+    void reap() {
+
+        unsigned head = *_cqHead;
+        unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+
+        for (; head != tail; head++) {
+            const io_uring_cqe& cqe = _cqes[head & _cqMask];
+            auto& slot = _slots[cqe.user_data];
+            int result = cqe.res;
+            _inFlight--;
+
+            if (result == -EINTR || result == -EAGAIN) {
+                queueRead(cqe.user_data);
+                continue;
+            }
+            if (result <= 0) {
+                // An error, or the file was truncated since it was opened.
+                if (result < 0) {
+                    LOG("Failed to read a chunk: " << std::strerror(-result));
+                }
+                slot.failed = true;
+                slot.complete = true;
+                continue;
+            }
+
+            slot.done += result;
+            if (slot.done < slot.length) {
+                queueRead(cqe.user_data);
+            }
+            else {
+                slot.complete = true;
+            }
+        }
+
+        __atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    //! Hands over the completed chunks at the front of the window.
+    void deliver() {
+
+        while (!_window.empty() && _slots[_window.front()].complete && !_stopped) {
+
+            size_t index = _window.front();
+            _window.pop_front();
+            const auto& slot = _slots[index];
+            auto& file = _files[slot.file];
+
+            if (!file.failed) {
+                const char* data = _buffers + index * kChunkSize;
+                auto lines = file.splitter.split(data, slot.done);
+                if (!lines.empty()) {
+                    _onLines(slot.file, lines);
+                }
+                auto last = static_cast<const char*>(::memrchr(data, '\n', slot.done));
+                if (last != nullptr) {
+                    file.end = slot.offset + (last - data) + 1u;
+                }
+                file.failed = slot.failed;
+            }
+            file.delivered += slot.length;
+            _free.push_back(index);
+
+            if (_onProgress) {
+                _onProgress(slot.file, file.delivered, file.size);
+            }
+        }
+    }
+
+    /**
+     * Reports the files with all their chunks handed over, in order,
+     * including those without anything to read.
+     */
+    void reportDone() {
+        while (_doneFile < _nextFile && !_stopped) {
+            if (!_window.empty() && _slots[_window.front()].file == _doneFile) {
+                break;
+            }
+            _onDone(_doneFile, _files[_doneFile].end);
+            _doneFile++;
+        }
+    }
+
+    OnLines                         _onLines;
+    OnProgress                      _onProgress;
+    OnDone                          _onDone;
+
+    int                             _ring{-1};
+    char*                           _sq{nullptr};
+    char*                           _cq{nullptr};
+    size_t                          _sqSize{0u};
+    size_t                          _cqSize{0u};
+    io_uring_sqe*                   _sqes{nullptr};
+    size_t                          _sqesSize{0u};
+    unsigned*                       _sqTail{nullptr};
+    unsigned                        _sqMask{0u};
+    unsigned*                       _sqArray{nullptr};
+    unsigned*                       _cqHead{nullptr};
+    unsigned*                       _cqTail{nullptr};
+    unsigned                        _cqMask{0u};
+    io_uring_cqe*                   _cqes{nullptr};
+
+    char*                           _buffers{nullptr};
+    size_t                          _buffersSize{0u};
+    bool                            _registered{false};
+
+    std::vector<File>               _files;
+    std::vector<Slot>               _slots;
+    std::deque<size_t>              _free;
+    //! Chunks being read or waiting for the ones before them, in file order.
+    std::deque<size_t>              _window;
+    //! Reads queued but not submitted yet, and submitted but not completed.
+    unsigned                        _queued{0u};
+    unsigned                        _inFlight{0u};
+    size_t                          _nextFile{0u};
+    size_t                          _doneFile{0u};
+    std::atomic<bool>               _stopped{false};
+    std::thread                     _thread;
+};
@@ -1,57 +1,623 @@
 #include "Curses.hpp"
 #include "DataModel.hpp"
+#include "FileIndexer.hpp"
+#include "HistoryReader.hpp"
+#include "IngestQueue.hpp"
 #include "LogReader.hpp"
+#include "NetReader.hpp"
 #include "Options.hpp"
+#include "Reactor.hpp"
+#include "RecordAssembler.hpp"
+#include "Recording.hpp"
+#include "RemoteDataModel.hpp"
+#include "SessionServer.hpp"
+#include "UringReader.hpp"
 
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <map>
 #include <string>
 
+//! What an input does when its queue is full.
+struct QueuePolicy {
+    IngestQueue::Policy policy{IngestQueue::Policy::Block};
+    size_t capacity{IngestQueue::kDefaultCapacity};
+};
+
 struct Configuration {
     DataModel data = DataModel{std::make_shared<Exec>()};
+    Reactor reactor;
+    std::unique_ptr<Recorder> recorder;
+    //! Rules joining the lines of an input into records, by input name.
+    std::map<std::string, std::string> multilines;
+    //! Queue policies by input name, the one without a name for the others.
+    std::map<std::string, QueuePolicy> queuePolicies;
+    //! Used by the queues, so they go after them.
+    std::vector<std::unique_ptr<RecordAssembler>> assemblers;
+    //! Serves the queues, so it goes before them.
+    IngestQueue::Worker worker;
+    std::vector<std::unique_ptr<IngestQueue>> queues;
     std::vector<std::unique_ptr<LogReader>> readers;
+    //! Continues with the readers once done, so it goes after them.
+    std::unique_ptr<FileIndexer> indexer;
+    std::unique_ptr<UringReader> uring;
+    std::vector<std::unique_ptr<HistoryReader>> histories;
+    std::vector<std::unique_ptr<NetReader>> listeners;
+    std::unique_ptr<Replayer> replayer;
+
+    std::mutex mtx;
+    std::condition_variable readerStopped;
+    //! Inputs which report reaching their end, and how many did.
+    size_t finiteReaders{0};
+    size_t stoppedReaders{0};
+
+    ~Configuration() {
+        // Before the inputs, which it resumes once their queues drain
+        worker.stop();
+    }
 };
 
+/**
+ * @return Rule joining the lines of the input into records, or an empty string.
+ */
+std::string getMultiline(Configuration* config, const std::string& name) {
+    auto it = config->multilines.find(name);
+    return it != config->multilines.end() ? it->second : std::string{};
+}
+
+/**
+ * @return Policy of the input's queue.
+ */
+QueuePolicy getQueuePolicy(Configuration* config, const std::string& name) {
+    auto it = config->queuePolicies.find(name);
+    return it != config->queuePolicies.end() ? it->second : config->queuePolicies[""];
+}
+
+/**
+ * Adds a queue handing the lines of the input over to its tab, joined
+ * into records if the input has a rule for them.
+ */
+IngestQueue* addQueue(Configuration* config, const std::string& name, uint8_t src) {
+
+    auto& data = config->data;
+    auto policy = getQueuePolicy(config, name);
+    auto onDropped = [&data, src](size_t cnt) { data.addDropped(src, cnt); };
+
+    auto rule = getMultiline(config, name);
+    if (rule.empty()) {
+        config->queues.emplace_back(std::make_unique<IngestQueue>(config->worker, policy.policy, policy.capacity,
+            [&data, src](const std::vector<std::string_view>& lines) { data.addLines(lines, src); },
+            onDropped));
+        return config->queues.back().get();
+    }
+
+    // The last record is complete once the input pauses
+    config->assemblers.emplace_back(std::make_unique<RecordAssembler>(rule));
+    auto assembler = config->assemblers.back().get();
+    config->queues.emplace_back(std::make_unique<IngestQueue>(config->worker, policy.policy, policy.capacity,
+        [&data, src, assembler](const std::vector<std::string_view>& lines) {
+            data.addLines(assembler->add(lines), src);
+        },
+        onDropped,
+        [&data, src, assembler]() { data.addLines(assembler->flush(), src); }));
+
+    return config->queues.back().get();
+}
+
+/**
+ * Adds a tab for the input, which hands its lines over through a queue.
+ */
+IngestQueue* addQueue(Configuration* config, const std::string& name) {
+    return addQueue(config, name, config->data.addSource(name));
+}
+
+/**
+ * Indexes the file on all cores up to its last line, after the files
+ * added before it, then has the reader continue from there.
+ */
+void addIndexer(Configuration* config, const std::string& input, uint8_t src, LogReader* reader) {
+
+    auto& data = config->data;
+    data.setIndexed(src, 0u);
+
+    if (!config->indexer) {
+        config->indexer = std::make_unique<FileIndexer>([&data](){ return data.getClassifier(); });
+    }
+
+    bool added = config->indexer->add(input,
+        [&data, src](const std::vector<std::string_view>& lines, const std::vector<int>& classes){
+            data.addClassifiedLines(lines, classes, src);
+        },
+        [&data, src](size_t indexed, size_t total){
+            data.setIndexed(src, total > 0u ? indexed * 100u / total : 100u);
+        },
+        [reader](size_t end){ reader->start(end); });
+
+    if (!added) {
+        data.setIndexed(src, 100u);
+        reader->start();
+    }
+}
+
+//! Input file read through io_uring before its reader continues.
+struct UringInput {
+    std::string name;
+    uint8_t src;
+    IngestQueue::OnLines push;
+    IngestQueue* queue;
+    LogReader* reader;
+};
+
+/**
+ * Reads the files through io_uring, then has their readers continue from
+ * the end of each.
+ */
+void addUring(Configuration* config, const std::vector<UringInput>& inputs, unsigned depth) {
+
+    auto& data = config->data;
+    std::vector<std::string> names;
+    for (const auto& input : inputs) {
+        data.setIndexed(input.src, 0u);
+        names.push_back(input.name);
+    }
+
+    auto uring = std::make_unique<UringReader>(names,
+        [inputs](size_t file, const std::vector<std::string_view>& lines){
+            inputs[file].push(lines);
+            inputs[file].queue->waitForSpace();
+        },
+        [&data, inputs](size_t file, size_t read, size_t total){
+            data.setIndexed(inputs[file].src, total > 0u ? read * 100u / total : 100u);
+        },
+        [&data, inputs](size_t file, size_t end){
+            data.setIndexed(inputs[file].src, 100u);
+            inputs[file].reader->start(end);
+        },
+        depth);
+
+    if (!uring->isOpen()) {
+        for (const auto& input : inputs) {
+            data.setIndexed(input.src, 100u);
+            input.reader->start();
+        }
+        return;
+    }
+    config->uring = std::move(uring);
+}
+
+/**
+ * Opens the file at its end, with the reader starting at its last lines
+ * and older ones loaded on request.
+ */
+void addHistory(Configuration* config, const std::string& input, uint8_t src, size_t lines, LogReader* reader) {
+
+    auto& data = config->data;
+    auto rule = getMultiline(config, input);
+    auto history = std::make_unique<HistoryReader>(config->reactor, input,
+        [&data, src, rule](const std::vector<std::string_view>& lines){
+            if (rule.empty()) {
+                data.prependLines(lines, src);
+                return;
+            }
+            // Blocks are joined separately, records spanning two are split
+            RecordAssembler assembler(rule);
+            data.prependLines(assembler.add(lines, true), src);
+        },
+        [&data, src](size_t read, size_t total){
+            data.setIndexed(src, total > 0u ? read * 100u / total : 100u);
+        });
+
+    if (!history->isOpen()) {
+        reader->start();
+        return;
+    }
+
+    auto offset = history->seekTail(lines);
+    reader->start(offset);
+    if (offset > 0u) {
+        data.setIndexed(src, 0u);
+        data.addHistoryLoader([reader = history.get()](){ reader->load(); });
+    }
+    config->histories.emplace_back(std::move(history));
+}
+
+/**
+ * @return Function handing the input's lines to the queue, recording them
+ *         first if requested.
+ */
+IngestQueue::OnLines getPush(Configuration* config, IngestQueue* queue, const std::string& name) {
+
+    if (!config->recorder) {
+        return [queue](const std::vector<std::string_view>& lines){ queue->push(lines); };
+    }
+
+    auto recorder = config->recorder.get();
+    auto input = recorder->addInput(name);
+    return [queue, recorder, input](const std::vector<std::string_view>& lines){
+        recorder->record(input, lines);
+        queue->push(lines);
+    };
+}
+
 bool initialize(Configuration* config, const Options::Options& options) {
 
     const auto noop = [](){};
+    const auto onReaderStop = [config](){
+        std::lock_guard<std::mutex> g(config->mtx);
+        config->stoppedReaders++;
+        config->readerStopped.notify_all();
+    };
+
+    config->queuePolicies[""] = {};
+    for (const auto& queue : options.queues) {
+        size_t separator = queue.rfind('=');
+        auto name = separator != std::string::npos ? queue.substr(0, separator) : std::string{};
+        auto spec = separator != std::string::npos ? queue.substr(separator + 1u) : queue;
+        auto& policy = config->queuePolicies[name];
+        if (!IngestQueue::parsePolicy(spec, &policy.policy, &policy.capacity)) {
+            std::cerr << "Invalid queue policy: " << queue << std::endl;
+            return false;
+        }
+    }
+
+    for (const auto& sampling : options.samplings) {
+        size_t every = std::strtoul(sampling.every.c_str(), nullptr, 10);
+        if (every == 0u) {
+            std::cerr << "Invalid sampling: " << sampling.every << std::endl;
+            return false;
+        }
+        config->data.setSampling(sampling.name, every);
+    }
+
+    // Files are only followed on request, and never when exported
+    const bool follow = options.follow && options.output.empty();
+
+    double speed;
+    if (!Replayer::parseSpeed(options.speed, &speed)) {
+        std::cerr << "Invalid replay speed: " << options.speed << std::endl;
+        return false;
+    }
+
+    if (!options.record.empty()) {
+        config->recorder = std::make_unique<Recorder>(options.record);
+        if (!config->recorder->isOpen()) {
+            std::cerr << "Failed to create recording " << options.record << std::endl;
+            return false;
+        }
+    }
+
+    for (const auto& multiline : options.multilines) {
+        if (!RecordAssembler(multiline.rule).isValid()) {
+            std::cerr << "Invalid record rule: " << multiline.rule << std::endl;
+            return false;
+        }
+        config->multilines[multiline.name] = multiline.rule;
+    }
+
+    if (!options.lineLimit.empty()) {
+        size_t limit = std::strtoul(options.lineLimit.c_str(), nullptr, 10);
+        if (limit == 0u) {
+            std::cerr << "Invalid line limit: " << options.lineLimit << std::endl;
+            return false;
+        }
+        config->data.setLineLimit(limit);
+    }
 
     // Filters must be available before the input is read
+    if (!options.filterCache.empty()) {
+        config->data.setFilterCache(options.filterCache);
+    }
+    for (const auto& drop : options.drops) {
+        config->data.addDropFilter(drop.name, drop.regex);
+    }
+
     for (const auto& filter : options.filters) {
         config->data.addFilter(filter.name, filter.regex);
     }
 
+    for (const auto& key : options.keys) {
+        if (!config->data.addKey(key.name, key.regex)) {
+            std::cerr << "Invalid key: " << key.regex << std::endl;
+            return false;
+        }
+    }
+
     for (const auto& external : options.externals) {
         config->data.addExternal(external.name, external.command);
     }
 
+    for (const auto& coprocess : options.coprocesses) {
+        config->data.addExternal(coprocess.name, coprocess.command, true);
+    }
+
+    size_t tail = 0u;
+    if (!options.tail.empty()) {
+        tail = std::strtoul(options.tail.c_str(), nullptr, 10);
+        if (tail == 0u) {
+            std::cerr << "Invalid number of lines: " << options.tail << std::endl;
+            return false;
+        }
+    }
+
+    unsigned depth = 0u;
+    if (!options.uring.empty()) {
+        depth = std::strtoul(options.uring.c_str(), nullptr, 10);
+        if (depth == 0u) {
+            std::cerr << "Invalid queue depth: " << options.uring << std::endl;
+            return false;
+        }
+    }
+
+    std::vector<UringInput> uringInputs;
     for (const auto& input : options.inputs) {
-        config->readers.emplace_back(std::make_unique<LogReader>(input, noop, config->data.getAppender(input)));
+        auto src = config->data.addSource(input);
+        auto queue = addQueue(config, input, src);
+
+        // Recordings keep the timing of reads, so recorded files are read
+        // serially, as are records, which may span the indexed blocks
+        bool indexed = !config->recorder && tail == 0u && getMultiline(config, input).empty()
+            && FileIndexer::isIndexable(input);
+        bool tailed = tail > 0u && FileIndexer::isIndexable(input, 0u);
+        bool uringed = depth > 0u && !config->recorder && !indexed && !tailed
+            && FileIndexer::isIndexable(input, 0u);
+
+        auto push = getPush(config, queue, input);
+        config->finiteReaders++;
+        config->readers.emplace_back(std::make_unique<LogReader>(
+            config->reactor, input,
+            [queue, onReaderStop](){ queue->finish(onReaderStop); },
+            push, follow, true));
+        config->readers.back()->setThrottle([queue](std::function<void()> resume){
+            return queue->throttle(resume);
+        });
+
+        if (indexed) {
+            addIndexer(config, input, src, config->readers.back().get());
+        }
+        else if (tailed) {
+            addHistory(config, input, src, tail, config->readers.back().get());
+        }
+        else if (uringed) {
+            uringInputs.push_back({input, src, push, queue, config->readers.back().get()});
+        }
+        else {
+            config->readers.back()->start();
+        }
+    }
+
+    if (!uringInputs.empty()) {
+        addUring(config, uringInputs, depth);
+    }
+
+    if (!options.replay.empty()) {
+        config->replayer = std::make_unique<Replayer>(options.replay, speed);
+        if (!config->replayer->isOpen()) {
+            std::cerr << "Failed to open recording " << options.replay << std::endl;
+            return false;
+        }
+
+        std::vector<IngestQueue*> queues;
+        std::vector<Replayer::OnLines> pushes;
+        for (const auto& input : config->replayer->getInputs()) {
+            auto queue = addQueue(config, input);
+            auto push = getPush(config, queue, input);
+            queues.push_back(queue);
+            pushes.push_back([queue, push](const std::vector<std::string_view>& lines){
+                push(lines);
+                queue->waitForSpace();
+            });
+        }
+        config->finiteReaders += queues.size();
+        config->replayer->start(pushes, [queues, onReaderStop](){
+            for (auto queue : queues) {
+                queue->finish(onReaderStop);
+            }
+        });
+    }
+
+    for (const auto& listener : options.listeners) {
+        NetReader::Protocol protocol;
+        if (!NetReader::parseProtocol(listener.protocol, &protocol)) {
+            std::cerr << "Unknown protocol: " << listener.protocol << std::endl;
+            return false;
+        }
+
+        auto name = listener.protocol + ":" + listener.address;
+        auto queue = addQueue(config, name);
+        auto reader = std::make_unique<NetReader>(
+            config->reactor, protocol, listener.address, noop,
+            getPush(config, queue, name));
+        if (!reader->isOpen()) {
+            std::cerr << "Failed to listen on " << name << std::endl;
+            return false;
+        }
+        reader->setThrottle([queue](std::function<void()> resume){ return queue->throttle(resume); });
+        config->listeners.emplace_back(std::move(reader));
+    }
+
+    return true;
+}
+
+bool exportInputs(Configuration* config, const std::string& filename) {
+
+    {
+        std::unique_lock<std::mutex> lock(config->mtx);
+        config->readerStopped.wait(lock, [config](){
+            return config->stoppedReaders == config->finiteReaders;
+        });
+    }
+
+    config->data.waitForComments();
+
+    size_t exported = 0;
+    if (!config->data.exportVisible(filename, &exported)) {
+        std::cerr << "Failed to export to " << filename << std::endl;
+        return false;
+    }
+
+    if (config->replayer) {
+        std::cout << "Replayed " << config->replayer->getLineCnt() << " lines in "
+                  << config->replayer->getDuration().count() << " ms" << std::endl;
+    }
+
+    std::cout << "Exported " << exported << " lines to " << filename << std::endl;
+    return true;
+}
+
+void stopInputs(Configuration* config) {
+
+    // Its workers report to the UI, like the inputs
+    config->data.stopQuery();
+
+    if (config->indexer) {
+        config->indexer->stop();
+    }
+
+    if (config->uring) {
+        config->uring->stop();
+    }
+
+    for (auto& history : config->histories) {
+        history->stop();
+    }
+
+    if (config->replayer) {
+        config->replayer->stop();
+    }
+
+    for (auto& reader : config->readers) {
+        reader->stop();
+    }
+
+    for (auto& listener : config->listeners) {
+        listener->stop();
+    }
+
+    config->worker.stop();
+}
+
+/**
+ * Detaches from the terminal. Must be called before any thread is started,
+ * as only the calling thread is carried over to the child.
+ */
+bool daemonize() {
+
+    pid_t pid = ::fork();
+    if (pid < 0) {
+        return false;
+    }
+    if (pid > 0) {
+        ::_exit(EXIT_SUCCESS);
+    }
+
+    ::setsid();
+
+    int null = ::open("/dev/null", O_RDWR);
+    if (null >= 0) {
+        ::dup2(null, STDIN_FILENO);
+        ::dup2(null, STDOUT_FILENO);
+        ::dup2(null, STDERR_FILENO);
+        ::close(null);
     }
 
     return true;
 }
 
+/**
+ * Serves the session to attached viewers until it is signalled to stop.
+ */
+bool runSession(Configuration* config, const Options::Options& options, const sigset_t& signals) {
+
+    SessionServer server(config->reactor, config->data, options.session);
+    if (!server.isOpen()) {
+        return false;
+    }
+
+    config->data.registerOnNewDataAvailableListener([&server](){ server.notify(); });
+
+    if (!initialize(config, options)) {
+        server.stop();
+        stopInputs(config);
+        return false;
+    }
+
+    int signal;
+    ::sigwait(&signals, &signal);
+    LOG("Session stopped by signal " << signal);
+
+    // No viewer may start a query while the inputs are stopped
+    server.stop();
+    stopInputs(config);
+    return true;
+}
+
+bool attach(const std::string& path) {
+
+    RemoteDataModel data(path);
+    if (!data.isOpen()) {
+        std::cerr << "Failed to attach to " << path << std::endl;
+        return false;
+    }
+
+    Curses curses(data);
+    bool success = curses.run();
+    data.stop();
+
+    return success;
+}
+
 int main(int argc, char* argv[]) {
 
     Options::Options options;
-    Configuration configuration;
-    Curses curses(configuration.data);
 
     if (!Options::parseOptions(&options, argc, argv)) {
         std::cout << Options::getHelp() << std::endl;
         return EXIT_FAILURE;
     }
 
-    if (!initialize(&configuration, options)) {
-        return EXIT_FAILURE;
+    if (!options.attach.empty()) {
+        return attach(options.attach) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    sigset_t signals;
+    if (!options.session.empty()) {
+        if (SessionServer::isRunning(options.session)) {
+            std::cerr << "Session already running on " << options.session << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "Session on " << options.session << std::endl;
+        if (!daemonize()) {
+            return EXIT_FAILURE;
+        }
+
+        // Threads inherit the mask, so the signals are left to sigwait()
+        ::sigemptyset(&signals);
+        ::sigaddset(&signals, SIGINT);
+        ::sigaddset(&signals, SIGTERM);
+        ::pthread_sigmask(SIG_BLOCK, &signals, nullptr);
     }
 
-    if (!curses.run()) {
+    Configuration configuration;
+
+    if (!options.session.empty()) {
+        return runSession(&configuration, options, signals) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    Curses curses(configuration.data);
+
+    if (!initialize(&configuration, options)) {
         return EXIT_FAILURE;
     }
 
-    for (auto& reader : configuration.readers) {
-        reader->stop();
+    if (!options.output.empty()) {
+        return exportInputs(&configuration, options.output) ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
-    return EXIT_SUCCESS;
+    bool success = curses.run();
+    stopInputs(&configuration);
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,66 @@
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <string>
+
+#include "src/Column.hpp"
+#include "src/QuantileSketch.hpp"
+
+TEST(QuantileSketch, testRelativeAccuracy)
+{
+    QuantileSketch sketch;
+    EXPECT_TRUE(std::isnan(sketch.getQuantile(0.5)));
+
+    for (int i = 1; i <= 10000; i++) {
+        sketch.add(i);
+    }
+    sketch.add(0.0);
+    sketch.add(-5.0);
+
+    EXPECT_EQ(sketch.getCount(), 10002u);
+    EXPECT_NEAR(sketch.getQuantile(0.5), 4999.0, 4999.0 * 0.01);
+    EXPECT_NEAR(sketch.getQuantile(0.99), 9899.0, 9899.0 * 0.01);
+    EXPECT_NEAR(sketch.getQuantile(0.0), -5.0, 5.0 * 0.01);
+    EXPECT_NEAR(sketch.getQuantile(1.0), 10000.0, 10000.0 * 0.01);
+}
+
+TEST(Column, testNumbers)
+{
+    Column column("latency", 2);
+    column.add(0, "10");
+    column.add(3, "30.5");
+    column.add(4, "oops");
+    column.add(7, "-4");
+    column.add(8, "");
+
+    EXPECT_EQ(column.getType(), Column::Type::Number);
+    EXPECT_EQ(column.size(), 4u);
+    EXPECT_EQ(column.getLineId(3), 7u);
+    EXPECT_TRUE(std::isnan(column.getNumber(2)));
+
+    auto info = column.getInfo();
+    EXPECT_EQ(info.name, "latency");
+    EXPECT_EQ(info.tab, 2);
+    EXPECT_TRUE(info.numeric);
+    EXPECT_EQ(info.count, 4u);
+    EXPECT_EQ(info.invalid, 1u);
+    EXPECT_DOUBLE_EQ(info.sum, 36.5);
+    EXPECT_DOUBLE_EQ(info.min, -4.0);
+    EXPECT_DOUBLE_EQ(info.max, 30.5);
+    EXPECT_NEAR(info.p50, 10.0, 0.1);
+}
+
+TEST(Column, testText)
+{
+    Column column("status", 0);
+    for (auto value : {"OK", "FAIL", "OK", "TIMEOUT", "OK", "FAIL", "42"}) {
+        column.add(0, value);
+    }
+
+    auto info = column.getInfo(2);
+    EXPECT_FALSE(info.numeric);
+    EXPECT_EQ(info.count, 7u);
+    ASSERT_EQ(info.top.size(), 2u);
+    EXPECT_EQ(info.top[0], std::make_pair(std::string("OK"), size_t{3}));
+    EXPECT_EQ(info.top[1], std::make_pair(std::string("FAIL"), size_t{2}));
+}
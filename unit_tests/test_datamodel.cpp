@@ -1,5 +1,15 @@
 #include "gtest/gtest.h"
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <thread>
+
 #include "src/DataModel.hpp"
 #include "mocks/ExecMock.hpp"
 
@@ -253,3 +263,610 @@ TEST(DataModel, testAddExternalWithMatchingFilterNoExec)
     EXPECT_EQ(data.nextLine().comment.empty(), true);
     EXPECT_EQ(data.nextLine().comment.empty(), true);
 }
+
+TEST(DataModel, testScrollTo)
+{
+    DataModel data;
+    auto append = data.getAppender("one");
+    auto tabOdd = data.addFilter("odd", ".*[13579]");
+
+    for (int i = 0; i < 5000; i++) {
+        append("line " + std::to_string(i));
+    }
+
+    EXPECT_EQ(data.getVisibleCnt(), 5000U);
+    EXPECT_EQ(data.scrollTo(3000), true);
+    EXPECT_EQ(data.getPosition(), 3000U);
+    data.prepareLines();
+    EXPECT_EQ(data.nextLine().text, "line 3000");
+
+    // Hiding odd lines keeps the top line and halves the positions
+    data.toggleTab(tabOdd);
+    EXPECT_EQ(data.getVisibleCnt(), 2500U);
+    EXPECT_EQ(data.getPosition(), 1500U);
+    data.prepareLines();
+    EXPECT_EQ(data.nextLine().text, "line 3000");
+    EXPECT_EQ(data.nextLine().text, "line 3002");
+
+    EXPECT_EQ(data.scrollTo(2100), true);
+    data.prepareLines();
+    EXPECT_EQ(data.nextLine().text, "line 4200");
+
+    // Positions past the end are clamped to the last line
+    data.scrollTo(100000);
+    EXPECT_EQ(data.getPosition(), 2499U);
+    data.prepareLines();
+    EXPECT_EQ(data.nextLine().text, "line 4998");
+    EXPECT_EQ(data.nextLine().isValid(), false);
+}
+
+TEST(DataModel, testScrollFromHiddenLine)
+{
+    DataModel data;
+    auto append = data.getAppender("one");
+    auto tabApples = data.addFilter("filter-apple", ".*apple.*");
+
+    append("line 1 orange");
+    append("line 2 apple");
+    append("line 3 orange");
+
+    data.scrollTo(1);
+    data.toggleTab(tabApples);
+
+    // Top line is hidden, the following visible line is shown instead
+    EXPECT_EQ(data.getPosition(), 1U);
+    data.prepareLines();
+    EXPECT_EQ(data.nextLine().text, "line 3 orange");
+    EXPECT_EQ(data.scrollUp(), true);
+    data.prepareLines();
+    EXPECT_EQ(data.nextLine().text, "line 1 orange");
+}
+
+TEST(DataModel, testTemplates)
+{
+    DataModel data;
+    auto append = data.getAppender("one");
+
+    append("connected to host alpha in 12 ms");
+    append("connected to host beta in 7 ms");
+    append("disk  full");
+    append("connected to host gamma in 130 ms");
+    append("connected to 10.0.0.1");
+
+    auto templates = data.getTemplates();
+    ASSERT_EQ(templates.size(), 3U);
+    EXPECT_EQ(templates[0].text, "connected to host <*> in <*> ms");
+    EXPECT_EQ(templates[0].count, 3U);
+
+    // Lines are rendered exactly, including those stored before
+    // their template gained wildcards
+    data.prepareLines();
+    EXPECT_EQ(data.nextLine().text, "connected to host alpha in 12 ms");
+    EXPECT_EQ(data.nextLine().text, "connected to host beta in 7 ms");
+    EXPECT_EQ(data.nextLine().text, "disk  full");
+    EXPECT_EQ(data.nextLine().text, "connected to host gamma in 130 ms");
+    EXPECT_EQ(data.nextLine().text, "connected to 10.0.0.1");
+}
+
+TEST(DataModel, testReadingCompressedLines)
+{
+    DataModel data;
+    auto append = data.getAppender("one");
+
+    const int kLines = 100000;
+    for (int i = 0; i < kLines; i++) {
+        append("request " + std::to_string(i * 7919 % kLines) + " served from cache node-" + std::to_string(i % 13));
+    }
+
+    // Jump between sealed blocks, the open block and back
+    for (int position : {0, 99999, 54321, 1, 77777, 54322}) {
+        data.scrollTo(position);
+        data.prepareLines();
+        EXPECT_EQ(data.nextLine().text,
+            "request " + std::to_string(position * 7919 % kLines) + " served from cache node-" + std::to_string(position % 13));
+    }
+}
+
+TEST(DataModel, testExportVisible)
+{
+    auto exec = std::make_shared<ExecMock>();
+    exec->execHandler = [] (auto, auto) { return "note\n"; };
+    DataModel data(exec);
+
+    auto append = data.getAppender("one");
+    auto tabNoise = data.addFilter("noise", ".*noise.*");
+    data.addFilter("error", ".*error.*");
+    data.addExternal("error", "some-command");
+
+    std::string expected;
+    for (int i = 0; i < 200000; i++) {
+        auto line = "line " + std::to_string(i);
+        if (i % 3 == 0) {
+            append(line + " noise");
+        }
+        else if (i % 1000 == 1) {
+            append(line + " error");
+            expected += line + " error\n        |> note\n";
+        }
+        else {
+            append(line);
+            expected += line + "\n";
+        }
+    }
+    data.toggleTab(tabNoise);
+
+    auto path = ::testing::TempDir() + "logalizer_export.txt";
+    size_t exported = 0;
+    ASSERT_EQ(data.exportVisible(path, &exported), true);
+    EXPECT_EQ(exported, 200000U - 66667U);
+
+    std::ifstream file(path);
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(contents, expected);
+    std::remove(path.c_str());
+}
+
+TEST(DataModel, testExportDoesNotBlockIngestion)
+{
+    DataModel data;
+    auto append = data.getAppender("one");
+    for (int i = 0; i < 100000; i++) {
+        append("line " + std::to_string(i));
+    }
+
+    // The export blocks writing to a pipe nobody reads yet
+    auto path = ::testing::TempDir() + "logalizer_export.fifo";
+    std::remove(path.c_str());
+    ASSERT_EQ(::mkfifo(path.c_str(), 0600), 0);
+    int fd = ::open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    ASSERT_GE(fd, 0);
+
+    size_t exported = 0u;
+    auto exporting = std::async(std::launch::async, [&data, &path, &exported] () {
+        return data.exportVisible(path, &exported);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    auto appending = std::async(std::launch::async, [&append] () { append("added during the export"); });
+    EXPECT_EQ(appending.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+
+    std::vector<char> buffer(64u * 1024u);
+    size_t size = 0u;
+    while (exporting.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        ssize_t cnt = ::read(fd, buffer.data(), buffer.size());
+        size += cnt > 0 ? cnt : 0;
+    }
+    ssize_t cnt;
+    while ((cnt = ::read(fd, buffer.data(), buffer.size())) > 0) {
+        size += cnt;
+    }
+    ::close(fd);
+    std::remove(path.c_str());
+
+    // Only the lines present when it started are exported
+    EXPECT_TRUE(exporting.get());
+    EXPECT_EQ(exported, 100000u);
+    EXPECT_EQ(data.getVisibleCnt(), 100001u);
+    size_t expected = 0u;
+    for (int i = 0; i < 100000; i++) {
+        expected += ("line " + std::to_string(i) + "\n").size();
+    }
+    EXPECT_EQ(size, expected);
+}
+
+TEST(DataModel, testFields)
+{
+    DataModel data;
+    auto tab = data.addFilter("requests", ".*status=(?<status>\\w+) took (?<ms>[0-9.]+)ms.*");
+    auto append = data.getAppender("one");
+
+    append("GET / status=OK took 12ms");
+    append("GET /a status=FAIL took 30ms");
+    append("unrelated");
+    append("GET /b status=OK took 6.5ms");
+
+    auto fields = data.getFields();
+    ASSERT_EQ(fields.size(), 2u);
+
+    EXPECT_EQ(fields[0].name, "status");
+    EXPECT_EQ(fields[0].tab, tab);
+    EXPECT_FALSE(fields[0].numeric);
+    ASSERT_FALSE(fields[0].top.empty());
+    EXPECT_EQ(fields[0].top[0], std::make_pair(std::string("OK"), size_t{2}));
+
+    EXPECT_EQ(fields[1].name, "ms");
+    EXPECT_TRUE(fields[1].numeric);
+    EXPECT_EQ(fields[1].count, 3u);
+    EXPECT_DOUBLE_EQ(fields[1].sum, 48.5);
+    EXPECT_DOUBLE_EQ(fields[1].max, 30.0);
+    EXPECT_EQ(data.getTab(tab).rowsCnt, 3u);
+}
+
+TEST(DataModel, testSampling)
+{
+    DataModel data;
+    data.setSampling("one", 10);
+    auto errors = data.addFilter("errors", ".*error.*");
+    auto src = data.addSource("one");
+
+    for (int i = 0; i < 100; i++) {
+        data.addLine(i % 20 == 0 ? "error " + std::to_string(i) : "noise " + std::to_string(i), src);
+    }
+    data.addDropped(src, 7);
+
+    EXPECT_EQ(data.getTab(errors).rowsCnt, 5u);
+    EXPECT_EQ(data.getTab(errors).sampled, 0u);
+    EXPECT_EQ(data.getTab(src).rowsCnt, 10u);
+    EXPECT_EQ(data.getTab(src).sampled, 85u);
+    EXPECT_EQ(data.getTab(src).dropped, 7u);
+    EXPECT_EQ(data.getVisibleCnt(), 15u);
+}
+
+TEST(DataModel, testClassifiedLines)
+{
+    std::vector<std::string> texts;
+    for (int i = 0; i < 100; i++) {
+        texts.push_back(i % 4 == 0 ? "GET /" + std::to_string(i) + " took " + std::to_string(i) + " ms"
+                                   : "noise " + std::to_string(i));
+    }
+    std::vector<std::string_view> lines(texts.begin(), texts.end());
+
+    DataModel serial;
+    DataModel classified;
+    for (auto data : {&serial, &classified}) {
+        data->addFilter("requests", "GET .* took (?<ms>[0-9]+) ms");
+        data->addFilter("noise", "noise.*");
+        data->addSource("input");
+    }
+
+    serial.addLines(lines, 2);
+
+    // Classified on another thread, as while indexing a file
+    std::vector<int> classes;
+    std::thread([&classified, &lines, &classes] () {
+        classified.getClassifier()(lines, &classes);
+    }).join();
+    classified.addClassifiedLines(lines, classes, 2);
+
+    for (uint8_t tab = 0; tab < 3; tab++) {
+        EXPECT_EQ(classified.getTab(tab).rowsCnt, serial.getTab(tab).rowsCnt);
+    }
+    EXPECT_EQ(classified.getTab(0).rowsCnt, 25u);
+    EXPECT_EQ(classified.getFields()[0].count, 25u);
+    EXPECT_DOUBLE_EQ(classified.getFields()[0].sum, serial.getFields()[0].sum);
+    EXPECT_EQ(classified.getFilters()[0].matched, 25u);
+    EXPECT_EQ(classified.getFilters()[1].tried, 75u);
+}
+
+TEST(DataModel, testPrependingHistory)
+{
+    DataModel data;
+    auto errors = data.addFilter("errors", ".*error.*");
+    auto src = data.addSource("one");
+
+    auto batch = [](int first, int last) {
+        std::vector<std::string> texts;
+        for (int i = first; i < last; i++) {
+            texts.push_back("line " + std::to_string(i) + (i % 10 == 0 ? " error" : ""));
+        }
+        return texts;
+    };
+    auto add = [&](int first, int last, bool history) {
+        auto texts = batch(first, last);
+        std::vector<std::string_view> lines(texts.begin(), texts.end());
+        history ? data.prependLines(lines, src) : data.addLines(lines, src);
+    };
+
+    // Tail, two blocks of history, and lines appended in between
+    add(3000, 4000, false);
+    data.scrollTo(500u);
+    add(2000, 3000, true);
+    add(4000, 4500, false);
+    add(0, 2000, true);
+
+    EXPECT_EQ(data.getVisibleCnt(), 4500u);
+    EXPECT_EQ(data.getTab(errors).rowsCnt, 450u);
+    EXPECT_EQ(data.getTab(src).rowsCnt, 4050u);
+
+    // The view stays on its line
+    EXPECT_EQ(data.getPosition(), 3500u);
+
+    DataModel::View view;
+    auto lines = data.getLines(view, 0u, 4500u);
+    ASSERT_EQ(lines.size(), 4500u);
+    for (size_t i = 0; i < lines.size(); i++) {
+        ASSERT_EQ(lines[i].text, batch(i, i + 1)[0]);
+    }
+
+    view.disabled.set(src);
+    lines = data.getLines(view, 299u, 2u);
+    ASSERT_EQ(lines.size(), 2u);
+    EXPECT_EQ(lines[0].text, "line 2990 error");
+    EXPECT_EQ(lines[1].text, "line 3000 error");
+
+    auto path = ::testing::TempDir() + "logalizer_history.txt";
+    size_t exported = 0;
+    ASSERT_TRUE(data.exportVisible(path, &exported));
+    std::ifstream file(path);
+    std::string line;
+    for (int i = 0; std::getline(file, line); i++) {
+        ASSERT_EQ(line, batch(i, i + 1)[0]);
+    }
+    EXPECT_EQ(exported, 4500u);
+    std::remove(path.c_str());
+}
+
+TEST(DataModel, testManySegments)
+{
+    DataModel data;
+    auto errors = data.addFilter("errors", ".*error.*");
+    auto src = data.addSource("one");
+
+    auto text = [](int i) { return "line " + std::to_string(i) + (i % 3 == 0 ? " error" : ""); };
+    auto add = [&](int first, int last, bool history) {
+        std::vector<std::string> texts;
+        for (int i = first; i < last; i++) {
+            texts.push_back(text(i));
+        }
+        std::vector<std::string_view> lines(texts.begin(), texts.end());
+        history ? data.prependLines(lines, src) : data.addLines(lines, src);
+    };
+
+    // History and live lines arriving in turn, each batch a segment
+    const int kBatches = 1000;
+    for (int i = 0; i < kBatches; i++) {
+        add((kBatches - i - 1) * 4, (kBatches - i) * 4, true);
+        add(kBatches * 4 + i * 3, kBatches * 4 + i * 3 + 3, false);
+    }
+
+    const size_t total = kBatches * 7u;
+    ASSERT_EQ(data.getVisibleCnt(), total);
+    DataModel::View view;
+    auto lines = data.getLines(view, 0u, total);
+    ASSERT_EQ(lines.size(), total);
+    for (size_t i = 0; i < lines.size(); i++) {
+        ASSERT_EQ(lines[i].text, text(i));
+    }
+
+    // Positions and lines agree, also with a tab hidden
+    data.toggleTab(errors);
+    size_t visible = data.getVisibleCnt();
+    EXPECT_EQ(visible, total - (total + 2u) / 3u);
+    for (size_t position : {0ul, 1ul, 777ul, visible / 2u, visible - 1u}) {
+        ASSERT_TRUE(data.scrollTo(position) || position == 0u);
+        EXPECT_EQ(data.getPosition(), position);
+        data.prepareLines();
+        auto line = data.nextLine();
+        size_t expected = position + position / 2u + 1u;
+        EXPECT_EQ(line.text, text(expected));
+    }
+}
+
+TEST(DataModel, testDropFilters)
+{
+    DataModel data;
+    data.addDropFilter("health", ".*GET /health.*");
+    data.addDropFilter("debug", ".*DEBUG [a-z]+");
+    auto errors = data.addFilter("errors", ".*ERROR.*");
+    auto src = data.addSource("one");
+
+    std::vector<std::string> texts;
+    for (int i = 0; i < 100; i++) {
+        texts.push_back(i % 5 == 0 ? "GET /health ERROR " + std::to_string(i)
+                      : i % 5 == 1 ? "DEBUG noise"
+                      : "ERROR " + std::to_string(i));
+    }
+    std::vector<std::string_view> lines(texts.begin(), texts.end());
+    data.addLines(lines, src);
+
+    // Classified on another thread
+    std::vector<int> classes;
+    std::thread([&data, &lines, &classes] () { data.getClassifier()(lines, &classes); }).join();
+    data.addClassifiedLines(lines, classes, src);
+
+    EXPECT_EQ(data.getVisibleCnt(), 120u);
+    EXPECT_EQ(data.getTab(errors).rowsCnt, 120u);
+    EXPECT_EQ(data.getTab(src).rowsCnt, 0u);
+
+    auto filters = data.getFilters();
+    ASSERT_EQ(filters.size(), 3u);
+    EXPECT_TRUE(filters[0].drop);
+    EXPECT_EQ(filters[0].name, "health");
+    EXPECT_EQ(filters[0].matched, 40u);
+    EXPECT_EQ(filters[1].matched, 40u);
+    EXPECT_FALSE(filters[2].drop);
+    EXPECT_EQ(filters[2].tried, 120u);
+}
+
+TEST(DataModel, testMultilineRecords)
+{
+    DataModel data;
+    auto errors = data.addFilter("errors", ".*ERROR.*at (?<function>\\w+)\\(\\).*");
+    auto src = data.addSource("one");
+
+    std::vector<std::string_view> lines = {"INFO start", "ERROR failed\n  at parse()\n  at main()"};
+    data.addLines(lines, src);
+
+    EXPECT_EQ(data.getTab(errors).rowsCnt, 1u);
+    EXPECT_EQ(data.getTab(src).rowsCnt, 1u);
+
+    auto fields = data.getFields();
+    ASSERT_EQ(fields.size(), 1u);
+    ASSERT_FALSE(fields[0].top.empty());
+    EXPECT_EQ(fields[0].top[0], std::make_pair(std::string("main"), size_t{1}));
+
+    data.scrollTo(0u);
+    data.prepareLines();
+    data.nextLine();
+    EXPECT_EQ(data.nextLine().text, "ERROR failed\n  at parse()\n  at main()");
+}
+
+TEST(DataModel, testRelatedLines)
+{
+    DataModel data;
+    EXPECT_TRUE(data.addKey("request", "req=(\\w+)"));
+    auto errors = data.addFilter("errors", ".*ERROR.*");
+    auto append = data.getAppender("one");
+
+    append("start req=a");
+    append("start req=b");
+    append("ERROR req=a");
+    append("no key");
+    append("done req=a");
+
+    auto related = data.getRelated(10u);
+    EXPECT_EQ(related.name, "request");
+    EXPECT_EQ(related.key, "a");
+    EXPECT_EQ(related.count, 3u);
+    EXPECT_EQ(related.position, 0u);
+    ASSERT_EQ(related.lines.size(), 3u);
+    EXPECT_EQ(related.lines[1].text, "ERROR req=a");
+
+    // Cycles across tabs and wraps around
+    EXPECT_EQ(data.scrollToRelated().position, 1u);
+    EXPECT_EQ(data.getPosition(), 2u);
+    EXPECT_EQ(data.scrollToRelated().position, 2u);
+    EXPECT_EQ(data.getPosition(), 4u);
+    EXPECT_EQ(data.scrollToRelated().position, 0u);
+    EXPECT_EQ(data.getPosition(), 0u);
+    EXPECT_EQ(data.scrollToRelated(true).position, 2u);
+
+    // Lines of disabled tabs are left out
+    data.toggleTab(errors);
+    related = data.getRelated(10u);
+    EXPECT_EQ(related.count, 2u);
+
+    data.scrollTo(2u);
+    EXPECT_EQ(data.getRelated(10u).count, 0u);
+}
+
+TEST(DataModel, testQuery)
+{
+    DataModel data;
+    auto errors = data.addFilter("errors", ".*ERROR.*");
+    auto src = data.addSource("one");
+
+    // Several chunks, scanned in parallel
+    std::vector<std::string> texts;
+    for (int i = 0; i < 40000; i++) {
+        texts.push_back((i % 10 == 0 ? "ERROR " : "INFO ") + std::string("user=u") + std::to_string(i % 7));
+    }
+    data.addLines(std::vector<std::string_view>(texts.begin(), texts.end()), src);
+
+    EXPECT_FALSE(data.startQuery("user=u[12"));
+    ASSERT_TRUE(data.startQuery("user=u[12]$"));
+    ASSERT_EQ(data.getTabCnt(), 3u);
+    auto query = data.getTabCnt() - 1u;
+    EXPECT_EQ(data.getTab(query).name, "/user=u[12]$/");
+
+    for (int i = 0; i < 1000 && data.getTab(query).indexed < 100u; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(data.getTab(query).indexed, 100u);
+
+    size_t expected = 0u;
+    size_t last = 0u;
+    for (int i = 0; i < 40000; i++) {
+        if (i % 7 == 1 || i % 7 == 2) {
+            expected++;
+            last = i;
+        }
+    }
+    EXPECT_EQ(data.getTab(query).rowsCnt, expected);
+    EXPECT_FALSE(data.getTab(query).enabled);
+    EXPECT_EQ(data.getVisibleCnt(), 40000u);
+
+    // Only the matching lines of the enabled tabs are shown
+    data.toggleTab(query);
+    EXPECT_EQ(data.getVisibleCnt(), expected);
+    data.prepareLines();
+    EXPECT_EQ(data.nextLine().text, "INFO user=u1");
+    EXPECT_EQ(data.nextLine().text, "INFO user=u2");
+    data.scrollTo(expected - 1u);
+    data.prepareLines();
+    EXPECT_EQ(data.nextLine().id, last);
+
+    data.toggleTab(errors);
+    size_t errorCnt = 0u;
+    for (int i = 0; i < 40000; i += 10) {
+        errorCnt += i % 7 == 1 || i % 7 == 2;
+    }
+    EXPECT_EQ(data.getVisibleCnt(), expected - errorCnt);
+    data.toggleTab(errors);
+
+    // Later lines are matched as they arrive
+    data.addLine("INFO user=u2", src);
+    data.addLine("INFO user=u3", src);
+    EXPECT_EQ(data.getVisibleCnt(), expected + 1u);
+
+    ASSERT_TRUE(data.startQuery(""));
+    EXPECT_EQ(data.getTabCnt(), 2u);
+    EXPECT_EQ(data.getVisibleCnt(), 40002u);
+}
+
+TEST(DataModel, testConcurrentQueries)
+{
+    DataModel data;
+    auto src = data.addSource("one");
+    std::vector<std::string> texts(40000, "INFO user=u1");
+    data.addLines(std::vector<std::string_view>(texts.begin(), texts.end()), src);
+
+    // Viewers and the shutdown may replace and stop the query at once
+    auto other = std::async(std::launch::async, [&data] () {
+        for (int i = 0; i < 20; i++) {
+            data.startQuery("user=u[12]");
+        }
+    });
+    for (int i = 0; i < 20; i++) {
+        data.startQuery("user=u1");
+        data.stopQuery();
+    }
+    other.get();
+
+    ASSERT_TRUE(data.startQuery("u1$"));
+    auto query = data.getTabCnt() - 1u;
+    for (int i = 0; i < 1000 && data.getTab(query).indexed < 100u; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(data.getTab(query).rowsCnt, 40000u);
+}
+
+TEST(DataModel, testLineLimit)
+{
+    DataModel data;
+    data.setLineLimit(16u);
+    auto tail = data.addFilter("tail", ".*needle$");
+    auto src = data.addSource("one");
+
+    std::string longLine = "GET /items?" + std::string(100, 'a') + " needle";
+    data.addLine("short line", src);
+    data.addLine(longLine, src);
+
+    data.prepareLines();
+    auto line = data.nextLine();
+    EXPECT_EQ(line.text, "short line");
+    EXPECT_EQ(line.fullLength, 0u);
+    line = data.nextLine();
+    EXPECT_EQ(line.text, longLine.substr(0, 16u));
+    EXPECT_EQ(line.fullLength, longLine.size());
+    EXPECT_EQ(data.getText(line.id), longLine);
+    EXPECT_EQ(data.getText(0u), "short line");
+
+    // Filters and queries see the whole line
+    EXPECT_EQ(data.getTab(tail).rowsCnt, 1u);
+    ASSERT_TRUE(data.startQuery("a needle"));
+    auto query = data.getTabCnt() - 1u;
+    for (int i = 0; i < 1000 && data.getTab(query).indexed < 100u; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(data.getTab(query).rowsCnt, 1u);
+    data.stopQuery();
+
+    auto path = ::testing::TempDir() + "logalizer_long.txt";
+    size_t exported = 0;
+    ASSERT_TRUE(data.exportVisible(path, &exported));
+    std::ifstream file(path);
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(contents, "short line\n" + longLine + "\n");
+    std::remove(path.c_str());
+}
@@ -0,0 +1,98 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "src/DataModel.hpp"
+#include "src/Exec.hpp"
+
+namespace {
+
+//! Answers every request with "seen:" and the line, like a co-process would.
+const char* kEchoCoprocess =
+    "while read -r id len; do "
+    "line=$(head -c \"$len\"); out=\"seen:$line\"; "
+    "printf '%s %s\\n%s' \"$id\" \"${#out}\" \"$out\"; "
+    "done";
+
+} // namespace
+
+TEST(Exec, testQuotedArgument)
+{
+    Exec exec;
+    EXPECT_EQ(exec.exec("echo", "it's a 'quoted' line"), "it's a 'quoted' line\n");
+    EXPECT_EQ(exec.exec("echo", "$HOME `true`"), "$HOME `true`\n");
+}
+
+TEST(Exec, testCoprocessAnswersAll)
+{
+    Coprocess coprocess(kEchoCoprocess);
+    ASSERT_EQ(coprocess.isRunning(), true);
+
+    const size_t kRequests = 1000;
+    std::mutex mtx;
+    std::condition_variable answered;
+    std::vector<std::string> results(kRequests);
+    size_t cnt = 0;
+
+    // All requests are sent before any answer is waited for
+    for (size_t i = 0; i < kRequests; i++) {
+        coprocess.send("it's line " + std::to_string(i), [&, i](std::string result) {
+            std::lock_guard<std::mutex> g(mtx);
+            results[i] = result;
+            cnt++;
+            answered.notify_one();
+        });
+    }
+
+    std::unique_lock<std::mutex> lock(mtx);
+    ASSERT_EQ(answered.wait_for(lock, std::chrono::seconds(10), [&](){ return cnt == kRequests; }), true);
+    for (size_t i = 0; i < kRequests; i++) {
+        EXPECT_EQ(results[i], "seen:it's line " + std::to_string(i));
+    }
+}
+
+TEST(Exec, testCoprocessExited)
+{
+    Coprocess coprocess("true");
+
+    std::atomic<int> empty{0};
+    for (int i = 0; i < 10; i++) {
+        coprocess.send("line", [&empty](std::string result) {
+            if (result.empty()) {
+                empty++;
+            }
+        });
+    }
+    coprocess.stop();
+
+    EXPECT_EQ(empty.load(), 10);
+    EXPECT_EQ(coprocess.isRunning(), false);
+}
+
+TEST(Exec, testCoprocessComments)
+{
+    DataModel data(std::make_shared<Exec>());
+    std::atomic<int> notified{0};
+    data.registerOnNewDataAvailableListener([&notified](){ notified++; });
+
+    auto append = data.getAppender("one");
+    data.addFilter("hello", ".*hello.*");
+    EXPECT_EQ(data.addExternal("hello", kEchoCoprocess, true), true);
+
+    append("hello world");
+    append("goodbye");
+    append("hello again");
+
+    // Comments arrive after the lines were added
+    data.waitForComments();
+    EXPECT_EQ(notified.load(), 5);
+
+    data.prepareLines();
+    EXPECT_EQ(data.nextLine().comment, "seen:hello world");
+    EXPECT_EQ(data.nextLine().comment, "");
+    EXPECT_EQ(data.nextLine().comment, "seen:hello again");
+}
@@ -0,0 +1,170 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/FileIndexer.hpp"
+
+namespace {
+
+struct Indexed {
+    std::mutex mtx;
+    std::vector<std::string> lines;
+    std::vector<int> classes;
+    size_t progress{0u};
+    std::atomic<bool> done{false};
+    size_t end{0u};
+
+    FileIndexer::OnLines onLines() {
+        return [this] (const std::vector<std::string_view>& batch, const std::vector<int>& batchClasses) {
+            std::lock_guard<std::mutex> g(mtx);
+            lines.insert(lines.end(), batch.begin(), batch.end());
+            classes.insert(classes.end(), batchClasses.begin(), batchClasses.end());
+        };
+    }
+
+    FileIndexer::OnProgress onProgress() {
+        return [this] (size_t indexed, size_t) {
+            std::lock_guard<std::mutex> g(mtx);
+            EXPECT_GE(indexed, progress);
+            progress = indexed;
+        };
+    }
+
+    FileIndexer::OnDone onDone() {
+        return [this] (size_t offset) {
+            end = offset;
+            done = true;
+        };
+    }
+
+    bool waitUntilDone() {
+        for (int i = 0; i < 1000 && !done; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return done;
+    }
+};
+
+//! Classifies lines by their length.
+FileIndexer::Classify classifyByLength() {
+    return [] (const std::vector<std::string_view>& lines, std::vector<int>* classes) {
+        classes->clear();
+        for (const auto& line : lines) {
+            classes->push_back(line.size() % 3u);
+        }
+    };
+}
+
+std::string tempPath(const std::string& name) {
+    return ::testing::TempDir() + "logalizer_" + name;
+}
+
+} // namespace
+
+TEST(FileIndexer, testLinesInFileOrder)
+{
+    // Spans several blocks, with lines crossing their boundaries
+    auto path = tempPath("indexed.log");
+    size_t complete = 0u;
+    {
+        std::ofstream file(path);
+        for (int i = 0; i < 300000; i++) {
+            std::string line = "line " + std::to_string(i) + " " + std::string(i % 50, 'x') + "\n";
+            if (i % 1000 == 0) {
+                line += "\n";
+            }
+            file << line;
+            complete += line.size();
+        }
+        file << "incomplete";
+    }
+
+    Indexed indexed;
+    FileIndexer indexer(classifyByLength, 4u);
+    ASSERT_TRUE(indexer.add(path, indexed.onLines(), indexed.onProgress(), indexed.onDone()));
+    ASSERT_TRUE(indexed.waitUntilDone());
+
+    ASSERT_EQ(indexed.lines.size(), 300000u);
+    for (size_t i = 0; i < indexed.lines.size(); i++) {
+        ASSERT_EQ(indexed.lines[i], "line " + std::to_string(i) + " " + std::string(i % 50, 'x'));
+        ASSERT_EQ(indexed.classes[i], static_cast<int>(indexed.lines[i].size() % 3u));
+    }
+    EXPECT_EQ(indexed.end, complete);
+    EXPECT_EQ(indexed.progress, complete);
+
+    std::remove(path.c_str());
+}
+
+TEST(FileIndexer, testStopping)
+{
+    auto path = tempPath("stopped.log");
+    {
+        std::ofstream file(path);
+        for (int i = 0; i < 1000000; i++) {
+            file << "line " << i << "\n";
+        }
+    }
+
+    Indexed indexed;
+    auto indexer = std::make_unique<FileIndexer>(nullptr, 2u);
+    ASSERT_TRUE(indexer->add(path, indexed.onLines(), nullptr, indexed.onDone()));
+    indexer->stop();
+    size_t cnt = indexed.lines.size();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(indexed.lines.size(), cnt);
+    for (size_t i = 0; i < cnt; i++) {
+        ASSERT_EQ(indexed.classes[i], -1);
+    }
+    indexer.reset();
+
+    std::remove(path.c_str());
+}
+
+TEST(FileIndexer, testFilesInTurn)
+{
+    // The workers are shared, each file's lines still arrive in order
+    std::vector<std::string> paths{tempPath("first.log"), tempPath("second.log"), tempPath("third.log")};
+    for (size_t f = 0; f < paths.size(); f++) {
+        std::ofstream file(paths[f]);
+        for (int i = 0; i < 100000; i++) {
+            file << "file " << f << " line " << i << "\n";
+        }
+    }
+
+    Indexed indexed[3];
+    FileIndexer indexer(classifyByLength, 3u);
+    for (size_t f = 0; f < paths.size(); f++) {
+        ASSERT_TRUE(indexer.add(paths[f], indexed[f].onLines(), nullptr, indexed[f].onDone()));
+    }
+    EXPECT_FALSE(indexer.add(tempPath("missing.log"), indexed[0].onLines(), nullptr, indexed[0].onDone()));
+
+    for (size_t f = 0; f < paths.size(); f++) {
+        ASSERT_TRUE(indexed[f].waitUntilDone());
+        ASSERT_EQ(indexed[f].lines.size(), 100000u);
+        for (size_t i = 0; i < indexed[f].lines.size(); i++) {
+            ASSERT_EQ(indexed[f].lines[i], "file " + std::to_string(f) + " line " + std::to_string(i));
+        }
+        std::remove(paths[f].c_str());
+    }
+}
+
+TEST(FileIndexer, testIsIndexable)
+{
+    auto path = tempPath("small.log");
+    std::ofstream(path) << "one\ntwo\n";
+
+    EXPECT_FALSE(FileIndexer::isIndexable(path));
+    EXPECT_TRUE(FileIndexer::isIndexable(path, 8u));
+    EXPECT_FALSE(FileIndexer::isIndexable(::testing::TempDir(), 0u));
+    EXPECT_FALSE(FileIndexer::isIndexable(tempPath("missing.log"), 0u));
+
+    std::remove(path.c_str());
+}
@@ -0,0 +1,264 @@
+#include "gtest/gtest.h"
+
+#include <sys/stat.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "src/FilterSet.hpp"
+
+namespace {
+
+std::string tempPath(const std::string& name) {
+    return ::testing::TempDir() + "logalizer_" + name;
+}
+
+} // namespace
+
+TEST(FilterSet, testRequiredLiteral)
+{
+    EXPECT_EQ(FilterSet::requiredLiteral(".*kernel.*"), "kernel");
+    EXPECT_EQ(FilterSet::requiredLiteral("^error: [0-9]+ failed$"), "error: ");
+    EXPECT_EQ(FilterSet::requiredLiteral(".*colou?r.*"), "colo");
+    EXPECT_EQ(FilterSet::requiredLiteral("a\\.b\\d+xyz"), "a.b");
+    EXPECT_EQ(FilterSet::requiredLiteral(".*(foo|bar)baz.*"), "baz");
+    EXPECT_EQ(FilterSet::requiredLiteral("foo|bar"), "");
+    EXPECT_EQ(FilterSet::requiredLiteral("x{2}[]abc]y"), "y");
+    EXPECT_EQ(FilterSet::requiredLiteral(".*"), "");
+
+    // Escapes and their arguments are skipped as a whole
+    EXPECT_EQ(FilterSet::requiredLiteral(".*\\x41.*"), "");
+    EXPECT_EQ(FilterSet::requiredLiteral("\\x41BCDE"), "BCDE");
+    EXPECT_EQ(FilterSet::requiredLiteral("\\u0041BC"), "BC");
+    EXPECT_EQ(FilterSet::requiredLiteral("\\cJab"), "ab");
+    EXPECT_EQ(FilterSet::requiredLiteral("\\0123"), "123");
+    EXPECT_EQ(FilterSet::requiredLiteral("(x)\\12ab"), "ab");
+    EXPECT_EQ(FilterSet::requiredLiteral("id\\d\\w\\sname"), "name");
+    EXPECT_EQ(FilterSet::requiredLiteral(""), "");
+}
+
+TEST(FilterSet, testStripNamedGroups)
+{
+    std::vector<std::pair<std::string, size_t>> fields;
+    auto stripped = FilterSet::stripNamedGroups(
+        "(a|b) (?:x)(?<status>[0-9]+) [(?<no>] \\(?<no>) (?<ms>\\d+)ms", &fields);
+
+    EXPECT_EQ(stripped, "(a|b) (?:x)([0-9]+) [(?<no>] \\(?<no>) (\\d+)ms");
+    ASSERT_EQ(fields.size(), 2u);
+    EXPECT_EQ(fields[0], std::make_pair(std::string("status"), size_t{2}));
+    EXPECT_EQ(fields[1], std::make_pair(std::string("ms"), size_t{3}));
+}
+
+TEST(FilterSet, testAutomatonScan)
+{
+    LiteralAutomaton automaton;
+    automaton.build({"he", "she", "his", "hers"});
+
+    std::vector<uint32_t> found;
+    automaton.scan("ushers", [&found](uint32_t id) { found.push_back(id); });
+
+    EXPECT_EQ(found, (std::vector<uint32_t>{1, 0, 3}));
+}
+
+TEST(FilterSet, testAutomatonSaveAndLoad)
+{
+    auto filename = tempPath("automaton.ac");
+
+    LiteralAutomaton built;
+    built.build({"abc", "bcd"});
+    ASSERT_TRUE(built.save(filename, 42u));
+
+    LiteralAutomaton loaded;
+    EXPECT_FALSE(loaded.load(filename, 43u, 2u));
+    ASSERT_TRUE(loaded.load(filename, 42u, 2u));
+    EXPECT_EQ(loaded.getStateCnt(), built.getStateCnt());
+
+    std::vector<uint32_t> found;
+    loaded.scan("xabcde", [&found](uint32_t id) { found.push_back(id); });
+    EXPECT_EQ(found, (std::vector<uint32_t>{0, 1}));
+
+    // Literal ids beyond those the automaton is used with
+    EXPECT_FALSE(loaded.load(filename, 42u, 1u));
+
+    std::remove(filename.c_str());
+}
+
+TEST(FilterSet, testCorruptAutomaton)
+{
+    auto filename = tempPath("corrupt.ac");
+
+    LiteralAutomaton built;
+    built.build({"abc", "bcd"});
+    ASSERT_TRUE(built.save(filename, 42u));
+
+    // A transition to a state past the last one, right after the header
+    {
+        std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(32 + 'a' * 4);
+        uint32_t state = 1000000u;
+        file.write(reinterpret_cast<const char*>(&state), sizeof(state));
+    }
+
+    LiteralAutomaton loaded;
+    EXPECT_FALSE(loaded.load(filename, 42u, 2u));
+    EXPECT_EQ(loaded.getStateCnt(), 0u);
+
+    std::remove(filename.c_str());
+}
+
+TEST(FilterSet, testMatchesLikeRegex)
+{
+    const std::vector<std::string> patterns = {
+        ".*kernel.*", ".*(usb|pci).*", "^[a-z]+ error.*", ".*warn(ing)?.*", "["};
+    const std::vector<std::string> lines = {
+        "kernel: usb 1-1 connected", "pci bus scan", "disk error on sda",
+        "a warning", "warn", "nothing", "Disk error", "["};
+
+    FilterSet filters;
+    for (size_t i = 0; i < patterns.size(); i++) {
+        filters.add(i, "f" + std::to_string(i), patterns[i]);
+    }
+
+    for (const auto& line : lines) {
+        int expected = -1;
+        for (size_t i = 0; i + 1u < patterns.size(); i++) {
+            if (std::regex_match(line, std::regex(patterns[i]))) {
+                expected = i;
+                break;
+            }
+        }
+        auto filter = filters.match(line);
+        EXPECT_EQ(filter != nullptr ? filter->src : -1, expected) << line;
+    }
+}
+
+TEST(FilterSet, testCachedAutomaton)
+{
+    auto root = tempPath("cache");
+    auto directory = root + "/filters";
+    std::system(("rm -rf " + root).c_str());
+
+    FilterSet first;
+    first.setCacheDirectory(directory);
+    first.add(0, "kernel", ".*kernel.*");
+    first.add(1, "systemd", ".*systemd.*");
+    ASSERT_NE(first.match("systemd[1]: started"), nullptr);
+    EXPECT_FALSE(first.isCached());
+
+    FilterSet second;
+    second.setCacheDirectory(directory);
+    second.add(0, "kernel", ".*kernel.*");
+    second.add(1, "systemd", ".*systemd.*");
+    auto filter = second.match("systemd[1]: started");
+    EXPECT_TRUE(second.isCached());
+    ASSERT_NE(filter, nullptr);
+    EXPECT_EQ(filter->name, "systemd");
+
+    FilterSet changed;
+    changed.setCacheDirectory(directory);
+    changed.add(0, "kernel", ".*kern.*");
+    EXPECT_NE(changed.match("kernel: boot"), nullptr);
+    EXPECT_FALSE(changed.isCached());
+
+    std::system(("rm -rf " + root).c_str());
+}
+
+TEST(FilterSet, testIsBacktrackProne)
+{
+    EXPECT_EQ(FilterSet::isBacktrackProne("(a+)+b"), true);
+    EXPECT_EQ(FilterSet::isBacktrackProne("(.*,)*x"), true);
+    EXPECT_EQ(FilterSet::isBacktrackProne("(.*)*"), true);
+    EXPECT_EQ(FilterSet::isBacktrackProne("(?:a|b)(x*y?)+$"), true);
+    EXPECT_EQ(FilterSet::isBacktrackProne("(\\s*\\w+)*:"), true);
+    EXPECT_EQ(FilterSet::isBacktrackProne("(\\w+\\s?){2,}$"), true);
+
+    EXPECT_EQ(FilterSet::isBacktrackProne(".*kernel.*"), false);
+    EXPECT_EQ(FilterSet::isBacktrackProne("(ab)+c*"), false);
+    EXPECT_EQ(FilterSet::isBacktrackProne("(a+)?b"), false);
+    EXPECT_EQ(FilterSet::isBacktrackProne("[(a+)]+"), false);
+    EXPECT_EQ(FilterSet::isBacktrackProne("\\(a+\\)+"), false);
+    EXPECT_EQ(FilterSet::isBacktrackProne("(a{1,3})+"), false);
+    // The repetitions can only split the text one way
+    EXPECT_EQ(FilterSet::isBacktrackProne("((ab)*c)+"), false);
+    EXPECT_EQ(FilterSet::isBacktrackProne("(\\d+\\.)+\\d+"), false);
+    EXPECT_EQ(FilterSet::isBacktrackProne(".*(\\w+\\.)+com"), false);
+    EXPECT_EQ(FilterSet::isBacktrackProne("(?:[a-z]+,)*end"), false);
+
+    FilterSet filters;
+    EXPECT_EQ(filters.add(0, "prone", "(a+)+b").warning, "backtracking");
+    EXPECT_EQ(filters.add(1, "fine", "a+b").warning, "");
+    EXPECT_EQ(filters.match(std::string(600, 'a') + "b"), &filters.getFilters()[1]);
+}
+
+TEST(FilterSet, testProneFilterBounded)
+{
+    FilterSet filters;
+    filters.add(0, "prone", "(a+)+b");
+    const auto& filter = filters.getFilters()[0];
+
+    // Takes seconds in std::regex if tried at all
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(filters.match(std::string(26, 'a') + "cb"), nullptr);
+    EXPECT_EQ(filter.skipped, 1u);
+
+    // The worst case of a line short enough to be tried
+    EXPECT_EQ(filters.match(std::string(14, 'a') + "cb"), nullptr);
+    EXPECT_EQ(filter.tried, 1u);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(100));
+    EXPECT_NE(filters.match("aaab"), nullptr);
+}
+
+TEST(FilterSet, testSlowFilterDemoted)
+{
+    FilterSet filters;
+    filters.add(0, "slow", "x.*");
+    // Every line takes longer than no time at all.
+    filters.setLineBudget(std::chrono::nanoseconds(0));
+    const auto& filter = filters.getFilters()[0];
+
+    EXPECT_NE(filters.match("x" + std::string(99, 'y')), nullptr);
+    EXPECT_EQ(filter.warning, "slow");
+    EXPECT_EQ(filter.maxLength, 50u);
+
+    // Longer lines are skipped, shorter ones still tried
+    EXPECT_EQ(filters.match("x" + std::string(59, 'y')), nullptr);
+    EXPECT_EQ(filter.skipped, 1u);
+    EXPECT_NE(filters.match("x" + std::string(39, 'y')), nullptr);
+    EXPECT_EQ(filter.maxLength, 20u);
+
+    EXPECT_NE(filters.match("xy"), nullptr);
+    EXPECT_EQ(filter.warning, "disabled");
+    EXPECT_EQ(filters.match("xy"), nullptr);
+
+    EXPECT_EQ(filter.tried, 3u);
+    EXPECT_EQ(filter.matched, 3u);
+    EXPECT_GT(filter.time.count(), 0);
+}
+
+TEST(FilterSet, testLiteralPattern)
+{
+    EXPECT_TRUE(FilterSet::isLiteralPattern(".*health.*", "health"));
+    EXPECT_TRUE(FilterSet::isLiteralPattern(".*GET /ping\\?x.*", "GET /ping?x"));
+    EXPECT_FALSE(FilterSet::isLiteralPattern(".*health", "health"));
+    EXPECT_FALSE(FilterSet::isLiteralPattern(".*heal.h.*", "heal"));
+    EXPECT_FALSE(FilterSet::isLiteralPattern(".*a|b.*", ""));
+    EXPECT_FALSE(FilterSet::isLiteralPattern(".*a\\.*", "a"));
+
+    FilterSet filters;
+    filters.add(0, "ping", ".*GET /ping.*");
+    filters.add(1, "other", "other.*");
+    EXPECT_TRUE(filters.getFilters()[0].literalOnly);
+    EXPECT_FALSE(filters.getFilters()[1].literalOnly);
+
+    EXPECT_EQ(filters.classify("10:00 GET /ping 200"), 0);
+    EXPECT_EQ(filters.classify("10:00 GET /pong 200"), -1);
+    EXPECT_EQ(filters.classify("other GET /ping"), 0);
+    // "." doesn't match a carriage return, so the regex decides
+    EXPECT_EQ(filters.classify("GET /ping\r"), -1);
+    EXPECT_EQ(filters.getFilters()[0].matched, 2u);
+}
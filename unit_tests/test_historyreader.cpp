@@ -0,0 +1,116 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/HistoryReader.hpp"
+
+namespace {
+
+struct Loaded {
+    std::mutex mtx;
+    std::vector<std::vector<std::string>> blocks;
+    std::atomic<size_t> read{0u};
+
+    HistoryReader::OnLines onLines() {
+        return [this] (const std::vector<std::string_view>& lines) {
+            std::lock_guard<std::mutex> g(mtx);
+            blocks.emplace_back(lines.begin(), lines.end());
+        };
+    }
+
+    HistoryReader::OnProgress onProgress() {
+        return [this] (size_t bytes, size_t) {
+            std::lock_guard<std::mutex> g(mtx);
+            read = bytes;
+        };
+    }
+
+    bool waitFor(size_t cnt) {
+        for (int i = 0; i < 500; i++) {
+            {
+                std::lock_guard<std::mutex> g(mtx);
+                if (blocks.size() >= cnt) {
+                    return true;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return false;
+    }
+};
+
+std::string tempPath(const std::string& name) {
+    return ::testing::TempDir() + "logalizer_" + name;
+}
+
+} // namespace
+
+TEST(HistoryReader, testSeekingTail)
+{
+    auto path = tempPath("tail.log");
+    std::ofstream(path) << "one\ntwo\nthree\nfour\n";
+
+    Reactor reactor;
+    Loaded loaded;
+    HistoryReader reader(reactor, path, loaded.onLines(), loaded.onProgress());
+    ASSERT_TRUE(reader.isOpen());
+    EXPECT_EQ(reader.seekTail(2u), 8u);
+
+    reader.load();
+    ASSERT_TRUE(loaded.waitFor(1u));
+    EXPECT_EQ(loaded.blocks[0], std::vector<std::string>({"one", "two"}));
+    EXPECT_EQ(loaded.read, 19u);
+
+    // Everything was loaded
+    reader.load();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(loaded.blocks.size(), 1u);
+
+    EXPECT_EQ(reader.seekTail(10u), 0u);
+
+    std::remove(path.c_str());
+}
+
+TEST(HistoryReader, testLoadingBlocksBackwards)
+{
+    auto path = tempPath("history.log");
+    size_t size = 0u;
+    {
+        std::ofstream file(path);
+        for (int i = 0; i < 300000; i++) {
+            file << "line " << i << "\n";
+        }
+        file << "incomplete";
+        size = file.tellp();
+    }
+
+    Reactor reactor;
+    Loaded loaded;
+    HistoryReader reader(reactor, path, loaded.onLines(), loaded.onProgress());
+    reader.seekTail(1000u);
+
+    for (size_t blocks = 1u; loaded.read < size; blocks++) {
+        reader.load();
+        ASSERT_TRUE(loaded.waitFor(blocks));
+    }
+    ASSERT_GT(loaded.blocks.size(), 1u);
+
+    // Blocks come newest first, with the lines of each in file order
+    std::vector<std::string> lines;
+    for (auto block = loaded.blocks.rbegin(); block != loaded.blocks.rend(); block++) {
+        lines.insert(lines.end(), block->begin(), block->end());
+    }
+    ASSERT_EQ(lines.size(), 299001u);
+    for (size_t i = 0; i < lines.size(); i++) {
+        ASSERT_EQ(lines[i], "line " + std::to_string(i));
+    }
+
+    std::remove(path.c_str());
+}
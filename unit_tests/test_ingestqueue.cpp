@@ -0,0 +1,181 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/IngestQueue.hpp"
+
+namespace {
+
+struct Consumer {
+    std::mutex mtx;
+    std::vector<std::string> lines;
+    std::atomic<size_t> dropped{0};
+    std::promise<void> release;
+    std::shared_future<void> released{release.get_future().share()};
+
+    IngestQueue::OnLines onLines(bool wait) {
+        return [this, wait] (const std::vector<std::string_view>& batch) {
+            if (wait) {
+                released.wait();
+            }
+            std::lock_guard<std::mutex> g(mtx);
+            lines.insert(lines.end(), batch.begin(), batch.end());
+        };
+    }
+
+    IngestQueue::OnDropped onDropped() {
+        return [this] (size_t cnt) { dropped += cnt; };
+    }
+};
+
+std::vector<std::string_view> batch(const std::vector<std::string>& lines) {
+    return {lines.begin(), lines.end()};
+}
+
+} // namespace
+
+TEST(IngestQueue, testParsePolicy)
+{
+    IngestQueue::Policy policy;
+    size_t capacity = 0;
+
+    EXPECT_TRUE(IngestQueue::parsePolicy("block", &policy, &capacity));
+    EXPECT_EQ(policy, IngestQueue::Policy::Block);
+    EXPECT_EQ(capacity, IngestQueue::kDefaultCapacity);
+
+    EXPECT_TRUE(IngestQueue::parsePolicy("drop:100", &policy, &capacity));
+    EXPECT_EQ(policy, IngestQueue::Policy::Drop);
+    EXPECT_EQ(capacity, 100u);
+
+    EXPECT_FALSE(IngestQueue::parsePolicy("sample", &policy, &capacity));
+    EXPECT_FALSE(IngestQueue::parsePolicy("drop:0", &policy, &capacity));
+    EXPECT_FALSE(IngestQueue::parsePolicy("drop:x", &policy, &capacity));
+}
+
+TEST(IngestQueue, testBlockKeepsAllLines)
+{
+    Consumer consumer;
+    IngestQueue::Worker worker;
+    IngestQueue queue(worker, IngestQueue::Policy::Block, 4, consumer.onLines(false), consumer.onDropped());
+
+    std::vector<std::string> lines;
+    for (int i = 0; i < 1000; i++) {
+        lines.push_back("line " + std::to_string(i));
+    }
+    for (size_t i = 0; i < lines.size(); i += 10) {
+        queue.push(batch({lines.begin() + i, lines.begin() + i + 10}));
+        queue.waitForSpace();
+    }
+
+    std::promise<void> finished;
+    queue.finish([&finished] () { finished.set_value(); });
+    ASSERT_EQ(finished.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+
+    EXPECT_EQ(consumer.lines, lines);
+    EXPECT_EQ(consumer.dropped, 0u);
+}
+
+TEST(IngestQueue, testDropWhenFull)
+{
+    Consumer consumer;
+    IngestQueue::Worker worker;
+    IngestQueue queue(worker, IngestQueue::Policy::Drop, 3, consumer.onLines(true), consumer.onDropped());
+
+    // The first batch is taken by the worker, which waits in the consumer.
+    queue.push(batch({"a"}));
+    for (int i = 0; i < 100 && consumer.dropped == 0u; i++) {
+        queue.push(batch({"b", "c"}));
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_GT(consumer.dropped, 0u);
+
+    consumer.release.set_value();
+    std::promise<void> finished;
+    queue.finish([&finished] () { finished.set_value(); });
+    ASSERT_EQ(finished.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+
+    std::lock_guard<std::mutex> g(consumer.mtx);
+    EXPECT_EQ(consumer.lines.front(), "a");
+    // Batch the worker waited with, and a full queue.
+    EXPECT_LE(consumer.lines.size(), 3u + 3u);
+}
+
+TEST(IngestQueue, testIdleAfterBatch)
+{
+    Consumer consumer;
+    std::atomic<size_t> idle{0};
+    IngestQueue::Worker worker;
+    IngestQueue queue(worker, IngestQueue::Policy::Block, 4, consumer.onLines(false), consumer.onDropped(),
+                      [&idle] () { idle++; });
+
+    queue.push(batch({"a"}));
+    for (int i = 0; i < 100 && idle == 0u; i++) {
+        std::this_thread::sleep_for(IngestQueue::kIdleTime / 10);
+    }
+    EXPECT_EQ(idle, 1u);
+
+    std::promise<void> finished;
+    queue.finish([&finished] () { finished.set_value(); });
+    ASSERT_EQ(finished.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_EQ(idle, 2u);
+}
+
+TEST(IngestQueue, testThrottleUntilDrained)
+{
+    Consumer consumer;
+    IngestQueue::Worker worker;
+    IngestQueue queue(worker, IngestQueue::Policy::Block, 2, consumer.onLines(true), consumer.onDropped());
+
+    // The first batch is taken by the worker, which waits in the consumer.
+    queue.push(batch({"a"}));
+    for (int i = 0; i < 100 && !queue.throttle([](){}); i++) {
+        queue.push(batch({"b"}));
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    std::promise<void> space;
+    ASSERT_TRUE(queue.throttle([&space] () { space.set_value(); }));
+    auto hasSpace = space.get_future();
+    EXPECT_EQ(hasSpace.wait_for(std::chrono::milliseconds(50)), std::future_status::timeout);
+
+    consumer.release.set_value();
+    ASSERT_EQ(hasSpace.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_FALSE(queue.throttle([](){}));
+    EXPECT_EQ(consumer.dropped, 0u);
+}
+
+TEST(IngestQueue, testQueuesShareWorker)
+{
+    Consumer first;
+    Consumer second;
+    IngestQueue::Worker worker;
+    IngestQueue a(worker, IngestQueue::Policy::Block, 4, first.onLines(false), first.onDropped());
+    IngestQueue b(worker, IngestQueue::Policy::Block, 4, second.onLines(false), second.onDropped());
+
+    std::vector<std::string> lines;
+    for (int i = 0; i < 100; i++) {
+        lines.push_back("line " + std::to_string(i));
+    }
+    for (size_t i = 0; i < lines.size(); i += 5) {
+        a.push(batch({lines.begin() + i, lines.begin() + i + 5}));
+        b.push(batch({lines.begin() + i, lines.begin() + i + 5}));
+        a.waitForSpace();
+        b.waitForSpace();
+    }
+
+    std::promise<void> finishedA;
+    std::promise<void> finishedB;
+    a.finish([&finishedA] () { finishedA.set_value(); });
+    b.finish([&finishedB] () { finishedB.set_value(); });
+    ASSERT_EQ(finishedA.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    ASSERT_EQ(finishedB.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+
+    EXPECT_EQ(first.lines, lines);
+    EXPECT_EQ(second.lines, lines);
+}
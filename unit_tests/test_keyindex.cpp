@@ -0,0 +1,46 @@
+#include "gtest/gtest.h"
+
+#include "src/KeyIndex.hpp"
+
+TEST(KeyIndex, testExtractKeys)
+{
+    KeyIndex keys;
+    EXPECT_TRUE(keys.addKey("request", "request=(?<id>\\w+)"));
+    EXPECT_TRUE(keys.addKey("trace", "trace-[0-9a-f]+"));
+    EXPECT_FALSE(keys.addKey("invalid", "("));
+
+    auto found = keys.find("GET / request=abc trace-12f");
+    ASSERT_EQ(found.size(), 2U);
+    EXPECT_EQ(found[0], KeyIndex::Found(0u, "abc"));
+    EXPECT_EQ(found[1], KeyIndex::Found(1u, "trace-12f"));
+    EXPECT_EQ(keys.getName(1u), "trace");
+
+    EXPECT_TRUE(keys.find("no keys here").empty());
+}
+
+TEST(KeyIndex, testLinesByKey)
+{
+    KeyIndex keys;
+    keys.addKey("request", "req=(\\d+)");
+
+    // Ids far apart take several bytes per delta
+    for (size_t lineId = 0; lineId < 100000u; lineId += 7u) {
+        keys.add("req=" + std::to_string(lineId % 3u) + " done", lineId);
+    }
+    keys.add("unrelated", 100001u);
+
+    EXPECT_EQ(keys.getValueCnt(), 3u);
+    auto lines = keys.getLines(0u, "1");
+    ASSERT_FALSE(lines.empty());
+    for (size_t i = 0; i < lines.size(); i++) {
+        EXPECT_EQ(lines[i] % 3u, 1u);
+        EXPECT_EQ(lines[i] % 7u, 0u);
+        EXPECT_TRUE(i == 0u || lines[i] == lines[i - 1u] + 21u);
+    }
+    EXPECT_EQ(lines.front(), 7u);
+
+    keys.add("req=9", 1u << 30);
+    EXPECT_EQ(keys.getLines(0u, "9"), std::vector<size_t>{1u << 30});
+    EXPECT_TRUE(keys.getLines(0u, "4").empty());
+    EXPECT_TRUE(keys.getLines(1u, "1").empty());
+}
@@ -0,0 +1,77 @@
+#include "gtest/gtest.h"
+
+#include "src/LineSplitter.hpp"
+
+namespace {
+
+std::vector<std::string> collect(const std::vector<std::string_view>& lines) {
+    return {lines.begin(), lines.end()};
+}
+
+} // namespace
+
+TEST(LineSplitter, testSplitWithinBlock)
+{
+    LineSplitter splitter;
+    std::string block = "first\n\nsecond line that is longer than a vector register\nthird\nrest";
+
+    auto lines = collect(splitter.split(block.data(), block.size()));
+    ASSERT_EQ(lines.size(), 3U);
+    EXPECT_EQ(lines[0], "first");
+    EXPECT_EQ(lines[1], "second line that is longer than a vector register");
+    EXPECT_EQ(lines[2], "third");
+
+    lines = collect(splitter.flush());
+    ASSERT_EQ(lines.size(), 1U);
+    EXPECT_EQ(lines[0], "rest");
+    EXPECT_EQ(splitter.flush().empty(), true);
+}
+
+TEST(LineSplitter, testLineAcrossBlocks)
+{
+    LineSplitter splitter;
+    std::string input = "alpha\nbeta gamma delta epsilon zeta eta theta\niota\n";
+
+    // Feed the input in every possible block size
+    for (size_t blockSize = 1; blockSize <= input.size(); blockSize++) {
+        std::vector<std::string> lines;
+        for (size_t i = 0; i < input.size(); i += blockSize) {
+            auto batch = collect(splitter.split(input.data() + i, std::min(blockSize, input.size() - i)));
+            lines.insert(lines.end(), batch.begin(), batch.end());
+        }
+        ASSERT_EQ(lines.size(), 3U) << blockSize;
+        EXPECT_EQ(lines[0], "alpha");
+        EXPECT_EQ(lines[1], "beta gamma delta epsilon zeta eta theta");
+        EXPECT_EQ(lines[2], "iota");
+    }
+}
+
+TEST(LineSplitter, testMaximumLineLength)
+{
+    LineSplitter splitter(8);
+    std::string block = "0123456789";
+
+    auto lines = collect(splitter.split(block.data(), block.size()));
+    ASSERT_EQ(lines.size(), 1U);
+    EXPECT_EQ(lines[0], "0123456789");
+
+    block = "ab\n";
+    lines = collect(splitter.split(block.data(), block.size()));
+    ASSERT_EQ(lines.size(), 1U);
+    EXPECT_EQ(lines[0], "ab");
+}
+
+TEST(LineSplitter, testForEachNewline)
+{
+    std::string block(1000, 'x');
+    std::vector<size_t> expected = {0, 15, 16, 31, 32, 63, 64, 500, 998, 999};
+    for (auto position : expected) {
+        block[position] = '\n';
+    }
+
+    std::vector<size_t> found;
+    LineSplitter::forEachNewline(block.data(), block.data() + block.size(), [&](const char* newline) {
+        found.push_back(newline - block.data());
+    });
+    EXPECT_EQ(found, expected);
+}
@@ -0,0 +1,256 @@
+#include "gtest/gtest.h"
+
+#include <sys/stat.h>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#include "src/LogReader.hpp"
+
+namespace {
+
+struct Received {
+    std::mutex mtx;
+    std::vector<std::string> lines;
+    std::atomic<bool> stopped{false};
+
+    LogReader::OnReadLines appender() {
+        return [this] (const std::vector<std::string_view>& batch) {
+            std::lock_guard<std::mutex> g(mtx);
+            lines.insert(lines.end(), batch.begin(), batch.end());
+        };
+    }
+
+    LogReader::OnStop onStop() {
+        return [this] () { stopped = true; };
+    }
+
+    bool waitFor(size_t cnt) {
+        for (int i = 0; i < 500; i++) {
+            {
+                std::lock_guard<std::mutex> g(mtx);
+                if (lines.size() >= cnt) {
+                    return true;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return false;
+    }
+};
+
+std::string tempPath(const std::string& name) {
+    return ::testing::TempDir() + "logalizer_" + name;
+}
+
+} // namespace
+
+TEST(LogReader, testReadingAndFollowingFile)
+{
+    auto path = tempPath("follow.log");
+    std::ofstream(path) << "one\n\ntwo\nthree";
+
+    Received received;
+    Reactor reactor;
+    LogReader reader(reactor, path, received.onStop(), received.appender());
+
+    ASSERT_EQ(received.waitFor(2), true);
+    EXPECT_EQ(received.lines[0], "one");
+    EXPECT_EQ(received.lines[1], "two");
+
+    // The last line is still being written
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    {
+        std::lock_guard<std::mutex> g(received.mtx);
+        EXPECT_EQ(received.lines.size(), 2u);
+    }
+
+    std::ofstream(path, std::ios::app) << " continued\n";
+    ASSERT_EQ(received.waitFor(3), true);
+    EXPECT_EQ(received.lines[2], "three continued");
+    EXPECT_EQ(received.stopped, false);
+
+    std::remove(path.c_str());
+}
+
+TEST(LogReader, testFollowingTruncatedFile)
+{
+    auto path = tempPath("truncated.log");
+    std::ofstream(path) << "first line\nsecond line\n";
+
+    Received received;
+    Reactor reactor;
+    LogReader reader(reactor, path, received.onStop(), received.appender());
+    ASSERT_EQ(received.waitFor(2), true);
+
+    std::ofstream(path) << "new\n";
+    ASSERT_EQ(received.waitFor(3), true);
+    EXPECT_EQ(received.lines[2], "new");
+
+    std::remove(path.c_str());
+}
+
+TEST(LogReader, testFollowingRotatedFile)
+{
+    auto path = tempPath("rotated.log");
+    auto rotated = path + ".1";
+    std::ofstream(path) << "old\n";
+
+    Received received;
+    Reactor reactor;
+    LogReader reader(reactor, path, received.onStop(), received.appender());
+    ASSERT_EQ(received.waitFor(1), true);
+
+    ASSERT_EQ(std::rename(path.c_str(), rotated.c_str()), 0);
+    std::ofstream(rotated, std::ios::app) << "last\n";
+    std::ofstream(path) << "new\n";
+
+    ASSERT_EQ(received.waitFor(3), true);
+    EXPECT_EQ(received.lines[1], "last");
+    EXPECT_EQ(received.lines[2], "new");
+
+    std::ofstream(path, std::ios::app) << "more\n";
+    ASSERT_EQ(received.waitFor(4), true);
+    EXPECT_EQ(received.lines[3], "more");
+
+    std::remove(path.c_str());
+    std::remove(rotated.c_str());
+}
+
+TEST(LogReader, testLinesAcrossChunks)
+{
+    auto path = tempPath("chunks.log");
+    std::string longLine(1000000, 'x');
+    {
+        std::ofstream file(path);
+        for (int i = 0; i < 100000; i++) {
+            file << "line " << i << "\n";
+        }
+        file << longLine << "\nlast\n";
+    }
+
+    Received received;
+    Reactor reactor;
+    LogReader reader(reactor, path, received.onStop(), received.appender());
+
+    ASSERT_EQ(received.waitFor(100002), true);
+    EXPECT_EQ(received.lines[0], "line 0");
+    EXPECT_EQ(received.lines[54321], "line 54321");
+    EXPECT_EQ(received.lines[100000], longLine);
+    EXPECT_EQ(received.lines[100001], "last");
+
+    std::remove(path.c_str());
+}
+
+TEST(LogReader, testFifoEndAndImmediateStop)
+{
+    auto path = tempPath("input.fifo");
+    std::remove(path.c_str());
+    ASSERT_EQ(::mkfifo(path.c_str(), 0600), 0);
+
+    Received received;
+    Reactor reactor;
+    auto reader = std::make_unique<LogReader>(reactor, path, received.onStop(), received.appender());
+
+    {
+        std::ofstream fifo(path);
+        fifo << "first\nsecond\n" << std::flush;
+        ASSERT_EQ(received.waitFor(2), true);
+
+        // Stopping does not wait for the writer
+        auto start = std::chrono::steady_clock::now();
+        reader.reset();
+        EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(100));
+    }
+
+    EXPECT_EQ(received.lines.size(), 2U);
+    std::remove(path.c_str());
+}
+
+TEST(LogReader, testFifoWriterClosing)
+{
+    auto path = tempPath("closing.fifo");
+    std::remove(path.c_str());
+    ASSERT_EQ(::mkfifo(path.c_str(), 0600), 0);
+
+    Received received;
+    Reactor reactor;
+    LogReader reader(reactor, path, received.onStop(), received.appender());
+
+    std::ofstream(path) << "only\nunterminated";
+
+    ASSERT_EQ(received.waitFor(2), true);
+    for (int i = 0; i < 100 && !received.stopped; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(received.stopped, true);
+    EXPECT_EQ(received.lines[1], "unterminated");
+    std::remove(path.c_str());
+}
+
+TEST(LogReader, testDeferredStartAtOffset)
+{
+    auto path = tempPath("offset.log");
+    std::ofstream(path) << "indexed\nalready\nfresh\nlines";
+
+    Received received;
+    Reactor reactor;
+    LogReader reader(reactor, path, received.onStop(), received.appender(), false, true);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_TRUE(received.lines.empty());
+
+    reader.start(16);
+    ASSERT_EQ(received.waitFor(2), true);
+    EXPECT_EQ(received.lines[0], "fresh");
+    EXPECT_EQ(received.lines[1], "lines");
+
+    std::remove(path.c_str());
+}
+
+TEST(LogReader, testThrottlePausesReading)
+{
+    auto path = tempPath("throttle.log");
+    {
+        // Several chunks, read one at a time
+        std::ofstream file(path);
+        for (int i = 0; i < 100000; i++) {
+            file << "line " << i << "\n";
+        }
+    }
+
+    Received received;
+    Reactor reactor;
+    LogReader reader(reactor, path, received.onStop(), received.appender(), false, true);
+
+    std::mutex mtx;
+    std::function<void()> resume;
+    reader.setThrottle([&mtx, &resume] (std::function<void()> onSpace) {
+        std::lock_guard<std::mutex> g(mtx);
+        resume = onSpace;
+        return true;
+    });
+    reader.start();
+
+    ASSERT_EQ(received.waitFor(1), true);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    size_t paused;
+    {
+        std::lock_guard<std::mutex> g(received.mtx);
+        paused = received.lines.size();
+    }
+    EXPECT_LT(paused, 100000u);
+
+    reader.setThrottle({});
+    {
+        std::lock_guard<std::mutex> g(mtx);
+        resume();
+    }
+    ASSERT_EQ(received.waitFor(100000), true);
+    EXPECT_EQ(received.lines.back(), "line 99999");
+
+    std::remove(path.c_str());
+}
@@ -0,0 +1,163 @@
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include "src/NetReader.hpp"
+
+namespace {
+
+struct Received {
+    std::mutex mtx;
+    std::vector<std::string> lines;
+
+    NetReader::OnReadLines appender() {
+        return [this] (const std::vector<std::string_view>& batch) {
+            std::lock_guard<std::mutex> g(mtx);
+            lines.insert(lines.end(), batch.begin(), batch.end());
+        };
+    }
+
+    bool waitFor(size_t cnt) {
+        for (int i = 0; i < 500; i++) {
+            {
+                std::lock_guard<std::mutex> g(mtx);
+                if (lines.size() >= cnt) {
+                    return true;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return false;
+    }
+};
+
+sockaddr_in loopback(uint16_t port) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return addr;
+}
+
+void sendStream(uint16_t port, const std::string& data) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    auto addr = loopback(port);
+    ASSERT_EQ(::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+    ASSERT_EQ(::write(fd, data.data(), data.size()), static_cast<ssize_t>(data.size()));
+    ::close(fd);
+}
+
+} // namespace
+
+TEST(NetReader, testParseProtocol)
+{
+    NetReader::Protocol protocol;
+    EXPECT_EQ(NetReader::parseProtocol("udp", &protocol), true);
+    EXPECT_EQ(protocol, NetReader::Protocol::Udp);
+    EXPECT_EQ(NetReader::parseProtocol("raw", &protocol), true);
+    EXPECT_EQ(protocol, NetReader::Protocol::Raw);
+    EXPECT_EQ(NetReader::parseProtocol("sctp", &protocol), false);
+}
+
+TEST(NetReader, testUdpDatagrams)
+{
+    Received received;
+    Reactor reactor;
+    NetReader reader(reactor, NetReader::Protocol::Udp, "127.0.0.1:0", [](){}, received.appender());
+    ASSERT_EQ(reader.isOpen(), true);
+
+    int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    auto addr = loopback(reader.getPort());
+
+    const size_t kMessages = 20000;
+    for (size_t i = 0; i < kMessages; i++) {
+        auto message = "<34>1 2003-10-11T22:14:15.003Z host app - - - message " + std::to_string(i) + "\n";
+        ::sendto(fd, message.data(), message.size(), 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    }
+    ::close(fd);
+
+    ASSERT_EQ(received.waitFor(kMessages), true);
+    EXPECT_EQ(received.lines.size(), kMessages);
+    EXPECT_EQ(received.lines[0], "<34>1 2003-10-11T22:14:15.003Z host app - - - message 0");
+    EXPECT_EQ(received.lines.back(), "<34>1 2003-10-11T22:14:15.003Z host app - - - message 19999");
+}
+
+TEST(NetReader, testTcpSyslogFraming)
+{
+    Received received;
+    Reactor reactor;
+    NetReader reader(reactor, NetReader::Protocol::Tcp, "127.0.0.1:0", [](){}, received.appender());
+    ASSERT_EQ(reader.isOpen(), true);
+
+    // Octet counted message with an embedded newline, then newline framing
+    sendStream(reader.getPort(), "11 <13>one\ntwo<13>three\n8 <13>four");
+
+    ASSERT_EQ(received.waitFor(3), true);
+    EXPECT_EQ(received.lines[0], "<13>one\ntwo");
+    EXPECT_EQ(received.lines[1], "<13>three");
+    EXPECT_EQ(received.lines[2], "<13>four");
+}
+
+TEST(NetReader, testTcpFramingFallback)
+{
+    Received received;
+    Reactor reactor;
+    NetReader reader(reactor, NetReader::Protocol::Tcp, "127.0.0.1:0", [](){}, received.appender());
+    ASSERT_EQ(reader.isOpen(), true);
+
+    // Leading digits without a space, too many of them or too large a
+    // count don't make an octet count
+    sendStream(reader.getPort(), "2024-01-01 first\n2024-01-02 second\n99999999999 third\n100000 fourth\n5 fifth");
+
+    ASSERT_EQ(received.waitFor(5), true);
+    EXPECT_EQ(received.lines[0], "2024-01-01 first");
+    EXPECT_EQ(received.lines[1], "2024-01-02 second");
+    EXPECT_EQ(received.lines[2], "99999999999 third");
+    EXPECT_EQ(received.lines[3], "100000 fourth");
+    EXPECT_EQ(received.lines[4], "fifth");
+}
+
+TEST(NetReader, testLongLines)
+{
+    Received received;
+    Reactor reactor;
+    NetReader reader(reactor, NetReader::Protocol::Raw, "127.0.0.1:0", [](){}, received.appender());
+    ASSERT_EQ(reader.isOpen(), true);
+
+    // Lines of several MB are kept whole, longer ones truncated, without
+    // dropping the client
+    std::string longLine(3u * 1024u * 1024u, 'x');
+    std::string hugeLine(17u * 1024u * 1024u, 'y');
+    sendStream(reader.getPort(), longLine + "\n" + hugeLine + "\nafter\n");
+
+    ASSERT_EQ(received.waitFor(3), true);
+    EXPECT_EQ(received.lines[0], longLine);
+    EXPECT_EQ(received.lines[1], std::string(16u * 1024u * 1024u, 'y'));
+    EXPECT_EQ(received.lines[2], "after");
+}
+
+TEST(NetReader, testInvalidPort)
+{
+    Reactor reactor;
+    for (const char* address : {"abc", "127.0.0.1:abc", "70000", "127.0.0.1:-1", "127.0.0.1:", "12ab"}) {
+        NetReader reader(reactor, NetReader::Protocol::Udp, address, [](){}, [](const std::vector<std::string_view>&){});
+        EXPECT_FALSE(reader.isOpen()) << address;
+    }
+}
+
+TEST(NetReader, testRawLines)
+{
+    Received received;
+    Reactor reactor;
+    NetReader reader(reactor, NetReader::Protocol::Raw, "127.0.0.1:0", [](){}, received.appender());
+    ASSERT_EQ(reader.isOpen(), true);
+
+    sendStream(reader.getPort(), "first\r\n\nsecond\nunterminated");
+
+    ASSERT_EQ(received.waitFor(3), true);
+    EXPECT_EQ(received.lines[0], "first");
+    EXPECT_EQ(received.lines[1], "second");
+    EXPECT_EQ(received.lines[2], "unterminated");
+}
@@ -0,0 +1,78 @@
+#include "gtest/gtest.h"
+
+#include "src/RecordAssembler.hpp"
+
+namespace {
+
+std::vector<std::string> collect(const std::vector<std::string_view>& records) {
+    return {records.begin(), records.end()};
+}
+
+std::vector<std::string_view> batch(const std::vector<std::string>& lines) {
+    return {lines.begin(), lines.end()};
+}
+
+} // namespace
+
+TEST(RecordAssembler, testIndentedLinesContinue)
+{
+    RecordAssembler assembler("indent");
+    std::vector<std::string> lines = {
+        "ERROR failed", "  at a()", "\tat b()", "INFO done", "INFO next"};
+
+    auto records = collect(assembler.add(batch(lines)));
+    ASSERT_EQ(records.size(), 2U);
+    EXPECT_EQ(records[0], "ERROR failed\n  at a()\n\tat b()");
+    EXPECT_EQ(records[1], "INFO done");
+
+    records = collect(assembler.flush());
+    ASSERT_EQ(records.size(), 1U);
+    EXPECT_EQ(records[0], "INFO next");
+    EXPECT_TRUE(assembler.flush().empty());
+}
+
+TEST(RecordAssembler, testRecordAcrossBatches)
+{
+    RecordAssembler assembler("timestamp");
+    std::string input[] = {"2024-01-31 12:00:00 ERROR", "Traceback:", "  File x",
+                           "[12:00:01] INFO", "Jan  5 12:00:02 host sshd", "continued"};
+
+    // The lines of each batch are gone once the batch was added
+    std::vector<std::string> records;
+    for (const auto& line : input) {
+        std::vector<std::string> lines = {line};
+        auto added = collect(assembler.add(batch(lines)));
+        records.insert(records.end(), added.begin(), added.end());
+    }
+    auto flushed = collect(assembler.flush());
+    records.insert(records.end(), flushed.begin(), flushed.end());
+
+    ASSERT_EQ(records.size(), 3U);
+    EXPECT_EQ(records[0], "2024-01-31 12:00:00 ERROR\nTraceback:\n  File x");
+    EXPECT_EQ(records[1], "[12:00:01] INFO");
+    EXPECT_EQ(records[2], "Jan  5 12:00:02 host sshd\ncontinued");
+}
+
+TEST(RecordAssembler, testStartRegex)
+{
+    RecordAssembler assembler("\\d+ ");
+    ASSERT_TRUE(assembler.isValid());
+    EXPECT_FALSE(RecordAssembler("(").isValid());
+
+    std::vector<std::string> lines = {"continued first", "1 one", "two", "22 three"};
+    auto records = collect(assembler.add(batch(lines), true));
+    ASSERT_EQ(records.size(), 3U);
+    EXPECT_EQ(records[0], "continued first");
+    EXPECT_EQ(records[1], "1 one\ntwo");
+    EXPECT_EQ(records[2], "22 three");
+}
+
+TEST(RecordAssembler, testRecordLimit)
+{
+    RecordAssembler assembler("indent");
+    std::vector<std::string> lines(RecordAssembler::kMaxLines + 1u, " more");
+
+    auto records = collect(assembler.add(batch(lines), true));
+    ASSERT_EQ(records.size(), 2U);
+    EXPECT_EQ(records[1], " more");
+}
@@ -0,0 +1,127 @@
+#include "gtest/gtest.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#include "src/Recording.hpp"
+
+namespace {
+
+std::string recordingPath() {
+    return "/tmp/logalizer_recording_" + std::to_string(::getpid()) + ".rec";
+}
+
+struct Replayed {
+    std::mutex mtx;
+    std::vector<std::pair<size_t, std::string>> lines;
+    std::vector<std::chrono::steady_clock::time_point> times;
+
+    Replayer::OnLines appender(size_t input) {
+        return [this, input] (const std::vector<std::string_view>& batch) {
+            std::lock_guard<std::mutex> g(mtx);
+            for (const auto& line : batch) {
+                lines.emplace_back(input, std::string(line));
+            }
+            times.push_back(std::chrono::steady_clock::now());
+        };
+    }
+};
+
+void replay(Replayer* replayer, Replayed* replayed) {
+    std::mutex mtx;
+    std::condition_variable stopped;
+    bool done = false;
+    replayer->start({replayed->appender(0), replayed->appender(1)}, [&](){
+        std::lock_guard<std::mutex> g(mtx);
+        done = true;
+        stopped.notify_one();
+    });
+    std::unique_lock<std::mutex> lock(mtx);
+    stopped.wait(lock, [&done](){ return done; });
+}
+
+} // namespace
+
+TEST(Recording, testParseSpeed)
+{
+    double speed;
+    EXPECT_EQ(Replayer::parseSpeed("1", &speed), true);
+    EXPECT_EQ(speed, 1.0);
+    EXPECT_EQ(Replayer::parseSpeed("2.5", &speed), true);
+    EXPECT_EQ(speed, 2.5);
+    EXPECT_EQ(Replayer::parseSpeed("max", &speed), true);
+    EXPECT_EQ(speed, Replayer::kMaxSpeed);
+    EXPECT_EQ(Replayer::parseSpeed("0", &speed), false);
+    EXPECT_EQ(Replayer::parseSpeed("fast", &speed), false);
+}
+
+TEST(Recording, testReplayKeepsInputsAndOrder)
+{
+    auto path = recordingPath();
+    {
+        Recorder recorder(path);
+        ASSERT_EQ(recorder.isOpen(), true);
+        auto first = recorder.addInput("first");
+        auto second = recorder.addInput("second");
+        recorder.record(first, {"a1", "a2"});
+        recorder.record(second, {std::string(300, 'b')});
+        recorder.record(first, {"", "a3"});
+    }
+
+    Replayer replayer(path, Replayer::kMaxSpeed);
+    ASSERT_EQ(replayer.isOpen(), true);
+    ASSERT_EQ(replayer.getInputs().size(), 2u);
+    EXPECT_EQ(replayer.getInputs()[0], "first");
+    EXPECT_EQ(replayer.getInputs()[1], "second");
+
+    Replayed replayed;
+    replay(&replayer, &replayed);
+
+    std::vector<std::pair<size_t, std::string>> expected = {
+        {0, "a1"}, {0, "a2"}, {1, std::string(300, 'b')}, {0, ""}, {0, "a3"}};
+    EXPECT_EQ(replayed.lines, expected);
+    EXPECT_EQ(replayer.getLineCnt(), 5u);
+
+    ::unlink(path.c_str());
+}
+
+TEST(Recording, testReplayTiming)
+{
+    auto path = recordingPath();
+    {
+        Recorder recorder(path);
+        auto input = recorder.addInput("input");
+        recorder.record(input, {"early"});
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        recorder.record(input, {"late"});
+    }
+
+    // Twice as fast keeps half of the pause between the batches
+    Replayer replayer(path, 2.0);
+    Replayed replayed;
+    replay(&replayer, &replayed);
+
+    ASSERT_EQ(replayed.times.size(), 2u);
+    auto pause = replayed.times[1] - replayed.times[0];
+    EXPECT_GE(pause, std::chrono::milliseconds(90));
+    EXPECT_LT(pause, std::chrono::milliseconds(190));
+
+    ::unlink(path.c_str());
+}
+
+TEST(Recording, testInvalidRecording)
+{
+    auto path = recordingPath();
+    {
+        std::ofstream file(path);
+        file << "not a recording";
+    }
+    EXPECT_EQ(Replayer(path, 1.0).isOpen(), false);
+    EXPECT_EQ(Replayer("/nonexistent/recording", 1.0).isOpen(), false);
+
+    ::unlink(path.c_str());
+}
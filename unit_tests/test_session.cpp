@@ -0,0 +1,233 @@
+#include "gtest/gtest.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <thread>
+
+#include "src/RemoteDataModel.hpp"
+#include "src/SessionServer.hpp"
+
+namespace {
+
+std::string socketPath() {
+    return "/tmp/logalizer_session_" + std::to_string(::getpid()) + ".sock";
+}
+
+bool waitFor(const std::function<bool()>& condition) {
+    for (int i = 0; i < 500; i++) {
+        if (condition()) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+} // namespace
+
+TEST(Session, testAttachToLines)
+{
+    Reactor reactor;
+    DataModel data;
+    auto path = socketPath();
+    SessionServer server(reactor, data, path);
+    ASSERT_EQ(server.isOpen(), true);
+    EXPECT_EQ(SessionServer::isRunning(path), true);
+
+    data.addFilter("ODD", ".*[13579]$");
+    auto appender = data.getAppender("input");
+    for (int i = 0; i < 300; i++) {
+        appender("line " + std::to_string(i));
+    }
+
+    RemoteDataModel remote(path);
+    ASSERT_EQ(remote.isOpen(), true);
+    EXPECT_EQ(remote.getTabCnt(), 2);
+    EXPECT_EQ(remote.getTab(0).name, "ODD");
+    EXPECT_EQ(remote.getTab(0).rowsCnt, 150u);
+    EXPECT_EQ(remote.getVisibleCnt(), 300u);
+    EXPECT_EQ(remote.getPosition(), 0u);
+
+    // Lines are fetched in parts as they are read
+    remote.prepareLines();
+    for (int i = 0; i < 300; i++) {
+        auto line = remote.nextLine();
+        ASSERT_EQ(line.valid, true);
+        EXPECT_EQ(line.text, "line " + std::to_string(i));
+        EXPECT_EQ(line.src, i % 2 == 1 ? 0 : 1);
+    }
+    EXPECT_EQ(remote.nextLine().valid, false);
+
+    // The viewer has its own view of the session
+    remote.toggleTab(0);
+    EXPECT_EQ(remote.getVisibleCnt(), 150u);
+    EXPECT_EQ(remote.scrollTo(10u), true);
+    EXPECT_EQ(remote.scrollDown(), true);
+    EXPECT_EQ(remote.getPosition(), 11u);
+    remote.prepareLines();
+    EXPECT_EQ(remote.nextLine().text, "line 22");
+
+    EXPECT_EQ(data.getVisibleCnt(), 300u);
+    EXPECT_EQ(data.getPosition(), 0u);
+
+    auto templates = remote.getTemplates();
+    ASSERT_EQ(templates.size(), 1u);
+    EXPECT_EQ(templates[0].count, 300u);
+
+    remote.stop();
+}
+
+TEST(Session, testNotifyAndExport)
+{
+    Reactor reactor;
+    DataModel data;
+    auto path = socketPath();
+    SessionServer server(reactor, data, path);
+    ASSERT_EQ(server.isOpen(), true);
+    data.registerOnNewDataAvailableListener([&server](){ server.notify(); });
+
+    RemoteDataModel remote(path);
+    ASSERT_EQ(remote.isOpen(), true);
+    EXPECT_EQ(remote.getVisibleCnt(), 0u);
+
+    std::atomic<int> notified{0};
+    remote.registerOnNewDataAvailableListener([&notified](){ notified++; });
+
+    auto appender = data.getAppender("input");
+    appender("first");
+    appender("second");
+
+    EXPECT_EQ(waitFor([&remote](){ return remote.getVisibleCnt() == 2u; }), true);
+    EXPECT_GT(notified.load(), 0);
+
+    std::string filename = "/tmp/logalizer_session_export_" + std::to_string(::getpid()) + ".txt";
+    size_t exported = 0;
+    EXPECT_EQ(remote.exportVisible(filename, &exported), true);
+    EXPECT_EQ(exported, 2u);
+
+    std::ifstream file(filename);
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(contents, "first\nsecond\n");
+    ::unlink(filename.c_str());
+
+    remote.stop();
+    server.stop();
+    EXPECT_EQ(SessionServer::isRunning(path), false);
+}
+
+TEST(Session, testExportDoesNotBlockViewers)
+{
+    Reactor reactor;
+    DataModel data;
+    auto path = socketPath();
+    SessionServer server(reactor, data, path);
+    ASSERT_EQ(server.isOpen(), true);
+
+    auto appender = data.getAppender("input");
+    appender("first");
+    appender("second");
+
+    // Opening the FIFO blocks the export until it is read
+    std::string fifo = "/tmp/logalizer_session_export_" + std::to_string(::getpid()) + ".fifo";
+    ::unlink(fifo.c_str());
+    ASSERT_EQ(::mkfifo(fifo.c_str(), 0600), 0);
+
+    RemoteDataModel exporter(path);
+    RemoteDataModel viewer(path);
+    ASSERT_EQ(exporter.isOpen(), true);
+    ASSERT_EQ(viewer.isOpen(), true);
+
+    size_t exported = 0;
+    auto exporting = std::async(std::launch::async, [&exporter, &fifo, &exported] () {
+        return exporter.exportVisible(fifo, &exported);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    auto viewing = std::async(std::launch::async, [&viewer] () { return viewer.getVisibleCnt(); });
+    ASSERT_EQ(viewing.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_EQ(viewing.get(), 2u);
+    EXPECT_EQ(exporting.wait_for(std::chrono::seconds(0)), std::future_status::timeout);
+
+    std::ifstream file(fifo);
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(contents, "first\nsecond\n");
+    EXPECT_EQ(exporting.get(), true);
+    EXPECT_EQ(exported, 2u);
+
+    // The exporting viewer is answered again
+    EXPECT_EQ(exporter.getVisibleCnt(), 2u);
+    ::unlink(fifo.c_str());
+
+    exporter.stop();
+    viewer.stop();
+}
+
+TEST(Session, testRelatedLines)
+{
+    Reactor reactor;
+    DataModel data;
+    auto path = socketPath();
+    SessionServer server(reactor, data, path);
+    ASSERT_EQ(server.isOpen(), true);
+
+    data.addKey("request", "req=(\\w+)");
+    auto appender = data.getAppender("input");
+    for (int i = 0; i < 10; i++) {
+        appender("line " + std::to_string(i) + " req=" + std::to_string(i % 3));
+    }
+
+    RemoteDataModel remote(path);
+    ASSERT_EQ(remote.isOpen(), true);
+
+    auto related = remote.scrollToRelated();
+    EXPECT_EQ(related.key, "0");
+    EXPECT_EQ(related.count, 4u);
+    EXPECT_EQ(related.position, 1u);
+    EXPECT_EQ(remote.getPosition(), 3u);
+
+    related = remote.getRelated(2u);
+    EXPECT_EQ(related.position, 1u);
+    ASSERT_EQ(related.lines.size(), 2u);
+    EXPECT_EQ(related.lines[1].text, "line 3 req=0");
+
+    // Each viewer cycles on its own
+    EXPECT_EQ(data.getPosition(), 0u);
+}
+
+TEST(Session, testQuery)
+{
+    Reactor reactor;
+    DataModel data;
+    auto path = socketPath();
+    SessionServer server(reactor, data, path);
+    ASSERT_EQ(server.isOpen(), true);
+    data.registerOnNewDataAvailableListener([&server](){ server.notify(); });
+
+    auto appender = data.getAppender("input");
+    for (int i = 0; i < 100; i++) {
+        appender("line " + std::to_string(i));
+    }
+
+    RemoteDataModel remote(path);
+    ASSERT_EQ(remote.isOpen(), true);
+    EXPECT_EQ(remote.startQuery("("), false);
+    ASSERT_EQ(remote.startQuery("line [0-9]$"), true);
+
+    EXPECT_EQ(waitFor([&remote](){ return remote.getTabCnt() == 2u && remote.getTab(1).indexed == 100u; }), true);
+    EXPECT_EQ(remote.getTab(1).rowsCnt, 10u);
+
+    // Shown only to the viewer enabling it
+    remote.toggleTab(1);
+    EXPECT_EQ(remote.getVisibleCnt(), 10u);
+    EXPECT_EQ(data.getVisibleCnt(), 100u);
+
+    EXPECT_EQ(remote.startQuery(""), true);
+    EXPECT_EQ(remote.getTabCnt(), 1u);
+    EXPECT_EQ(remote.getText(42u), "line 42");
+    data.registerOnNewDataAvailableListener(nullptr);
+}
@@ -0,0 +1,27 @@
+#include "gtest/gtest.h"
+
+#include "src/SpillStore.hpp"
+
+TEST(SpillStore, testAppendAndRead)
+{
+    SpillStore spill;
+    EXPECT_EQ(spill.size(), 0u);
+
+    std::string large(100000, 'x');
+    large.back() = 'y';
+    uint64_t first, second;
+    ASSERT_TRUE(spill.append("first line", &first));
+    ASSERT_TRUE(spill.append(large, &second));
+    EXPECT_EQ(first, 0u);
+    EXPECT_EQ(second, 10u);
+    EXPECT_EQ(spill.size(), 10u + large.size());
+
+    std::string text;
+    ASSERT_TRUE(spill.read(second, large.size(), &text));
+    EXPECT_EQ(text, large);
+    ASSERT_TRUE(spill.read(first + 6u, 4u, &text));
+    EXPECT_EQ(text, "line");
+
+    // Past the end
+    EXPECT_FALSE(spill.read(spill.size(), 1u, &text));
+}
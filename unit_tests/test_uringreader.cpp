@@ -0,0 +1,91 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/UringReader.hpp"
+
+namespace {
+
+std::string tempPath(const std::string& name) {
+    return ::testing::TempDir() + "logalizer_" + name;
+}
+
+} // namespace
+
+TEST(UringReader, testFilesInOrder)
+{
+    // Files of several chunks, an empty one, one missing and one ending
+    // with an incomplete line
+    std::vector<std::string> paths;
+    std::vector<std::vector<std::string>> expected;
+    for (int i = 0; i < 5; i++) {
+        paths.push_back(tempPath("rotated.log." + std::to_string(i)));
+        expected.emplace_back();
+        std::ofstream file(paths.back());
+        int cnt = i == 1 ? 0 : i == 3 ? 100 : 30000 * (i + 1);
+        for (int j = 0; j < cnt; j++) {
+            expected.back().push_back("file " + std::to_string(i) + " line " + std::to_string(j)
+                                      + " " + std::string(j % 40, 'x'));
+            file << expected.back().back() << "\n";
+        }
+        if (i == 3) {
+            file << "incomplete";
+        }
+    }
+    std::remove(paths[2].c_str());
+    expected[2].clear();
+
+    std::mutex mtx;
+    std::vector<std::vector<std::string>> lines(paths.size());
+    std::vector<size_t> order;
+    std::vector<size_t> ends(paths.size(), SIZE_MAX);
+    std::atomic<size_t> done{0u};
+    size_t lastFile = 0u;
+
+    UringReader reader(paths,
+        [&](size_t file, const std::vector<std::string_view>& batch) {
+            std::lock_guard<std::mutex> g(mtx);
+            EXPECT_GE(file, lastFile);
+            lastFile = file;
+            lines[file].insert(lines[file].end(), batch.begin(), batch.end());
+        },
+        nullptr,
+        [&](size_t file, size_t end) {
+            std::lock_guard<std::mutex> g(mtx);
+            order.push_back(file);
+            ends[file] = end;
+            done++;
+        },
+        4u);
+    if (!reader.isOpen()) {
+        GTEST_SKIP() << "io_uring isn't available";
+    }
+
+    for (int i = 0; i < 1000 && done < paths.size(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(done, paths.size());
+
+    std::lock_guard<std::mutex> g(mtx);
+    EXPECT_EQ(order, std::vector<size_t>({0u, 1u, 2u, 3u, 4u}));
+    for (size_t i = 0; i < paths.size(); i++) {
+        EXPECT_EQ(lines[i], expected[i]) << "file " << i;
+        std::remove(paths[i].c_str());
+    }
+
+    // The incomplete line is left to a reader continuing
+    size_t size = 0u;
+    for (const auto& line : expected[3]) {
+        size += line.size() + 1u;
+    }
+    EXPECT_EQ(ends[1], 0u);
+    EXPECT_EQ(ends[2], 0u);
+    EXPECT_EQ(ends[3], size);
+}